@@ -0,0 +1,200 @@
+//  ===========================================================================
+//  Asynchronous control test for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+/*
+    Usage: test_ctl [rate_hz] [poll_ms] [seconds]
+
+    Streams scans from a simulated sensor (urg-sim.h) and, from another
+    thread, polls II through urg-ctl.h every poll_ms. Halfway through it
+    changes the motor speed with CR, which has to suspend the stream.
+    Reports scans received against scans sent, and the poll round trip.
+
+    gcc -DURG_NO_MAIN -D_GNU_SOURCE -O2 -o test_ctl test_ctl.c urg-multi.c
+        urg-parser.c urg-raw.c urg-model.c urg-io.c urg-uring.c urg-ctl.c
+        urg-sim.c -lpthread -lm
+*/
+
+//  ===========================================================================
+
+#include <unistd.h>	    // UNIX standard function definitions.
+#include <stdio.h>	    // Standard Input/Output definitions.
+#include <stdlib.h>
+#include <string.h>	    // String function definitions.
+#include <stdint.h>	    // Standard type definitions.
+#include <pthread.h>
+
+#include "urg-multi.h"
+#include "urg-parser.h"
+#include "urg-io.h"
+#include "urg-ctl.h"
+#include "urg-sim.h"
+
+#define SCAN_CMD "MD0044072501000"
+
+static ctl_t       ctl;
+static atomic_bool done;
+static int         poll_ms;
+static int         seconds;
+
+/* Poller results. */
+static uint32_t polls;
+static uint32_t failed;
+static uint64_t rtt_sum;
+static uint64_t rtt_max;
+static char     cr_status[3];
+
+//  ===========================================================================
+//  Counts scans.
+//  ===========================================================================
+static void count_scan(const scan_t *scan, void *arg)
+{
+    (void)scan;
+    (*(uint64_t *)arg)++;
+}
+
+//  ===========================================================================
+//  Polls II and changes motor speed once, as another thread would.
+//  ===========================================================================
+static void *poller(void *arg)
+{
+    ctl_cmd_t cmd;
+    uint64_t  rtt;
+    uint64_t  cr = host_time() + seconds * 500000ULL;
+
+    (void)arg;
+
+    while (!atomic_load(&done))
+    {
+        if (cr && host_time() >= cr)
+        {
+            cr = 0;
+            if (ctl_submit(&ctl, &cmd, "CR00", NULL, NULL) == 0 &&
+                ctl_wait(&ctl, &cmd, 2000) == 0)
+                memcpy(cr_status, cmd.status, sizeof(cr_status));
+            continue;
+        }
+
+        if (ctl_submit(&ctl, &cmd, CMD_GET_RUN_STATE, NULL, NULL) < 0 ||
+            ctl_wait(&ctl, &cmd, 2000) < 0)
+        {
+            failed++;
+        }
+        else
+        {
+            rtt = cmd.replied - cmd.sent;
+            rtt_sum += rtt;
+            if (rtt > rtt_max) rtt_max = rtt;
+            polls++;
+        }
+
+        usleep(poll_ms * 1000);
+    }
+
+    return NULL;
+}
+
+//  ===========================================================================
+//  Runs one backend.
+//  ===========================================================================
+static int run(int backend, int rate)
+{
+    static sim_t    sim;
+    static parser_t parser;
+    static serial_t serial;
+    ctl_cmd_t stream;
+    ctl_cmd_t stop;
+    pthread_t thread;
+    uint64_t  scans = 0;
+    uint64_t  sent;
+    uint64_t  end;
+    io_t io;
+
+    polls = failed = 0;
+    rtt_sum = rtt_max = 0;
+    cr_status[0] = STRING_NULL;
+    atomic_store(&done, false);
+
+    if (io_init(&io, backend) < 0) return -1;
+    if (sim_open(&sim, rate) < 0) return -1;
+    if (serial_open(&serial, sim.path, BIT_RATE_0) < 0) return -1;
+
+    parser_init(&parser, count_scan, NULL, &scans);
+    if (io_add(&io, serial.fd, &parser) < 0) return -1;
+    if (ctl_init(&ctl, &io, serial.fd, &parser) < 0) return -1;
+
+    ctl_submit(&ctl, &stream, SCAN_CMD, NULL, NULL);
+    while (atomic_load(&stream.state) == CTL_PENDING) io_poll(&io, 10);
+
+    sent = atomic_load(&sim.scans);
+    scans = 0;
+    pthread_create(&thread, NULL, poller, NULL);
+
+    end = host_time() + seconds * 1000000ULL;
+    while (host_time() < end)
+    {
+        io_poll(&io, 10);
+        ctl_run(&ctl);
+    }
+
+    atomic_store(&done, true);
+    while (pthread_tryjoin_np(thread, NULL) != 0)
+    {
+        io_poll(&io, 10);
+        ctl_run(&ctl);
+    }
+
+    ctl_submit(&ctl, &stop, CMD_SET_LASER_OFF, NULL, NULL);
+    while (atomic_load(&stop.state) == CTL_PENDING)
+    {
+        io_poll(&io, 10);
+        ctl_run(&ctl);
+    }
+    sent = atomic_load(&sim.scans) - sent;
+
+    printf("%-9s %6llu/%llu scans %4u polls %2u failed %7.1f us avg "
+           "%7.1f us max rtt, CR %s, %u suspends %u unmatched\n",
+           io.ops->name, (unsigned long long)scans,
+           (unsigned long long)sent, polls, failed,
+           polls ? (double)rtt_sum / polls : 0.0, (double)rtt_max,
+           cr_status[0] ? cr_status : "failed", ctl.suspends,
+           ctl.unmatched);
+
+    io_free(&io);
+    ctl_free(&ctl);
+    serial_close(&serial);
+    sim_close(&sim);
+
+    return 0;
+}
+
+//  ===========================================================================
+//  Main.
+//  ===========================================================================
+int main(int argc, char *argv[])
+{
+    int rate = (argc > 1) ? atoi(argv[1]) : SIM_RATE;
+
+    poll_ms = (argc > 2) ? atoi(argv[2]) : 50;
+    seconds = (argc > 3) ? atoi(argv[3]) : 3;
+
+    printf("%d Hz, II every %d ms for %d s.\n", rate, poll_ms, seconds);
+
+    run(IO_EPOLL, rate);
+    if (run(IO_URING, rate) < 0) printf("io_uring not available.\n");
+
+    return 0;
+}
@@ -0,0 +1,157 @@
+//  ===========================================================================
+//  App for benchmarking the reader backends on simulated sensors.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+/*
+    Usage: test_io [sensors] [rate_hz] [seconds]
+
+    Runs the same number of simulated sensors (urg-sim.h) against each
+    backend in turn and reports the reader thread's CPU time and system
+    calls per scan.
+
+    gcc -DURG_NO_MAIN -D_GNU_SOURCE -O2 -o test_io test_io.c urg-multi.c
+        urg-parser.c urg-raw.c urg-model.c urg-io.c urg-uring.c urg-sim.c -lpthread -lm
+*/
+
+//  ===========================================================================
+
+#include <unistd.h>	    // UNIX standard function definitions.
+#include <stdio.h>	    // Standard Input/Output definitions.
+#include <stdlib.h>
+#include <string.h>	    // String function definitions.
+#include <stdint.h>	    // Standard type definitions.
+#include <time.h>       // Clock definitions.
+
+#include "urg-multi.h"
+#include "urg-parser.h"
+#include "urg-io.h"
+#include "urg-sim.h"
+
+#define SCAN_CMD "MD0044072501000\n"
+
+//  ===========================================================================
+//  Counts scans.
+//  ===========================================================================
+static void count_scan(const scan_t *scan, void *arg)
+{
+    (void)scan;
+    (*(uint64_t *)arg)++;
+}
+
+//  ===========================================================================
+//  Returns CPU time used by this thread (us).
+//  ===========================================================================
+static uint64_t thread_time(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+//  ===========================================================================
+//  Runs one backend.
+//  ===========================================================================
+static int run(int backend, int sensors, int rate, int seconds)
+{
+    static sim_t    sim[IO_SOURCES_MAX];
+    static parser_t parser[IO_SOURCES_MAX];
+    static serial_t serial[IO_SOURCES_MAX];
+    uint64_t scans = 0;
+    uint64_t missed = 0;
+    uint64_t errors = 0;
+    uint64_t start, end, cpu;
+    io_t io;
+    int  i;
+
+    if (io_init(&io, backend) < 0) return -1;
+
+    for (i = 0; i < sensors; i++)
+    {
+        if (sim_open(&sim[i], rate) < 0) return -1;
+        if (serial_open(&serial[i], sim[i].path, BIT_RATE_0) < 0) return -1;
+
+        parser_init(&parser[i], count_scan, NULL, &scans);
+        if (io_add(&io, serial[i].fd, &parser[i]) < 0) return -1;
+
+        write(serial[i].fd, SCAN_CMD, strlen(SCAN_CMD));
+    }
+
+    // Let every simulator get going before measuring.
+    end = host_time() + 200000;
+    while (host_time() < end) io_poll(&io, 10);
+
+    scans = 0;
+    io.syscalls = 0;
+    io.reads = 0;
+    for (i = 0; i < sensors; i++) atomic_store(&sim[i].missed, 0);
+
+    start = host_time();
+    end = start + seconds * 1000000ULL;
+    cpu = thread_time();
+
+    while (host_time() < end) io_poll(&io, 10);
+
+    cpu = thread_time() - cpu;
+
+    for (i = 0; i < sensors; i++)
+    {
+        write(serial[i].fd, CMD_SET_LASER_OFF LF, 3);
+        missed += atomic_load(&sim[i].missed);
+        errors += parser[i].errors;
+    }
+
+    printf("%-9s %6llu scans %8.1f/s %6.2f syscalls/scan "
+           "%6.2f reads/scan %7.1f us cpu/scan %llu missed %llu errors\n",
+           io.ops->name, (unsigned long long)scans,
+           scans * 1e6 / (host_time() - start),
+           scans ? (double)io.syscalls / scans : 0.0,
+           scans ? (double)io.reads / scans : 0.0,
+           scans ? (double)cpu / scans : 0.0,
+           (unsigned long long)missed, (unsigned long long)errors);
+
+    io_free(&io);
+
+    for (i = 0; i < sensors; i++)
+    {
+        serial_close(&serial[i]);
+        sim_close(&sim[i]);
+    }
+
+    return 0;
+}
+
+//  ===========================================================================
+//  Main.
+//  ===========================================================================
+int main(int argc, char *argv[])
+{
+    int sensors = (argc > 1) ? atoi(argv[1]) : 16;
+    int rate    = (argc > 2) ? atoi(argv[2]) : 100;
+    int seconds = (argc > 3) ? atoi(argv[3]) : 3;
+
+    if (sensors < 1 || sensors > IO_SOURCES_MAX) sensors = 16;
+
+    printf("%d sensors at %d Hz for %d s.\n", sensors, rate, seconds);
+
+    run(IO_EPOLL, sensors, rate, seconds);
+    if (run(IO_URING, sensors, rate, seconds) < 0)
+        printf("io_uring not available.\n");
+
+    return 0;
+}
@@ -0,0 +1,161 @@
+//  ===========================================================================
+//  App for benchmarking line extraction on a simulated scan.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+#include <stdio.h>	    // Standard Input/Output definitions.
+#include <stdlib.h>
+#include <stdint.h>	    // Standard type definitions.
+#include <math.h>       // Maths definitions.
+#include <time.h>       // Clock definitions.
+
+#include "urg-multi.h"
+#include "urg-lines.h"
+
+#define RUNS 1000
+
+//  ===========================================================================
+//  Simulates a scan of a 4 m x 3 m room with the sensor off centre.
+//  ===========================================================================
+void simulate_room(const spec_t *spec, scan_t *scan)
+{
+    float angle;
+    float c, s;
+    float t, t_min;
+    int   i;
+
+    scan->first = spec->step_min;
+    scan->cluster = 1;
+    scan->count = spec->step_max - spec->step_min + 1;
+
+    for (i = 0; i < scan->count; i++)
+    {
+        angle = (scan->first + i - spec->step_front) * 2.0f * M_PI
+              / spec->ang_res;
+        c = cosf(angle);
+        s = sinf(angle);
+
+        // Walls at x = -1, 3 and y = -1, 2.
+        t_min = INFINITY;
+        if (c > 0 && (t = 3.0f / c) < t_min) t_min = t;
+        if (c < 0 && (t = -1.0f / c) < t_min) t_min = t;
+        if (s > 0 && (t = 2.0f / s) < t_min) t_min = t;
+        if (s < 0 && (t = -1.0f / s) < t_min) t_min = t;
+
+        // Add up to +/- 10 mm of noise.
+        scan->range[i] = t_min * 1000.0f + (rand() % 21) - 10;
+    }
+}
+
+//  ===========================================================================
+//  Checks a zigzag that splits into more segments than half the points.
+//  ===========================================================================
+static int test_zigzag(lines_t *lines, points_t *points)
+{
+    int i;
+
+    points->count = 1000;
+    for (i = 0; i < points->count; i++)
+    {
+        points->x[i] = 0.001f * i;
+        points->y[i] = 1.0f + 0.01f * (i & 1);
+    }
+
+    lines_init(lines, 0.001f, 0.2f, 0.01f, 2, 0.0f);
+    lines_extract(lines, points);
+
+    printf("Zigzag:  %d segments from %d points, %s.\n", lines->count,
+           points->count, lines->count <= LINES_MAX ? "ok" : "FAILED");
+
+    return (lines->count <= LINES_MAX) ? 0 : -1;
+}
+
+//  ===========================================================================
+//  Checks collinear walls either side of a doorway stay apart.
+//  ===========================================================================
+static int test_doorway(lines_t *lines, points_t *points)
+{
+    int n = 0;
+    int i;
+
+    // Walls at y = 1 for x in [-3, -2.02] and [0, 0.98], 20 mm apart.
+    for (i = 0; i < 50; i++, n++)
+    {
+        points->x[n] = -3.0f + 0.02f * i;
+        points->y[n] = 1.0f;
+    }
+    for (i = 0; i < 50; i++, n++)
+    {
+        points->x[n] = 0.02f * i;
+        points->y[n] = 1.0f;
+    }
+    points->count = n;
+
+    lines_init(lines, 0.03f, 0.2f, 0.01f, 8, 0.2f);
+    lines_extract(lines, points);
+
+    printf("Doorway: %d segments, %s.\n", lines->count,
+           lines->count == 2 ? "ok" : "FAILED");
+
+    return (lines->count == 2) ? 0 : -1;
+}
+
+//  ===========================================================================
+//  Main routine.
+//  ===========================================================================
+int main(void)
+{
+    static scan_t   scan;
+    static points_t points;
+    static lines_t  lines;
+
+    spec_t spec = {"Simulated", 20, 5600, 1024, 44, 725, 384, 600};
+    struct timespec start, end;
+    double elapsed;
+    int    err;
+    int    i;
+
+    simulate_room(&spec, &scan);
+    scan_to_points(&spec, &scan, &points);
+    lines_init(&lines, 0.03f, 0.2f, 0.01f, 8, 0.2f);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < RUNS; i++) lines_extract(&lines, &points);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    elapsed = (end.tv_sec - start.tv_sec) * 1e6
+            + (end.tv_nsec - start.tv_nsec) / 1e3;
+
+    printf("Extracted %d segments from %d points.\n", lines.count,
+                                                       points.count);
+    printf("Time per scan = %.1f us.\n\n", elapsed / RUNS);
+
+    for (i = 0; i < lines.count; i++)
+    {
+        printf("\t(%6.3f, %6.3f) - (%6.3f, %6.3f) "
+               "alpha = %6.3f r = %5.3f sd(r) = %.4f\n",
+               lines.segment[i].x1, lines.segment[i].y1,
+               lines.segment[i].x2, lines.segment[i].y2,
+               lines.segment[i].alpha, lines.segment[i].r,
+               sqrtf(lines.segment[i].cov[2]));
+    }
+    printf("\n");
+
+    err = test_zigzag(&lines, &points);
+    err |= test_doorway(&lines, &points);
+
+    return (err);
+}
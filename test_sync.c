@@ -0,0 +1,187 @@
+//  ===========================================================================
+//  Frame synchronisation test for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+/*
+    Usage: test_sync [sensors] [seconds] [wait_ms]
+
+    Runs free running 10 Hz sensors on their own threads, each with its own
+    phase, and groups their frames with urg-sync.h under every policy.
+    Halfway through the last sensor stops for a second, as a sensor that
+    has to be reset would. Reports groups, skew and wait per policy.
+
+    The figures depend on the machine's scheduling. The test fails if a
+    policy makes no groups, or if a SYNC_WAIT group waited more than
+    WAIT_MARGIN past the wait time.
+
+    gcc -DURG_NO_MAIN -D_GNU_SOURCE -O2 -o test_sync test_sync.c urg-sync.c
+        urg-pool.c urg-rt.c urg-multi.c urg-raw.c urg-model.c -lpthread -lm
+*/
+
+//  ===========================================================================
+
+#include <unistd.h>	    // UNIX standard function definitions.
+#include <stdio.h>	    // Standard Input/Output definitions.
+#include <stdlib.h>
+#include <string.h>	    // String function definitions.
+#include <stdint.h>	    // Standard type definitions.
+#include <pthread.h>
+
+#include "urg-multi.h"
+#include "urg-pool.h"
+#include "urg-sync.h"
+
+#define PERIOD  100000      // Scan period (us).
+#define STALL   1000000     // Time the last sensor stops for (us).
+#define WAIT_MARGIN 20000   // Allowed scheduling delay past the wait (us).
+
+typedef struct
+{
+    int       id;
+    pthread_t thread;
+    pool_t    pool;
+} source_t;
+
+static sync_t      sync_stage;
+static source_t    source[SENSORS_MAX];
+static timing_t    timing = {600, 97.66f, PERIOD};
+static atomic_bool done;
+static int         sensors;
+static int         seconds;
+
+//  ===========================================================================
+//  Pushes a frame every period, stopping once if it is the last sensor.
+//  ===========================================================================
+static void *producer(void *arg)
+{
+    source_t *src = arg;
+    scan_t   *scan;
+    uint64_t  next = host_time() + src->id * PERIOD / sensors + 7000;
+    uint64_t  stall = next + seconds * 500000ULL;
+    uint64_t  now;
+
+    while (!atomic_load(&done))
+    {
+        now = host_time();
+        if (now < next)
+        {
+            usleep(next - now);
+            continue;
+        }
+
+        // Up to 1 ms of delivery jitter.
+        next += PERIOD + rand() % 1000;
+        if (src->id == sensors - 1 && stall && now >= stall)
+        {
+            next += STALL;
+            stall = 0;
+        }
+
+        scan = pool_get(&src->pool);
+        if (scan == NULL) continue;
+        scan->host_time = host_time();
+        sync_push(&sync_stage, src->id, scan);
+    }
+
+    return NULL;
+}
+
+//  ===========================================================================
+//  Runs one policy, returning -1 if its groups are out of bounds.
+//  ===========================================================================
+static int run(int policy, uint32_t wait_time)
+{
+    sync_group_t group;
+    uint64_t end;
+    uint64_t wait_max;
+    int err = 0;
+    int i;
+
+    if (sync_init(&sync_stage, policy, wait_time) < 0) return -1;
+
+    for (i = 0; i < sensors; i++)
+    {
+        source[i].id = i;
+        if (pool_init(&source[i].pool, 1000, &timing) < 0) return -1;
+        sync_add_sensor(&sync_stage, &source[i].pool);
+    }
+
+    atomic_store(&done, false);
+    for (i = 0; i < sensors; i++)
+        pthread_create(&source[i].thread, NULL, producer, &source[i]);
+
+    end = host_time() + seconds * 1000000ULL;
+    while (host_time() < end)
+    {
+        if (sync_next(&sync_stage, &group, 100000) == 0)
+            sync_release(&sync_stage, &group);
+    }
+
+    atomic_store(&done, true);
+    for (i = 0; i < sensors; i++) pthread_join(source[i].thread, NULL);
+
+    sync_report(&sync_stage);
+
+    if (sync_stage.groups == 0)
+    {
+        printf("FAIL: no groups.\n");
+        err = -1;
+    }
+
+    wait_max = sync_stage.wait.max * SYNC_HIST_UNIT;
+    if (policy == SYNC_WAIT && wait_max > sync_stage.wait_time + WAIT_MARGIN)
+    {
+        printf("FAIL: waited %llu us, over %u us plus %d us.\n",
+               (unsigned long long)wait_max, sync_stage.wait_time,
+               WAIT_MARGIN);
+        err = -1;
+    }
+
+    sync_free(&sync_stage);
+    for (i = 0; i < sensors; i++) pool_free(&source[i].pool);
+
+    return (err);
+}
+
+//  ===========================================================================
+//  Main.
+//  ===========================================================================
+int main(int argc, char *argv[])
+{
+    uint32_t wait_time;
+    int err = 0;
+
+    sensors = (argc > 1) ? atoi(argv[1]) : 3;
+    seconds = (argc > 2) ? atoi(argv[2]) : 6;
+    wait_time = (argc > 3) ? atoi(argv[3]) * 1000 : SYNC_WAIT_TIME;
+
+    if (sensors < 2 || sensors > SENSORS_MAX)
+    {
+        printf("Sensors must be 2 to %d.\n", SENSORS_MAX);
+        return -1;
+    }
+
+    printf("%d sensors at 10 Hz for %d s, last stops for %d ms.\n\n",
+           sensors, seconds, STALL / 1000);
+
+    if (run(SYNC_NEAREST, 0) < 0) err = -1;
+    printf("\n");
+    if (run(SYNC_LATEST, 0) < 0) err = -1;
+    printf("\n");
+    if (run(SYNC_WAIT, wait_time) < 0) err = -1;
+
+    return (err);
+}
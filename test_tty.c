@@ -0,0 +1,152 @@
+//  ===========================================================================
+//  App for benchmarking serial read modes on a simulated sensor.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+/*
+    Usage: test_tty [bytes_per_s] [seconds]
+
+    Streams scans from a simulated sensor paced in 64 byte packets at
+    bytes_per_s (default 250000) and reads them in each urg-tty.h mode in
+    turn. Latency is from the simulator starting to write the last packet
+    of a scan to the parser delivering the scan.
+
+    gcc -DURG_NO_MAIN -D_GNU_SOURCE -O2 -o test_tty test_tty.c urg-multi.c
+        urg-parser.c urg-raw.c urg-model.c urg-tty.c urg-sim.c urg-rt.c -lpthread -lm
+*/
+
+//  ===========================================================================
+
+#include <unistd.h>	    // UNIX standard function definitions.
+#include <stdio.h>	    // Standard Input/Output definitions.
+#include <stdlib.h>
+#include <string.h>	    // String function definitions.
+#include <stdint.h>	    // Standard type definitions.
+#include <time.h>       // Clock definitions.
+
+#include "urg-multi.h"
+#include "urg-parser.h"
+#include "urg-tty.h"
+#include "urg-sim.h"
+#include "urg-rt.h"
+
+#define SCAN_CMD "MD0044072501000\n"
+
+static sim_t     sim;
+static rt_hist_t latency;
+
+//  ===========================================================================
+//  Records latency of a scan.
+//  ===========================================================================
+static void record_scan(const scan_t *scan, void *arg)
+{
+    uint64_t sent = atomic_load(&sim.sent);
+
+    (void)arg;
+    rt_hist_add(&latency, scan->host_time > sent ? scan->host_time - sent
+                                                 : 0);
+}
+
+//  ===========================================================================
+//  Returns CPU time used by this thread (us).
+//  ===========================================================================
+static uint64_t thread_time(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+//  ===========================================================================
+//  Runs one mode.
+//  ===========================================================================
+static int run(int mode, uint32_t pace, int seconds)
+{
+    static tty_t    tty;
+    static parser_t parser;
+    serial_t serial;
+    uint64_t scans;
+    uint64_t cpu;
+    uint64_t end;
+    char     p99[16];
+
+    if (sim_open(&sim, SIM_RATE) < 0) return -1;
+    sim_pace(&sim, pace, SIM_CHUNK);
+
+    if (serial_open(&serial, sim.path, BIT_RATE_0) < 0) return -1;
+    if (tty_open(&tty, serial.fd, mode) < 0) return -1;
+
+    parser_init(&parser, record_scan, NULL, NULL);
+    write(serial.fd, SCAN_CMD, strlen(SCAN_CMD));
+
+    // Skip the first scans while the adaptive mode learns.
+    while (parser.scans < 3) tty_read(&tty, &parser);
+
+    memset(&latency, 0, sizeof(latency));
+    tty.reads = 0;
+    tty.bytes = 0;
+    tty.waits = 0;
+    scans = parser.scans;
+    cpu = thread_time();
+    end = host_time() + seconds * 1000000ULL;
+
+    while (host_time() < end)
+        if (tty_read(&tty, &parser) < 0) break;
+
+    cpu = thread_time() - cpu;
+    scans = parser.scans - scans;
+
+    // Beyond the histogram is only known to be at least its range.
+    sprintf(p99, "%s%llu", latency.bucket[RT_HIST_MAX] ? ">" : "",
+            (unsigned long long)rt_hist_percentile(&latency, 0.99));
+
+    printf("%-9s %4llu scans %5.1f reads/scan %5.0f bytes/read "
+           "%5.1f us cpu/scan  latency mean %5llu p99 %6s max %6llu us%s\n",
+           tty_mode_name(mode), (unsigned long long)scans,
+           scans ? (double)tty.reads / scans : 0.0,
+           tty.reads ? (double)tty.bytes / tty.reads : 0.0,
+           scans ? (double)cpu / scans : 0.0,
+           (unsigned long long)(latency.count ? latency.sum / latency.count
+                                              : 0),
+           p99, (unsigned long long)latency.max,
+           tty.low_latency ? "" : " (no low latency flag)");
+
+    write(serial.fd, CMD_SET_LASER_OFF LF, 3);
+    tty_close(&tty);
+    serial_close(&serial);
+    sim_close(&sim);
+
+    return 0;
+}
+
+//  ===========================================================================
+//  Main.
+//  ===========================================================================
+int main(int argc, char *argv[])
+{
+    uint32_t pace = (argc > 1) ? atoi(argv[1]) : 250000;
+    int seconds   = (argc > 2) ? atoi(argv[2]) : 3;
+    int mode;
+
+    printf("Scans at %d Hz paced at %u bytes/s in %d byte packets.\n",
+           SIM_RATE, pace, SIM_CHUNK);
+
+    for (mode = 0; mode < TTY_MODES; mode++) run(mode, pace, seconds);
+
+    return 0;
+}
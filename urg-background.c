@@ -0,0 +1,276 @@
+//  ===========================================================================
+//  Background model for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+#include "urg-background.h"
+#include <stdio.h>	    // Standard Input/Output definitions.
+#include <stdlib.h>
+#include <string.h>	    // String function definitions.
+#include <stdint.h>	    // Standard type definitions.
+#include <stdbool.h>	// Boolean definitions.
+
+//  Vector types. -------------------------------------------------------------
+
+typedef float    v4sf  __attribute__((vector_size(16)));
+typedef int32_t  v4si  __attribute__((vector_size(16)));
+
+/* Unaligned load type for four ranges from the scan. */
+typedef uint16_t v4u16u __attribute__((vector_size(8), aligned(2)));
+
+/* Selects a where mask is set, otherwise b. */
+#define SELECT(mask, a, b) \
+    ((v4sf)(((mask) & (v4si)(a)) | (~(mask) & (v4si)(b))))
+
+//  ===========================================================================
+//  Initialises model for count beams, with an optional histogram.
+//  ===========================================================================
+int bg_init(bg_t *bg, const spec_t *spec, uint16_t count, uint16_t bins)
+{
+    memset(bg, 0, sizeof(bg_t));
+
+    if (count > SCAN_STEPS_MAX) return -1;
+
+    bg->count = count;
+    bg->dist_min = spec->dist_min;
+    bg->sigma = BG_SIGMA;
+    bg->min_var = BG_MIN_VAR;
+    bg->min_frames = BG_MIN_FRAMES;
+    bg->max_frames = BG_MAX_FRAMES;
+    bg->hist_min = BG_HIST_MIN;
+
+    if (bins == 0) return 0;
+
+    bg->bins = bins;
+    bg->bin_width = (spec->dist_max + bins - 1) / bins;
+    bg->hist = calloc((size_t)count * bins, sizeof(uint16_t));
+    bg->hist_total = calloc(count, sizeof(uint32_t));
+    if (bg->hist == NULL || bg->hist_total == NULL)
+    {
+        printf("Error allocating background histogram.\n");
+        bg_free(bg);
+        return -1;
+    }
+
+    return 0;
+}
+
+//  ===========================================================================
+//  Adds a range to a beam's histogram.
+//  ===========================================================================
+static void bg_hist_add(bg_t *bg, int beam, uint16_t range)
+{
+    uint16_t *row = &bg->hist[(size_t)beam * bg->bins];
+    int bin;
+    int i;
+
+    bin = range / bg->bin_width;
+    if (bin >= bg->bins) bin = bg->bins - 1;
+
+    bg->hist_total[beam]++;
+    if (++row[bin] < UINT16_MAX) return;
+
+    // Saturated, so halve the whole row to keep the shares.
+    bg->hist_total[beam] = 0;
+    for (i = 0; i < bg->bins; i++)
+    {
+        row[i] >>= 1;
+        bg->hist_total[beam] += row[i];
+    }
+}
+
+//  ===========================================================================
+//  Adds a frame to the model.
+//  ===========================================================================
+void bg_update(bg_t *bg, const scan_t *scan, bool skip_fg)
+{
+    const v4sf one = {1.0f, 1.0f, 1.0f, 1.0f};
+    const v4sf max = one * bg->max_frames;
+    const v4sf dmin = one * bg->dist_min;
+    int count;
+    int i;
+
+    count = (scan->count < bg->count) ? scan->count : bg->count;
+
+    for (i = 0; i + BG_LANES <= count; i += BG_LANES)
+    {
+        v4sf x    = __builtin_convertvector(*(const v4u16u *)&scan->range[i],
+                                            v4sf);
+        v4si fg   = {bg->fg[i], bg->fg[i + 1], bg->fg[i + 2], bg->fg[i + 3]};
+        v4si ok   = (v4si)(x >= dmin);
+        v4sf n    = *(v4sf *)&bg->n[i];
+        v4sf mean = *(v4sf *)&bg->mean[i];
+        v4sf m2   = *(v4sf *)&bg->m2[i];
+        v4sf inc, d, full;
+
+        if (skip_fg) ok &= (fg == 0);
+
+        /*
+            Welford: n += 1, mean += d / n, m2 += d * (x - mean). At the
+            cap n stays put and m2 is scaled by (n - 1) / n first, which
+            is the same update with exponential forgetting.
+        */
+        full = (v4sf)((v4si)(n >= max) & ok);
+        m2  *= SELECT((v4si)full, (max - one) / max, one);
+        inc  = (v4sf)((v4si)one & ok);
+        n    = n + inc;
+        n    = SELECT((v4si)(n > max), max, n);
+        d    = (x - mean) * inc;
+        mean = mean + d / SELECT((v4si)(n < one), one, n);
+        m2   = m2 + d * (x - mean);
+
+        *(v4sf *)&bg->n[i] = n;
+        *(v4sf *)&bg->mean[i] = mean;
+        *(v4sf *)&bg->m2[i] = m2;
+    }
+
+    for (; i < count; i++)
+    {
+        float x = scan->range[i];
+        float d;
+
+        if (scan->range[i] < bg->dist_min || (skip_fg && bg->fg[i]))
+            continue;
+
+        if (bg->n[i] >= bg->max_frames)
+            bg->m2[i] *= (bg->max_frames - 1.0f) / bg->max_frames;
+        else
+            bg->n[i] += 1.0f;
+
+        d = x - bg->mean[i];
+        bg->mean[i] += d / bg->n[i];
+        bg->m2[i] += d * (x - bg->mean[i]);
+    }
+
+    if (bg->bins == 0) return;
+
+    for (i = 0; i < count; i++)
+        if (scan->range[i] >= bg->dist_min && !(skip_fg && bg->fg[i]))
+            bg_hist_add(bg, i, scan->range[i]);
+}
+
+//  ===========================================================================
+//  Returns variance of a beam (mm^2).
+//  ===========================================================================
+float bg_variance(const bg_t *bg, int beam)
+{
+    return (bg->n[beam] > 1.0f) ? bg->m2[beam] / bg->n[beam] : 0.0f;
+}
+
+//  ===========================================================================
+//  Marks foreground beams in fg, returns number of foreground beams.
+//  ===========================================================================
+int bg_classify(bg_t *bg, const scan_t *scan)
+{
+    const v4sf one = {1.0f, 1.0f, 1.0f, 1.0f};
+    const v4sf s2 = one * (bg->sigma * bg->sigma);
+    const v4sf min_var = one * bg->min_var;
+    const v4sf min_n = one * bg->min_frames;
+    const v4sf dmin = one * bg->dist_min;
+    uint16_t *row;
+    int count;
+    int bin;
+    int fg;
+    int i;
+
+    count = (scan->count < bg->count) ? scan->count : bg->count;
+    memset(bg->fg, 0, sizeof(bg->fg));
+
+    for (i = 0; i + BG_LANES <= count; i += BG_LANES)
+    {
+        v4sf x   = __builtin_convertvector(*(const v4u16u *)&scan->range[i],
+                                           v4sf);
+        v4sf n   = *(v4sf *)&bg->n[i];
+        v4sf d   = x - *(v4sf *)&bg->mean[i];
+        v4sf var = *(v4sf *)&bg->m2[i] / SELECT((v4si)(n < one), one, n);
+        v4si m;
+
+        var = SELECT((v4si)(var < min_var), min_var, var);
+        m = (v4si)(x >= dmin) & (v4si)(n >= min_n)
+          & (v4si)(d * d > s2 * var);
+
+        bg->fg[i]     = m[0] & 1;
+        bg->fg[i + 1] = m[1] & 1;
+        bg->fg[i + 2] = m[2] & 1;
+        bg->fg[i + 3] = m[3] & 1;
+    }
+
+    for (; i < count; i++)
+    {
+        float d = scan->range[i] - bg->mean[i];
+        float var = bg_variance(bg, i);
+
+        if (var < bg->min_var) var = bg->min_var;
+        bg->fg[i] = scan->range[i] >= bg->dist_min &&
+                    bg->n[i] >= bg->min_frames &&
+                    d * d > bg->sigma * bg->sigma * var;
+    }
+
+    // Foreground is rare, so only those beams look at their histogram.
+    fg = 0;
+    for (i = 0; i < count; i++)
+    {
+        if (!bg->fg[i]) continue;
+
+        if (bg->bins > 0 && bg->hist_total[i] > 0)
+        {
+            row = &bg->hist[(size_t)i * bg->bins];
+            bin = scan->range[i] / bg->bin_width;
+            if (bin >= bg->bins) bin = bg->bins - 1;
+
+            if (row[bin] >= bg->hist_min * bg->hist_total[i])
+            {
+                bg->fg[i] = 0;
+                continue;
+            }
+        }
+        fg++;
+    }
+
+    bg->foreground = fg;
+
+    return (fg);
+}
+
+//  ===========================================================================
+//  Forgets everything learnt.
+//  ===========================================================================
+void bg_reset(bg_t *bg)
+{
+    memset(bg->n, 0, sizeof(bg->n));
+    memset(bg->mean, 0, sizeof(bg->mean));
+    memset(bg->m2, 0, sizeof(bg->m2));
+    memset(bg->fg, 0, sizeof(bg->fg));
+    bg->foreground = 0;
+
+    if (bg->bins == 0) return;
+
+    memset(bg->hist, 0, (size_t)bg->count * bg->bins * sizeof(uint16_t));
+    memset(bg->hist_total, 0, bg->count * sizeof(uint32_t));
+}
+
+//  ===========================================================================
+//  Frees histogram.
+//  ===========================================================================
+void bg_free(bg_t *bg)
+{
+    free(bg->hist);
+    free(bg->hist_total);
+
+    bg->hist = NULL;
+    bg->hist_total = NULL;
+    bg->bins = 0;
+}
@@ -0,0 +1,100 @@
+//  ===========================================================================
+//  Background model for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+/*
+    Learns the static scene per beam so that change detection is one pass
+    over the frame.
+
+    Statistics:
+
+    Each beam keeps a running mean and sum of squared differences using
+    Welford's method, four beams per vector operation. Error codes (below
+    DMIN) are masked out so each beam has its own sample count. Once a beam
+    has max_frames samples its count stops growing, which turns the update
+    into an exponential average and lets the model follow slow changes.
+
+    Histogram:
+
+    Optionally each beam also counts its ranges into bins of bin_width mm.
+    This catches backgrounds with more than one level, e.g. a door or a
+    swinging sign, that a single mean and variance would call foreground.
+    Counts are halved when one saturates.
+
+    Classification:
+
+    A valid beam is foreground when the model has at least min_frames
+    samples and (range - mean)^2 > sigma^2 * max(variance, min_var), unless
+    its histogram bin holds at least hist_min of the beam's samples.
+    Error codes are never foreground.
+
+    Usage is classify then update. Updating with skip_fg leaves beams just
+    classified as foreground out of the model, so a person standing still
+    is not learnt into the scene.
+*/
+
+//  ===========================================================================
+
+#ifndef URG_BACKGROUND_H
+#define URG_BACKGROUND_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "urg-multi.h"
+
+//  Defines. ------------------------------------------------------------------
+
+#define BG_LANES        4
+#define BG_STRIDE       ((SCAN_STEPS_MAX + BG_LANES - 1) & ~(BG_LANES - 1))
+#define BG_SIGMA        3.0f    // Default threshold (standard deviations).
+#define BG_MIN_VAR      100.0f  // Default variance floor (mm^2).
+#define BG_MIN_FRAMES   20      // Default samples before classifying.
+#define BG_MAX_FRAMES   1000    // Default samples before forgetting.
+#define BG_HIST_MIN     0.1f    // Default bin share counted as background.
+
+//  Types. --------------------------------------------------------------------
+
+typedef struct
+{
+    uint16_t count;         // Beams per frame.
+    uint16_t dist_min;      // DMIN (mm).
+    float    sigma;
+    float    min_var;       // Variance floor (mm^2).
+    float    min_frames;
+    float    max_frames;
+    uint16_t bins;          // Histogram bins per beam, 0 if none.
+    uint16_t bin_width;     // mm per bin.
+    float    hist_min;      // Bin share counted as background.
+    uint16_t *hist;         // count x bins counts.
+    uint32_t *hist_total;   // Samples per beam histogram.
+    uint16_t foreground;    // Foreground beams in last frame.
+    _Alignas(16) float n[BG_STRIDE];    // Samples per beam.
+    _Alignas(16) float mean[BG_STRIDE]; // Mean range (mm).
+    _Alignas(16) float m2[BG_STRIDE];   // Sum of squared differences.
+    _Alignas(16) uint8_t fg[BG_STRIDE]; // 1 if beam is foreground.
+} bg_t;
+
+//  Functions. ----------------------------------------------------------------
+
+int bg_init(bg_t *bg, const spec_t *spec, uint16_t count, uint16_t bins);
+void bg_update(bg_t *bg, const scan_t *scan, bool skip_fg);
+int bg_classify(bg_t *bg, const scan_t *scan);
+float bg_variance(const bg_t *bg, int beam);
+void bg_reset(bg_t *bg);
+void bg_free(bg_t *bg);
+
+#endif
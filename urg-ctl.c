@@ -0,0 +1,399 @@
+//  ===========================================================================
+//  Asynchronous control for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+#include "urg-ctl.h"
+#include <unistd.h>	    // UNIX standard function definitions.
+#include <stdio.h>	    // Standard Input/Output definitions.
+#include <string.h>	    // String function definitions.
+#include <stdint.h>	    // Standard type definitions.
+#include <errno.h>      // Error numbers.
+#include <time.h>       // Clock definitions.
+#include <sys/eventfd.h>    // Event notification.
+
+//  ===========================================================================
+//  Returns true if cmd can be sent while a stream is running.
+//  ===========================================================================
+static bool ctl_streamable(const char *cmd)
+{
+    return strncmp(cmd, CMD_GET_VERSION, 2) == 0 ||
+           strncmp(cmd, CMD_GET_SPEC, 2) == 0 ||
+           strncmp(cmd, CMD_GET_RUN_STATE, 2) == 0 ||
+           strncmp(cmd, CMD_SET_LASER_ON, 2) == 0 ||
+           strncmp(cmd, CMD_SET_LASER_OFF, 2) == 0 ||
+           strncmp(cmd, CMD_SET_LASER_RESET, 2) == 0;
+}
+
+//  ===========================================================================
+//  Returns true if cmd starts a stream.
+//  ===========================================================================
+static bool ctl_is_stream(const char *cmd)
+{
+    return strncmp(cmd, CMD_GET_DATA_CONT3, 2) == 0 ||
+           strncmp(cmd, CMD_GET_DATA_CONT2, 2) == 0;
+}
+
+//  ===========================================================================
+//  Returns true if cmd stops a stream.
+//  ===========================================================================
+static bool ctl_is_stop(const char *cmd)
+{
+    return strncmp(cmd, CMD_SET_LASER_OFF, 2) == 0 ||
+           strncmp(cmd, CMD_SET_LASER_RESET, 2) == 0;
+}
+
+//  ===========================================================================
+//  Marks a command finished and tells whoever is waiting.
+//  ===========================================================================
+static void ctl_finish(ctl_t *ctl, ctl_cmd_t *cmd, int state)
+{
+    pthread_mutex_lock(&ctl->lock);
+    atomic_store(&cmd->state, state);
+    pthread_cond_broadcast(&ctl->cond);
+    pthread_mutex_unlock(&ctl->lock);
+
+    if (cmd->done) cmd->done(cmd, cmd->arg);
+}
+
+//  ===========================================================================
+//  Fills in a command.
+//  ===========================================================================
+static int ctl_set(ctl_cmd_t *cmd, const char *text, ctl_done_t done,
+                   void *arg)
+{
+    int len = strlen(text);
+
+    if (len < 2 || len > CTL_CMD_MAX) return -1;
+
+    memcpy(cmd->cmd, text, len);
+    cmd->cmd[len] = STRING_NULL;
+    cmd->len = len;
+    cmd->done = done;
+    cmd->arg = arg;
+    cmd->status[0] = STRING_NULL;
+    cmd->reply_len = 0;
+    cmd->sent = 0;
+    cmd->replied = 0;
+    atomic_store(&cmd->state, CTL_PENDING);
+
+    return 0;
+}
+
+//  ===========================================================================
+//  Writes a command to the port and makes it the outstanding one.
+//  ===========================================================================
+static int ctl_send(ctl_t *ctl, ctl_cmd_t *cmd)
+{
+    char line[CTL_CMD_MAX + 1];
+
+    memcpy(line, cmd->cmd, cmd->len);
+    line[cmd->len] = STRING_LF;
+
+    if (write(ctl->fd, line, cmd->len + 1) != cmd->len + 1)
+    {
+        perror("Write to port");
+        return -1;
+    }
+
+    cmd->sent = host_time();
+    ctl->current = cmd;
+    ctl->sent++;
+
+    return 0;
+}
+
+//  ===========================================================================
+//  Handles a text reply from the port's parser.
+//  ===========================================================================
+static void ctl_reply(const char *reply, int len, void *arg)
+{
+    ctl_t *ctl = arg;
+    ctl_cmd_t *cmd = ctl->current;
+    const char *status;
+
+    // The echo is the command as sent.
+    if (cmd == NULL || len < cmd->len ||
+        strncmp(reply, cmd->cmd, cmd->len) != 0 ||
+        (len > cmd->len && reply[cmd->len] != STRING_LF))
+    {
+        ctl->unmatched++;
+        if (ctl->on_other) ctl->on_other(reply, len, ctl->other_arg);
+        return;
+    }
+
+    memcpy(cmd->reply, reply, len);
+    cmd->reply[len] = STRING_NULL;
+    cmd->reply_len = len;
+    cmd->replied = host_time();
+
+    status = reply + cmd->len + 1;
+    if (len >= cmd->len + 3)
+    {
+        cmd->status[0] = status[0];
+        cmd->status[1] = status[1];
+        cmd->status[2] = STRING_NULL;
+    }
+
+    // Track the stream from what the sensor accepted.
+    if (strcmp(cmd->status, "00") == 0)
+    {
+        if (ctl_is_stream(cmd->cmd))
+        {
+            ctl->streaming = true;
+            ctl->suspended = false;
+            memcpy(ctl->stream, cmd->cmd, cmd->len + 1);
+        }
+        else if (ctl_is_stop(cmd->cmd))
+        {
+            ctl->streaming = false;
+        }
+    }
+
+    ctl->current = NULL;
+    ctl_finish(ctl, cmd, CTL_DONE);
+    ctl_run(ctl);
+}
+
+//  ===========================================================================
+//  Handles the wake up event from ctl_submit().
+//  ===========================================================================
+static void ctl_wake(const char *data, int len, void *arg)
+{
+    (void)data;
+    (void)len;
+
+    ctl_run(arg);
+}
+
+//  ===========================================================================
+//  Sets up control of the port fd, read by io with parser.
+//  ===========================================================================
+int ctl_init(ctl_t *ctl, io_t *io, int fd, parser_t *parser)
+{
+    memset(ctl, 0, sizeof(ctl_t));
+    ctl->fd = fd;
+
+    ctl->event_fd = eventfd(0, EFD_CLOEXEC);
+    if (ctl->event_fd < 0)
+    {
+        perror("eventfd");
+        return -1;
+    }
+
+    pthread_mutex_init(&ctl->lock, NULL);
+    pthread_cond_init(&ctl->cond, NULL);
+
+    if (io_watch(io, ctl->event_fd, ctl_wake, ctl) < 0)
+    {
+        ctl_free(ctl);
+        return -1;
+    }
+
+    parser_set_reply(parser, ctl_reply, ctl);
+
+    return 0;
+}
+
+//  ===========================================================================
+//  Queues a command (without LF). Any thread, does not block on the port.
+//  ===========================================================================
+/*
+    Returns -1 if the command is too long or the queue is full, in which
+    case done is not called.
+*/
+int ctl_submit(ctl_t *ctl, ctl_cmd_t *cmd, const char *text,
+               ctl_done_t done, void *arg)
+{
+    uint64_t one = 1;
+    int      err = -1;
+
+    if (ctl_set(cmd, text, done, arg) < 0) return -1;
+
+    pthread_mutex_lock(&ctl->lock);
+    if (ctl->count < CTL_QUEUE)
+    {
+        ctl->queue[(ctl->head + ctl->count) % CTL_QUEUE] = cmd;
+        ctl->count++;
+        err = 0;
+    }
+    pthread_mutex_unlock(&ctl->lock);
+
+    if (err < 0) return -1;
+
+    if (write(ctl->event_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+        perror("Control wake");
+
+    return 0;
+}
+
+//  ===========================================================================
+//  Waits up to timeout_ms (-1 forever) for a command. Not the loop thread.
+//  ===========================================================================
+/*
+    Returns 0 once replied, -1 if it failed or is still pending.
+*/
+int ctl_wait(ctl_t *ctl, ctl_cmd_t *cmd, int timeout_ms)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += timeout_ms / 1000;
+    ts.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+    if (ts.tv_nsec >= 1000000000)
+    {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&ctl->lock);
+    while (atomic_load(&cmd->state) == CTL_PENDING)
+    {
+        if (timeout_ms < 0)
+            pthread_cond_wait(&ctl->cond, &ctl->lock);
+        else if (pthread_cond_timedwait(&ctl->cond, &ctl->lock, &ts) != 0)
+            break;
+    }
+    pthread_mutex_unlock(&ctl->lock);
+
+    return (atomic_load(&cmd->state) == CTL_DONE) ? 0 : -1;
+}
+
+//  ===========================================================================
+//  Times out a lost reply and sends what can be sent. Loop thread only.
+//  ===========================================================================
+void ctl_run(ctl_t *ctl)
+{
+    ctl_cmd_t *cmd;
+    ctl_cmd_t *next;
+
+    if (ctl->current)
+    {
+        if (host_time() - ctl->current->sent < CTL_TIMEOUT) return;
+
+        cmd = ctl->current;
+        ctl->current = NULL;
+        ctl->timeouts++;
+
+        // A lost QT leaves the stream state unknown, so resume anyway.
+        if (cmd == &ctl->suspend) ctl->streaming = false;
+        ctl_finish(ctl, cmd, CTL_FAILED);
+    }
+
+    while (ctl->current == NULL)
+    {
+        pthread_mutex_lock(&ctl->lock);
+        next = ctl->count ? ctl->queue[ctl->head] : NULL;
+        pthread_mutex_unlock(&ctl->lock);
+
+        // Nothing needing the sensor idle is left, so carry on streaming.
+        if (ctl->suspended && !ctl->streaming &&
+            (next == NULL || ctl_streamable(next->cmd) ||
+             ctl_is_stream(next->cmd)))
+        {
+            ctl->suspended = false;
+
+            // A stop or a new stream takes the place of resuming.
+            if (next && (ctl_is_stop(next->cmd) || ctl_is_stream(next->cmd)))
+                continue;
+
+            ctl_set(&ctl->resume, ctl->stream, NULL, NULL);
+            if (ctl_send(ctl, &ctl->resume) == 0) return;
+            ctl_finish(ctl, &ctl->resume, CTL_FAILED);
+            continue;
+        }
+
+        if (next == NULL) return;
+
+        // Stop the stream first for commands the sensor refuses during it.
+        if (ctl->streaming && !ctl_streamable(next->cmd))
+        {
+            ctl_set(&ctl->suspend, CMD_SET_LASER_OFF, NULL, NULL);
+            if (ctl_send(ctl, &ctl->suspend) < 0)
+            {
+                ctl_finish(ctl, &ctl->suspend, CTL_FAILED);
+                return;
+            }
+            ctl->suspended = true;
+            ctl->suspends++;
+            return;
+        }
+
+        pthread_mutex_lock(&ctl->lock);
+        ctl->head = (ctl->head + 1) % CTL_QUEUE;
+        ctl->count--;
+        pthread_mutex_unlock(&ctl->lock);
+
+        // An explicit stop or new stream replaces any suspended one.
+        if (ctl_is_stop(next->cmd) || ctl_is_stream(next->cmd))
+            ctl->suspended = false;
+
+        if (ctl_send(ctl, next) < 0) ctl_finish(ctl, next, CTL_FAILED);
+    }
+}
+
+//  ===========================================================================
+//  Returns true when nothing is queued or outstanding. Loop thread only.
+//  ===========================================================================
+bool ctl_idle(ctl_t *ctl)
+{
+    bool idle;
+
+    pthread_mutex_lock(&ctl->lock);
+    idle = (ctl->count == 0 && ctl->current == NULL && !ctl->suspended);
+    pthread_mutex_unlock(&ctl->lock);
+
+    return (idle);
+}
+
+//  ===========================================================================
+//  Sets callback for replies to nothing outstanding. Loop thread only.
+//  ===========================================================================
+void ctl_set_other(ctl_t *ctl, parser_reply_t on_other, void *arg)
+{
+    ctl->on_other = on_other;
+    ctl->other_arg = arg;
+}
+
+//  ===========================================================================
+//  Fails anything still queued and closes the eventfd.
+//  ===========================================================================
+/*
+    Call after io_free(), since the loop reads the eventfd.
+*/
+void ctl_free(ctl_t *ctl)
+{
+    ctl_cmd_t *cmd;
+
+    if (ctl->current && ctl->current != &ctl->suspend &&
+        ctl->current != &ctl->resume)
+        ctl_finish(ctl, ctl->current, CTL_FAILED);
+    ctl->current = NULL;
+
+    while (ctl->count > 0)
+    {
+        cmd = ctl->queue[ctl->head];
+        ctl->head = (ctl->head + 1) % CTL_QUEUE;
+        ctl->count--;
+        ctl_finish(ctl, cmd, CTL_FAILED);
+    }
+
+    if (ctl->event_fd >= 0) close(ctl->event_fd);
+    ctl->event_fd = -1;
+
+    pthread_cond_destroy(&ctl->cond);
+    pthread_mutex_destroy(&ctl->lock);
+}
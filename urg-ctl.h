@@ -0,0 +1,137 @@
+//  ===========================================================================
+//  Asynchronous control for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+/*
+    Sends commands to a sensor whose port is read by an urg-io.h loop,
+    without stopping to wait for replies, so they can be issued while MD
+    is streaming. The synchronous calls in urg-multi.c flush the port and
+    sleep, which would throw away scans.
+
+    Use:
+
+    ctl_init() hooks a port's parser and adds an eventfd to the loop. Any
+    thread may then ctl_submit() a command with a ctl_cmd_t it owns, which
+    acts as the future: the done callback runs on the loop thread when the
+    reply arrives, and other threads can ctl_wait() for it. The callback
+    must not block. The command must stay valid until it is done.
+
+    Sequencing:
+
+    One command is outstanding at a time and replies are matched to it by
+    their echo, so scan replies in between are delivered as usual. The
+    loop calls ctl_run() after each io_poll() to time out lost replies.
+
+    While MD or MS is streaming the sensor only takes some commands:
+
+    VV, PP, II  Answered between scans. Polls cost no scans.
+    BM          Answered between scans (status 02, already on).
+    QT, RS      Stop the stream.
+    Others      (CR, TM, SS, HS, DB, GD, GS, MD, MS) need the sensor idle.
+                The stream is suspended with QT, these are sent, then the
+                stream's MD is sent again. Consecutive ones share a single
+                suspension. Scans are lost for the time it takes.
+
+    The stream's command is remembered when its "00" acknowledgement is
+    seen, whoever sent it through ctl_submit(). Replies that match nothing
+    outstanding, e.g. a stream ending with an error status, go to the
+    callback set with ctl_set_other().
+*/
+
+//  ===========================================================================
+
+#ifndef URG_CTL_H
+#define URG_CTL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "urg-parser.h"
+#include "urg-io.h"
+
+//  Defines. ------------------------------------------------------------------
+
+#define CTL_QUEUE       16          // Commands waiting per port.
+#define CTL_CMD_MAX     24          // Longest command, without LF.
+#define CTL_TIMEOUT     1000000     // Time to wait for a reply (us).
+
+/* Command states. */
+#define CTL_PENDING     0
+#define CTL_DONE        1           // Replied, see status.
+#define CTL_FAILED      2           // No reply, or not sent.
+
+//  Types. --------------------------------------------------------------------
+
+typedef struct ctl_cmd_s ctl_cmd_t;
+
+/* Called on the loop thread when a command is done or has failed. */
+typedef void (*ctl_done_t)(ctl_cmd_t *cmd, void *arg);
+
+struct ctl_cmd_s
+{
+    char       cmd[CTL_CMD_MAX + 1];
+    int        len;
+    ctl_done_t done;
+    void      *arg;
+    atomic_int state;
+    char       status[3];               // Reply status, e.g. "00".
+    char       reply[PARSER_REPLY_MAX]; // Reply lines, echo first.
+    int        reply_len;
+    uint64_t   sent;                    // Host time written (us).
+    uint64_t   replied;                 // Host time of reply (us).
+};
+
+typedef struct
+{
+    int      fd;                        // Port.
+    int      event_fd;                  // Wakes the loop for new commands.
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;               // Signalled when commands finish.
+    ctl_cmd_t *queue[CTL_QUEUE];        // Submitted, not sent.
+    int      head;
+    int      count;
+
+    // Loop thread only.
+    ctl_cmd_t *current;                 // Waiting for its reply.
+    bool     streaming;                 // MD or MS running.
+    bool     suspended;                 // Stream stopped for a command.
+    char     stream[CTL_CMD_MAX + 1];   // Command to resume stream with.
+    ctl_cmd_t suspend;                  // Internal QT.
+    ctl_cmd_t resume;                   // Internal MD or MS.
+    parser_reply_t on_other;            // Unmatched replies.
+    void    *other_arg;
+
+    // Statistics.
+    uint32_t sent;
+    uint32_t timeouts;
+    uint32_t unmatched;                 // Replies to nothing outstanding.
+    uint32_t suspends;
+} ctl_t;
+
+//  Functions. ----------------------------------------------------------------
+
+int ctl_init(ctl_t *ctl, io_t *io, int fd, parser_t *parser);
+int ctl_submit(ctl_t *ctl, ctl_cmd_t *cmd, const char *text,
+               ctl_done_t done, void *arg);
+int ctl_wait(ctl_t *ctl, ctl_cmd_t *cmd, int timeout_ms);
+void ctl_run(ctl_t *ctl);
+bool ctl_idle(ctl_t *ctl);
+void ctl_set_other(ctl_t *ctl, parser_reply_t on_other, void *arg);
+void ctl_free(ctl_t *ctl);
+
+#endif
@@ -0,0 +1,292 @@
+//  ===========================================================================
+//  Scan daemon for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+/*
+    Owns the sensors and publishes every scan to local consumers, both on
+    the Unix socket server and the shared memory ring.
+
+    Usage: urg-daemon [-d device] [-r cpus] [-p priority] [-m ms]
+
+    -d device   Sensor port, default USB_PORT. Any SCIP 2.0 model works,
+                see urg-model.h.
+    -r cpus     Real-time mode (urg-rt.h). Streams scans with MD and reads
+                them through urg-io.h on a thread pinned to cpus (e.g. 2 or
+                2-3), with memory locked and no allocation once running.
+                Latency statistics are printed on exit.
+    -p priority SCHED_FIFO priority in real-time mode, default RT_PRIORITY.
+    -m ms       Health poll interval in real-time mode (urg-health.h),
+                default HEALTH_PERIOD, 0 to only watch scans. Events are
+                printed.
+
+    Build with the driver's own main disabled, e.g.
+
+    gcc -DURG_NO_MAIN -D_GNU_SOURCE -o urg-daemon urg-daemon.c urg-multi.c \
+        urg-server.c urg-shm.c urg-delta.c urg-parser.c urg-io.c \
+        urg-uring.c urg-rt.c urg-raw.c urg-model.c urg-ctl.c urg-health.c \
+        -lpthread -lrt -lm
+*/
+
+//  ===========================================================================
+
+#include <stdio.h>	    // Standard Input/Output definitions.
+#include <stdlib.h>
+#include <stdint.h>	    // Standard type definitions.
+#include <string.h>	    // String function definitions.
+#include <unistd.h>	    // UNIX standard function definitions.
+#include <signal.h>     // Signal handling.
+
+#include "urg-multi.h"
+#include "urg-server.h"
+#include "urg-shm.h"
+#include "urg-parser.h"
+#include "urg-io.h"
+#include "urg-ctl.h"
+#include "urg-health.h"
+#include "urg-rt.h"
+
+#define DAEMON_SENSORS 1    // Sensors to open.
+#define DAEMON_SLOTS  64    // Shared memory ring slots.
+#define DAEMON_CALIBRATE 1000   // Wakeup latency samples at 1 ms.
+
+static volatile sig_atomic_t running = 1;
+
+static server_t server;
+static shm_t    shm;
+static rt_t     rt;
+static ctl_t    ctl[DAEMON_SENSORS];   // Control while streaming.
+static health_t health[DAEMON_SENSORS];
+static uint64_t health_period = HEALTH_PERIOD;
+
+//  ===========================================================================
+//  Signal handler.
+//  ===========================================================================
+static void stop(int sig)
+{
+    (void)sig;
+    running = 0;
+}
+
+//  ===========================================================================
+//  Publishes a streamed scan.
+//  ===========================================================================
+/*
+    Raw clients get the sensor's characters as they came. The scan is
+    decoded at most once, raw_to_scan() reusing what the server decoded.
+*/
+static void publish(raw_t *raw, void *arg)
+{
+    static scan_t scan;
+    sensor_t *sensor = arg;
+
+    health_scan(&health[sensor->id], raw);
+    server_publish_raw(&server, sensor->id, &sensor->spec, raw);
+    raw_to_scan(raw, &scan);
+    shm_publish(&shm, sensor->id, &scan);
+    rt_frame(&rt, sensor->id, raw->host_time);
+}
+
+//  ===========================================================================
+//  Reports a health event.
+//  ===========================================================================
+static void health_event(const health_event_t *event, void *arg)
+{
+    (void)arg;
+
+    printf("Sensor %d %s: %d (expected %d) %s\n", event->sensor,
+           health_event_name(event->type), event->value, event->expected,
+           event->text);
+}
+
+//  ===========================================================================
+//  Streams scans on a real-time thread until stopped.
+//  ===========================================================================
+/*
+    Everything is allocated and touched before rt_arm(), so the loop only
+    parses, encodes into preallocated buffers and publishes. Commands go
+    through urg-ctl.h so they can be sent without stopping the stream.
+*/
+static int stream(const cpu_set_t *cpus, int priority)
+{
+    static parser_t  parser[DAEMON_SENSORS];
+    static ctl_cmd_t start[DAEMON_SENSORS];
+    static ctl_cmd_t stop[DAEMON_SENSORS];
+    char     cmd[DATA_CMD_LEN + DATA_STRING_LEN];
+    io_t     io;
+    uint64_t end;
+    uint8_t  i;
+
+    if (io_init(&io, IO_EPOLL) < 0) return -1;
+
+    for (i = 0; i < DAEMON_SENSORS; i++)
+    {
+        parser_init(&parser[i], NULL, NULL, sensor[i]);
+        parser_set_raw(&parser[i], publish);
+        if (io_add(&io, sensor[i]->serial.fd, &parser[i]) < 0 ||
+            ctl_init(&ctl[i], &io, sensor[i]->serial.fd, &parser[i]) < 0)
+        {
+            io_free(&io);
+            return -1;
+        }
+        health_init(&health[i], i, &ctl[i], &sensor[i]->timing,
+                    health_period, health_event, NULL);
+    }
+
+    rt_init(&rt, &sensor[0]->timing);
+    rt_lock_memory();
+    rt_thread(cpus, priority);
+    rt_prefault(&parser, sizeof(parser));
+    rt_prefault(&ctl, sizeof(ctl));
+
+    rt_calibrate(&rt, DAEMON_CALIBRATE, 1000);
+
+    for (i = 0; i < DAEMON_SENSORS; i++)
+    {
+        sprintf(cmd, "%s%04d%04d%02d000",
+                (sensor[i]->acq.encoding == 2) ? CMD_GET_DATA_CONT2
+                                               : CMD_GET_DATA_CONT3,
+                sensor[i]->spec.step_min, sensor[i]->spec.step_max,
+                sensor[i]->acq.cluster);
+
+        if (ctl_submit(&ctl[i], &start[i], cmd, NULL, NULL) < 0)
+            printf("Couldn't start sensor %d.\n", i);
+    }
+
+    rt_arm(&rt);
+
+    while (running)
+    {
+        if (io_poll(&io, 100) < 0) break;
+        for (i = 0; i < DAEMON_SENSORS; i++)
+        {
+            ctl_run(&ctl[i]);
+            health_run(&health[i]);
+        }
+    }
+
+    // Before shutdown, which is allowed to free and fault.
+    rt_check(&rt);
+
+    // Stop streaming, giving replies up to a second.
+    for (i = 0; i < DAEMON_SENSORS; i++)
+        ctl_submit(&ctl[i], &stop[i], CMD_SET_LASER_OFF, NULL, NULL);
+
+    end = host_time() + 1000000;
+    for (i = 0; i < DAEMON_SENSORS && host_time() < end; i++)
+    {
+        while (!ctl_idle(&ctl[i]) && host_time() < end)
+        {
+            if (io_poll(&io, 100) < 0) break;
+            ctl_run(&ctl[i]);
+        }
+    }
+
+    io_free(&io);
+    for (i = 0; i < DAEMON_SENSORS; i++) ctl_free(&ctl[i]);
+    rt_report(&rt);
+
+    return 0;
+}
+
+//  ===========================================================================
+//  Main routine.
+//  ===========================================================================
+int main(int argc, char *argv[])
+{
+    static scan_t scan;
+    cpu_set_t cpus;
+    const char *device = USB_PORT;
+    bool    realtime = false;
+    int     priority = RT_PRIORITY;
+    int     opt;
+    int     err;
+    uint8_t i;
+
+    while ((opt = getopt(argc, argv, "d:r:p:m:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'd':
+            device = optarg;
+            break;
+        case 'r':
+            if (rt_cpus(optarg, &cpus) < 0)
+            {
+                printf("Bad CPU list %s.\n", optarg);
+                return -1;
+            }
+            realtime = true;
+            break;
+        case 'p':
+            priority = atoi(optarg);
+            break;
+        case 'm':
+            health_period = atoi(optarg) * 1000ULL;
+            break;
+        default:
+            printf("Usage: %s [-d device] [-r cpus] [-p priority] [-m ms]\n",
+                   argv[0]);
+            return -1;
+        }
+    }
+
+    signal(SIGINT, stop);
+    signal(SIGTERM, stop);
+
+    for (i = 0; i < DAEMON_SENSORS; i++)
+    {
+        err = sensor_open(device);
+        if (err < 0)
+        {
+            printf("Couldn't initialise sensor.\n");
+            return -1;
+        }
+    }
+
+    err = server_init(&server, SERVER_PATH);
+    if (err < 0) return -1;
+
+    err = shm_publisher_open(&shm, SHM_NAME, DAEMON_SLOTS,
+                             &sensor[0]->spec, DAEMON_SENSORS);
+    if (err < 0)
+    {
+        server_free(&server);
+        return -1;
+    }
+    shm_publish_delta(&shm, DELTA_THRESHOLD, DELTA_INTERVAL);
+
+    if (realtime) stream(&cpus, priority);
+
+    while (running && !realtime)
+    {
+        for (i = 0; i < DAEMON_SENSORS; i++)
+        {
+            if (get_scan(sensor[i], &scan) < 0) continue;
+
+            server_publish(&server, i, &sensor[i]->spec, &scan);
+            shm_publish(&shm, i, &scan);
+        }
+    }
+
+    shm_close(&shm);
+    server_free(&server);
+
+    for (i = 0; i < DAEMON_SENSORS; i++)
+        serial_close(&sensor[i]->serial);
+
+    return (0);
+}
@@ -0,0 +1,233 @@
+//  ===========================================================================
+//  Delta encoding for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+#include "urg-delta.h"
+#include <stdio.h>	    // Standard Input/Output definitions.
+#include <string.h>	    // String function definitions.
+#include <stdint.h>	    // Standard type definitions.
+#include <stdbool.h>	// Boolean definitions.
+
+//  Vector types. -------------------------------------------------------------
+
+typedef uint16_t v8u16 __attribute__((vector_size(16)));
+typedef uint64_t v2u64 __attribute__((vector_size(16)));
+
+/* Unaligned load type for the scan range array. */
+typedef uint16_t v8u16u __attribute__((vector_size(16), aligned(2)));
+
+//  ===========================================================================
+//  Initialises delta encoder.
+//  ===========================================================================
+void delta_init(delta_t *delta, uint16_t threshold, uint16_t interval)
+{
+    memset(delta, 0, sizeof(delta_t));
+
+    delta->threshold = threshold;
+    delta->interval = interval;
+    delta->key = true;
+}
+
+//  ===========================================================================
+//  Makes the next frame a key frame.
+//  ===========================================================================
+void delta_reset(delta_t *delta)
+{
+    delta->key = true;
+}
+
+//  ===========================================================================
+//  Marks changed beams in bitmap, returns number changed.
+//  ===========================================================================
+int delta_compare(delta_t *delta, const scan_t *scan, delta_hdr_t *hdr,
+                  uint8_t *bitmap)
+{
+    const v8u16 zero = {0};
+    const v8u16 t = zero + delta->threshold;
+    const v8u16 bit = {1, 2, 4, 8, 16, 32, 64, 128};
+    uint16_t *last = delta->last;
+    int bytes;
+    int changed;
+    int i;
+
+    bytes = (scan->count + 7) / 8;
+
+    if (delta->count != scan->count ||
+        (delta->interval > 0 && delta->since >= delta->interval))
+        delta->key = true;
+
+    if (delta->key)
+    {
+        memset(bitmap, 0xff, bytes);
+        if (scan->count % 8) bitmap[bytes - 1] = (1 << (scan->count % 8)) - 1;
+        memcpy(last, scan->range, scan->count * sizeof(uint16_t));
+
+        delta->key = false;
+        delta->since = 0;
+        delta->count = scan->count;
+        hdr->flags = DELTA_KEY;
+        hdr->changed = scan->count;
+        return (scan->count);
+    }
+
+    /*
+        |r - l| > t without widening: the larger minus the smaller. The
+        compare gives all ones per changed lane, and with one bit per lane
+        the lanes add up to the bitmap byte.
+    */
+    changed = 0;
+    for (i = 0; i + DELTA_LANES <= scan->count; i += DELTA_LANES)
+    {
+        v8u16 r = *(const v8u16u *)&scan->range[i];
+        v8u16 l = *(const v8u16 *)&last[i];
+        v8u16 gt = (v8u16)(r > l);
+        v8u16 d = ((r - l) & gt) | ((l - r) & ~gt);
+        v8u16 m = (v8u16)(d > t);
+        v2u64 any = (v2u64)m;
+        uint8_t byte;
+        int lane;
+
+        if ((any[0] | any[1]) == 0)
+        {
+            bitmap[i / 8] = 0;
+            continue;
+        }
+
+        m &= bit;
+        byte = 0;
+        for (lane = 0; lane < DELTA_LANES; lane++) byte |= m[lane];
+        bitmap[i / 8] = byte;
+
+        // Only changed beams move the reference.
+        *(v8u16 *)&last[i] = (r & (v8u16)(m != 0)) | (l & (v8u16)(m == 0));
+        changed += __builtin_popcount(byte);
+    }
+
+    if (i < scan->count)
+    {
+        uint8_t byte = 0;
+        for (; i < scan->count; i++)
+        {
+            uint16_t r = scan->range[i];
+            uint16_t d = (r > last[i]) ? r - last[i] : last[i] - r;
+
+            if (d > delta->threshold)
+            {
+                byte |= 1 << (i % 8);
+                last[i] = r;
+                changed++;
+            }
+        }
+        bitmap[bytes - 1] = byte;
+    }
+
+    delta->since++;
+    hdr->flags = 0;
+    hdr->changed = changed;
+
+    return (changed);
+}
+
+//  ===========================================================================
+//  Encodes frame, returns size in bytes.
+//  ===========================================================================
+size_t delta_encode(delta_t *delta, const scan_t *scan, uint8_t *data)
+{
+    delta_hdr_t hdr;
+    uint8_t    *bitmap;
+    uint8_t    *value;
+    int bytes;
+    int byte;
+    int i;
+
+    bitmap = data + sizeof(delta_hdr_t);
+    bytes = (scan->count + 7) / 8;
+
+    delta_compare(delta, scan, &hdr, bitmap);
+    memcpy(data, &hdr, sizeof(delta_hdr_t));
+
+    value = bitmap + bytes;
+
+    if (hdr.flags & DELTA_KEY)
+    {
+        memcpy(value, scan->range, scan->count * sizeof(uint16_t));
+    }
+    else
+    {
+        // Walk set bits only, values may be unaligned.
+        for (byte = 0; byte < bytes; byte++)
+        {
+            unsigned int bits = bitmap[byte];
+            while (bits)
+            {
+                i = byte * 8 + __builtin_ctz(bits);
+                memcpy(value, &scan->range[i], sizeof(uint16_t));
+                value += sizeof(uint16_t);
+                bits &= bits - 1;
+            }
+        }
+    }
+
+    return (sizeof(delta_hdr_t) + bytes + hdr.changed * sizeof(uint16_t));
+}
+
+//  ===========================================================================
+//  Applies encoded frame to ranges, returns 1 if key frame, 0 if delta.
+//  ===========================================================================
+int delta_decode(uint16_t *range, uint16_t count, const uint8_t *data,
+                 size_t size)
+{
+    delta_hdr_t    hdr;
+    const uint8_t *bitmap;
+    const uint8_t *value;
+    int bytes;
+    int byte;
+    int n;
+
+    bytes = (count + 7) / 8;
+    if (size < sizeof(delta_hdr_t) + bytes) return -1;
+
+    memcpy(&hdr, data, sizeof(delta_hdr_t));
+    if (size != sizeof(delta_hdr_t) + bytes + hdr.changed * sizeof(uint16_t))
+        return -1;
+
+    bitmap = data + sizeof(delta_hdr_t);
+    value = bitmap + bytes;
+
+    if (hdr.flags & DELTA_KEY)
+    {
+        if (hdr.changed != count) return -1;
+        memcpy(range, value, count * sizeof(uint16_t));
+        return 1;
+    }
+
+    n = 0;
+    for (byte = 0; byte < bytes; byte++)
+    {
+        unsigned int bits = bitmap[byte];
+        while (bits)
+        {
+            int i = byte * 8 + __builtin_ctz(bits);
+            if (i >= count || n >= hdr.changed) return -1;
+            memcpy(&range[i], value + n * sizeof(uint16_t), sizeof(uint16_t));
+            bits &= bits - 1;
+            n++;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,98 @@
+//  ===========================================================================
+//  Delta encoding for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+/*
+    Sends only the beams that changed since the last published frame.
+
+    Format:
+
+    ,-------------------------------------------------------,
+    | delta_hdr_t | Bitmap ((count + 7) / 8) | Changed ranges |
+    '-------------------------------------------------------'
+
+    Bit i of the bitmap (byte i / 8, bit i % 8) is set if beam i is sent.
+    The changed ranges follow as uint16_t in beam order.
+
+    Comparison:
+
+    A beam is sent when it differs from the value last sent for it by more
+    than the threshold, so slow drift is still sent once it adds up. The
+    compare runs eight beams at a time and whole unchanged blocks are
+    skipped, which is the common case on a static scene.
+
+    Key frames:
+
+    Every interval frames, or when forced, every beam is sent and the
+    header is flagged DELTA_KEY. A receiver can only apply deltas on top of
+    a key frame, so late joiners and receivers that lost a frame wait for
+    the next one.
+*/
+
+//  ===========================================================================
+
+#ifndef URG_DELTA_H
+#define URG_DELTA_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "urg-multi.h"
+
+//  Defines. ------------------------------------------------------------------
+
+#define DELTA_KEY        0x0001 // Frame holds every beam.
+#define DELTA_LANES      8
+#define DELTA_STRIDE     ((SCAN_STEPS_MAX + DELTA_LANES - 1) \
+                          & ~(DELTA_LANES - 1))
+#define DELTA_BYTES      (DELTA_STRIDE / 8)
+#define DELTA_THRESHOLD  10     // Default change threshold (mm).
+#define DELTA_INTERVAL   50     // Default frames between key frames.
+
+/* Largest encoded frame. */
+#define DELTA_SIZE_MAX   (sizeof(delta_hdr_t) + DELTA_BYTES \
+                          + SCAN_STEPS_MAX * sizeof(uint16_t))
+
+//  Types. --------------------------------------------------------------------
+
+typedef struct
+{
+    uint16_t flags;         // DELTA_KEY.
+    uint16_t changed;       // Ranges following the bitmap.
+} delta_hdr_t;
+
+typedef struct
+{
+    uint16_t threshold;     // Change threshold (mm).
+    uint16_t interval;      // Frames between key frames.
+    uint16_t since;         // Frames since last key frame.
+    uint16_t count;         // Beams in last frame.
+    bool     key;           // Next frame is a key frame.
+    _Alignas(16) uint16_t last[DELTA_STRIDE];   // Last value sent per beam.
+} delta_t;
+
+//  Functions. ----------------------------------------------------------------
+
+void delta_init(delta_t *delta, uint16_t threshold, uint16_t interval);
+void delta_reset(delta_t *delta);
+int delta_compare(delta_t *delta, const scan_t *scan, delta_hdr_t *hdr,
+                  uint8_t *bitmap);
+size_t delta_encode(delta_t *delta, const scan_t *scan, uint8_t *data);
+int delta_decode(uint16_t *range, uint16_t count, const uint8_t *data,
+                 size_t size);
+
+#endif
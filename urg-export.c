@@ -0,0 +1,468 @@
+//  ===========================================================================
+//  Point cloud export for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+#include "urg-export.h"
+#include <unistd.h>	    // UNIX standard function definitions.
+#include <stdio.h>	    // Standard Input/Output definitions.
+#include <stdlib.h>
+#include <string.h>	    // String function definitions.
+#include <stdint.h>	    // Standard type definitions.
+#include <errno.h>      // Error numbers.
+#include <fcntl.h>	    // File control definitions.
+#include <math.h>       // Maths definitions.
+
+//  ===========================================================================
+//  Renders file header for a point count, returns its length.
+//  ===========================================================================
+static size_t export_header(int format, uint64_t points, char *header)
+{
+    // Counts are fixed width so the final header overwrites the first.
+    if (format == EXPORT_PLY)
+        return snprintf(header, EXPORT_HEADER_MAX,
+                        "ply\n"
+                        "format binary_little_endian 1.0\n"
+                        "comment Hokuyo URG-04LX-UG01\n"
+                        "element vertex %020llu\n"
+                        "property float x\n"
+                        "property float y\n"
+                        "property float z\n"
+                        "property uchar sensor\n"
+                        "property uint frame\n"
+                        "end_header\n",
+                        (unsigned long long)points);
+
+    return snprintf(header, EXPORT_HEADER_MAX,
+                    "# .PCD v0.7 - Hokuyo URG-04LX-UG01\n"
+                    "VERSION 0.7\n"
+                    "FIELDS x y z sensor frame\n"
+                    "SIZE 4 4 4 1 4\n"
+                    "TYPE F F F U U\n"
+                    "COUNT 1 1 1 1 1\n"
+                    "WIDTH %020llu\n"
+                    "HEIGHT 1\n"
+                    "VIEWPOINT 0 0 0 1 0 0 0\n"
+                    "POINTS %020llu\n"
+                    "DATA binary\n",
+                    (unsigned long long)points, (unsigned long long)points);
+}
+
+//  ===========================================================================
+//  Builds name of a file.
+//  ===========================================================================
+static void export_name(const export_t *exp, uint32_t file, char *name,
+                        size_t len)
+{
+    const char *ext = (exp->format == EXPORT_PLY) ? "ply" : "pcd";
+
+    if (exp->frames_per_file == 0)
+        snprintf(name, len, "%s.%s", exp->base, ext);
+    else
+        snprintf(name, len, "%s-%06u.%s", exp->base, file, ext);
+}
+
+//  ===========================================================================
+//  Writes all of data, returns -1 on error.
+//  ===========================================================================
+static int export_write(int fd, const uint8_t *data, size_t size)
+{
+    ssize_t ret;
+
+    while (size > 0)
+    {
+        ret = write(fd, data, size);
+        if (ret < 0)
+        {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        data += ret;
+        size -= ret;
+    }
+
+    return 0;
+}
+
+//  ===========================================================================
+//  Starts the next file (writer thread).
+//  ===========================================================================
+static int export_file_open(export_t *exp)
+{
+    char name[300];
+    char header[EXPORT_HEADER_MAX];
+
+    export_name(exp, exp->file, name, sizeof(name));
+
+    exp->fd = open(name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (exp->fd < 0)
+    {
+        perror("Export open");
+        return -1;
+    }
+
+    // Rolling window, remove the file that just fell out of it.
+    if (exp->frames_per_file > 0 && exp->keep > 0 && exp->file >= exp->keep)
+    {
+        export_name(exp, exp->file - exp->keep, name, sizeof(name));
+        unlink(name);
+    }
+
+    exp->file_points = 0;
+    exp->header_len = export_header(exp->format, 0, header);
+
+    return export_write(exp->fd, (uint8_t *)header, exp->header_len);
+}
+
+//  ===========================================================================
+//  Fills in point count and closes file (writer thread).
+//  ===========================================================================
+static void export_file_finish(export_t *exp)
+{
+    char header[EXPORT_HEADER_MAX];
+    size_t len;
+
+    len = export_header(exp->format, exp->file_points, header);
+    if (len != exp->header_len ||
+        pwrite(exp->fd, header, len, 0) != (ssize_t)len)
+    {
+        printf("Error finishing export file %u.\n", exp->file);
+        exp->errors++;
+    }
+
+    close(exp->fd);
+    exp->fd = -1;
+    exp->file++;
+}
+
+//  ===========================================================================
+//  Writes each segment of a buffer to its file (writer thread).
+//  ===========================================================================
+static void export_segments(export_t *exp, export_buffer_t *buf)
+{
+    export_segment_t *seg;
+    size_t start;
+    int i;
+
+    start = 0;
+    for (i = 0; i < buf->segments; i++)
+    {
+        seg = &buf->segment[i];
+
+        if (seg->end > start && (exp->fd >= 0 || export_file_open(exp) == 0))
+        {
+            if (export_write(exp->fd, buf->data + start,
+                             seg->end - start) < 0)
+            {
+                perror("Export write");
+                exp->errors++;
+            }
+            else
+            {
+                exp->file_points += seg->points;
+            }
+        }
+        if (seg->last && exp->fd >= 0) export_file_finish(exp);
+
+        start = seg->end;
+    }
+}
+
+//  ===========================================================================
+//  Writer thread.
+//  ===========================================================================
+static void *export_thread(void *arg)
+{
+    export_t *exp = arg;
+    export_buffer_t *buf;
+    int i;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&exp->lock);
+        while (exp->queue_count == 0 && !exp->stop)
+            pthread_cond_wait(&exp->ready, &exp->lock);
+
+        if (exp->queue_count == 0)
+        {
+            pthread_mutex_unlock(&exp->lock);
+            break;
+        }
+
+        buf = exp->queue[0];
+        exp->queue_count--;
+        for (i = 0; i < exp->queue_count; i++)
+            exp->queue[i] = exp->queue[i + 1];
+        pthread_mutex_unlock(&exp->lock);
+
+        export_segments(exp, buf);
+
+        pthread_mutex_lock(&exp->lock);
+        exp->points += buf->points;
+        buf->used = 0;
+        buf->points = 0;
+        buf->segments = 0;
+        exp->free[exp->free_count++] = buf;
+        pthread_cond_broadcast(&exp->done);
+        pthread_mutex_unlock(&exp->lock);
+    }
+
+    if (exp->fd >= 0) export_file_finish(exp);
+
+    return NULL;
+}
+
+//  ===========================================================================
+//  Hands the fill buffer to the writer.
+//  ===========================================================================
+static void export_push(export_t *exp)
+{
+    export_buffer_t *fill = exp->fill;
+    export_segment_t *seg;
+
+    // Close the open segment, the file carries on in the next buffer.
+    if (fill->used > exp->seg_start)
+    {
+        seg = &fill->segment[fill->segments++];
+        seg->end = fill->used;
+        seg->points = exp->seg_points;
+        seg->last = false;
+    }
+    exp->seg_start = 0;
+    exp->seg_points = 0;
+
+    pthread_mutex_lock(&exp->lock);
+    exp->queue[exp->queue_count++] = exp->fill;
+    pthread_cond_signal(&exp->ready);
+    pthread_mutex_unlock(&exp->lock);
+
+    exp->fill = NULL;
+}
+
+//  ===========================================================================
+//  Returns space for a frame of up to points points, NULL to drop it.
+//  ===========================================================================
+static uint8_t *export_begin(export_t *exp, uint32_t points)
+{
+    size_t size = (size_t)points * EXPORT_POINT_SIZE;
+
+    if (size > EXPORT_BUFFER_SIZE) return NULL;
+
+    if (exp->fill != NULL && exp->fill->used + size > EXPORT_BUFFER_SIZE)
+        export_push(exp);
+
+    if (exp->fill == NULL)
+    {
+        pthread_mutex_lock(&exp->lock);
+        if (exp->free_count > 0) exp->fill = exp->free[--exp->free_count];
+        pthread_mutex_unlock(&exp->lock);
+
+        if (exp->fill == NULL) return NULL;
+    }
+
+    return (exp->fill->data + exp->fill->used);
+}
+
+//  ===========================================================================
+//  Commits a frame of points written at export_begin().
+//  ===========================================================================
+static void export_end(export_t *exp, uint32_t points)
+{
+    export_buffer_t *fill = exp->fill;
+    export_segment_t *seg;
+
+    fill->used += (size_t)points * EXPORT_POINT_SIZE;
+    fill->points += points;
+    exp->seg_points += points;
+    exp->frames++;
+
+    // Always counted, since points are tagged with it even in one file.
+    exp->file_frames++;
+    if (exp->frames_per_file == 0 ||
+        exp->file_frames < exp->frames_per_file) return;
+
+    // File is complete.
+    seg = &fill->segment[fill->segments++];
+    seg->end = fill->used;
+    seg->points = exp->seg_points;
+    seg->last = true;
+
+    exp->seg_start = fill->used;
+    exp->seg_points = 0;
+    exp->file_frames = 0;
+
+    // Keep a segment spare for export_push().
+    if (fill->segments >= EXPORT_SEGMENTS - 1) export_push(exp);
+}
+
+//  ===========================================================================
+//  Packs one point.
+//  ===========================================================================
+static uint8_t *export_put(uint8_t *p, float x, float y, uint8_t sensor,
+                           uint32_t frame)
+{
+    const float z = 0.0f;
+
+    memcpy(p, &x, 4);
+    memcpy(p + 4, &y, 4);
+    memcpy(p + 8, &z, 4);
+    p[12] = sensor;
+    memcpy(p + 13, &frame, 4);
+
+    return (p + EXPORT_POINT_SIZE);
+}
+
+//  ===========================================================================
+//  Opens exporter and starts writer thread.
+//  ===========================================================================
+int export_open(export_t *exp, const char *base, int format,
+                uint32_t frames_per_file, uint32_t keep)
+{
+    int i;
+
+    memset(exp, 0, sizeof(export_t));
+    strncpy(exp->base, base, sizeof(exp->base) - 1);
+    exp->format = format;
+    exp->frames_per_file = frames_per_file;
+    exp->keep = keep;
+    exp->fd = -1;
+
+    for (i = 0; i < EXPORT_BUFFERS; i++)
+    {
+        exp->buffer[i].data = malloc(EXPORT_BUFFER_SIZE);
+        if (exp->buffer[i].data == NULL)
+        {
+            printf("Error allocating export buffers.\n");
+            while (i-- > 0) free(exp->buffer[i].data);
+            return -1;
+        }
+        exp->free[i] = &exp->buffer[i];
+    }
+    exp->free_count = EXPORT_BUFFERS;
+
+    pthread_mutex_init(&exp->lock, NULL);
+    pthread_cond_init(&exp->ready, NULL);
+    pthread_cond_init(&exp->done, NULL);
+
+    if (pthread_create(&exp->thread, NULL, export_thread, exp) != 0)
+    {
+        printf("Error starting export thread.\n");
+        for (i = 0; i < EXPORT_BUFFERS; i++) free(exp->buffer[i].data);
+        return -1;
+    }
+
+    return 0;
+}
+
+//  ===========================================================================
+//  Queues a Cartesian frame, returns -1 if dropped.
+//  ===========================================================================
+int export_points(export_t *exp, uint8_t sensor, const points_t *points)
+{
+    uint8_t *p;
+    uint32_t n;
+    int i;
+
+    p = export_begin(exp, points->count);
+    if (p == NULL)
+    {
+        exp->dropped++;
+        return -1;
+    }
+
+    n = 0;
+    for (i = 0; i < points->count; i++)
+    {
+        if (isnan(points->x[i])) continue;
+        p = export_put(p, points->x[i], points->y[i], sensor,
+                       exp->file_frames);
+        n++;
+    }
+
+    export_end(exp, n);
+
+    return 0;
+}
+
+//  ===========================================================================
+//  Queues a fused cloud, returns -1 if dropped.
+//  ===========================================================================
+int export_cloud(export_t *exp, const cloud_t *cloud)
+{
+    uint8_t *p;
+    uint32_t n;
+    uint32_t i;
+
+    p = export_begin(exp, cloud->count);
+    if (p == NULL)
+    {
+        exp->dropped++;
+        return -1;
+    }
+
+    n = 0;
+    for (i = 0; i < cloud->count; i++)
+    {
+        if (isnan(cloud->x[i])) continue;
+        p = export_put(p, cloud->x[i], cloud->y[i], cloud->sensor[i],
+                       exp->file_frames);
+        n++;
+    }
+
+    export_end(exp, n);
+
+    return 0;
+}
+
+//  ===========================================================================
+//  Writes everything queued so far and waits for it.
+//  ===========================================================================
+void export_flush(export_t *exp)
+{
+    if (exp->fill != NULL) export_push(exp);
+
+    pthread_mutex_lock(&exp->lock);
+    while (exp->free_count < EXPORT_BUFFERS)
+        pthread_cond_wait(&exp->done, &exp->lock);
+    pthread_mutex_unlock(&exp->lock);
+}
+
+//  ===========================================================================
+//  Flushes, finishes the current file and stops writer thread.
+//  ===========================================================================
+void export_close(export_t *exp)
+{
+    int i;
+
+    export_flush(exp);
+
+    pthread_mutex_lock(&exp->lock);
+    exp->stop = true;
+    pthread_cond_signal(&exp->ready);
+    pthread_mutex_unlock(&exp->lock);
+
+    pthread_join(exp->thread, NULL);
+
+    for (i = 0; i < EXPORT_BUFFERS; i++)
+    {
+        free(exp->buffer[i].data);
+        exp->buffer[i].data = NULL;
+    }
+
+    pthread_cond_destroy(&exp->ready);
+    pthread_cond_destroy(&exp->done);
+    pthread_mutex_destroy(&exp->lock);
+}
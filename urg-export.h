@@ -0,0 +1,135 @@
+//  ===========================================================================
+//  Point cloud export for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+/*
+    Writes Cartesian or fused frames as binary PCD or PLY point clouds.
+
+    Points:
+
+    Each point is x, y, z (float, m, z always 0), the source sensor
+    (uint8) and the frame number within the file (uint32), packed into 17
+    bytes little endian. Invalid (NAN) points are skipped.
+
+    Files:
+
+    With frames_per_file 0 every frame goes into one file, <base>.<ext>.
+    Otherwise a new file <base>-NNNNNN.<ext> is started every
+    frames_per_file frames, and if keep is not 0 only the last keep files
+    are kept, giving a rolling window of recent data. The point count in
+    the header is written as a fixed width placeholder and filled in when
+    the file is finished.
+
+    Buffering:
+
+    Frames are appended to large buffers and a writer thread writes each
+    full buffer with one write() per file it spans, so short files do not
+    waste buffers. The caller only copies points and never waits for the
+    disk. If the writer falls so far behind that no buffer is free, the
+    frame is dropped and counted.
+*/
+
+//  ===========================================================================
+
+#ifndef URG_EXPORT_H
+#define URG_EXPORT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "urg-multi.h"
+#include "urg-fusion.h"
+
+//  Defines. ------------------------------------------------------------------
+
+/* Formats. */
+#define EXPORT_PCD          0
+#define EXPORT_PLY          1
+
+#define EXPORT_POINT_SIZE   17                  // Packed bytes per point.
+#define EXPORT_BUFFERS      4
+#define EXPORT_BUFFER_SIZE  (4 * 1024 * 1024)   // Must hold a fused frame.
+#define EXPORT_HEADER_MAX   512
+#define EXPORT_SEGMENTS     64                  // File ends per buffer.
+
+//  Types. --------------------------------------------------------------------
+
+/* Run of a buffer that belongs to one file. */
+typedef struct
+{
+    size_t   end;           // Offset after segment.
+    uint32_t points;
+    bool     last;          // Finish file after segment.
+} export_segment_t;
+
+typedef struct
+{
+    uint8_t *data;
+    size_t   used;          // Bytes filled.
+    uint32_t points;        // Points in buffer.
+    int      segments;      // Completed segments.
+    export_segment_t segment[EXPORT_SEGMENTS];
+} export_buffer_t;
+
+typedef struct
+{
+    char     base[256];     // Path without extension.
+    int      format;
+    uint32_t frames_per_file;
+    uint32_t keep;          // Files kept, 0 for all.
+
+    // Producer.
+    export_buffer_t *fill;  // Buffer being filled, NULL if none.
+    uint32_t file_frames;   // Frames sent to the current file.
+    size_t   seg_start;     // Fill offset where current segment began.
+    uint32_t seg_points;    // Points in current segment.
+
+    // Writer.
+    int      fd;            // Current file, -1 if none.
+    uint32_t file;          // Number of current file.
+    uint64_t file_points;   // Points written to current file.
+    size_t   header_len;
+
+    // Shared.
+    export_buffer_t  buffer[EXPORT_BUFFERS];
+    export_buffer_t *free[EXPORT_BUFFERS];
+    int              free_count;
+    export_buffer_t *queue[EXPORT_BUFFERS];     // Full, oldest first.
+    int              queue_count;
+    bool             stop;
+    pthread_mutex_t  lock;
+    pthread_cond_t   ready;     // Queue has a buffer or stop is set.
+    pthread_cond_t   done;      // A buffer was freed.
+    pthread_t        thread;
+
+    // Statistics.
+    uint64_t frames;        // Frames accepted.
+    uint64_t dropped;       // Frames dropped.
+    uint64_t points;        // Points written.
+    uint32_t errors;        // Write errors.
+} export_t;
+
+//  Functions. ----------------------------------------------------------------
+
+int export_open(export_t *exp, const char *base, int format,
+                uint32_t frames_per_file, uint32_t keep);
+int export_points(export_t *exp, uint8_t sensor, const points_t *points);
+int export_cloud(export_t *exp, const cloud_t *cloud);
+void export_flush(export_t *exp);
+void export_close(export_t *exp);
+
+#endif
@@ -0,0 +1,270 @@
+//  ===========================================================================
+//  Range filters for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+#include "urg-filter.h"
+#include <stdio.h>	    // Standard Input/Output definitions.
+#include <string.h>	    // String function definitions.
+#include <stdint.h>	    // Standard type definitions.
+#include <stdbool.h>	// Boolean definitions.
+#include <math.h>       // Maths definitions.
+
+//  Vector types. -------------------------------------------------------------
+
+typedef uint16_t v8u16 __attribute__((vector_size(16)));
+
+/* Unaligned load and store type for range arrays. */
+typedef uint16_t v8u16u __attribute__((vector_size(16), aligned(2)));
+
+/* Lane-wise min and max by compare and select. */
+#define VEC_MIN(a, b) \
+    (((a) & (v8u16)((a) < (b))) | ((b) & (v8u16)((a) >= (b))))
+#define VEC_MAX(a, b) \
+    (((a) & (v8u16)((a) > (b))) | ((b) & (v8u16)((a) <= (b))))
+
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
+
+//  ===========================================================================
+//  Initialises filter for a sensor with the given stages.
+//  ===========================================================================
+void filter_init(filter_t *filter, const spec_t *spec, const acq_t *acq,
+                 uint8_t stages)
+{
+    memset(filter, 0, sizeof(filter_t));
+
+    filter->stages = stages;
+    filter->window = FILTER_WINDOW;
+    filter->dist_min = spec->dist_min;
+    filter->dist_max = spec->dist_max;
+    filter->alpha = FILTER_ALPHA;
+    filter->ema_reset = FILTER_EMA_RESET;
+    filter->step_angle = 2.0f * M_PI * acq->cluster / spec->ang_res;
+
+    filter_set_veil(filter, FILTER_VEIL_ANGLE);
+}
+
+//  ===========================================================================
+//  Sets veiling angle (degrees).
+//  ===========================================================================
+void filter_set_veil(filter_t *filter, float angle)
+{
+    filter->veil_tan = tanf(angle * M_PI / 180.0f);
+}
+
+//  ===========================================================================
+//  Clears temporal state.
+//  ===========================================================================
+void filter_reset(filter_t *filter)
+{
+    filter->count = 0;
+}
+
+//  ===========================================================================
+//  Sets error codes and out of range values to 0.
+//  ===========================================================================
+static void filter_mask(filter_t *filter, scan_t *scan)
+{
+    const v8u16 zero = {0};
+    const v8u16 lo = zero + filter->dist_min;
+    const v8u16 hi = zero + filter->dist_max;
+    uint16_t *r = scan->range;
+    int i;
+
+    for (i = 0; i + FILTER_LANES <= scan->count; i += FILTER_LANES)
+    {
+        v8u16 v = *(v8u16u *)&r[i];
+        *(v8u16u *)&r[i] = v & (v8u16)((v >= lo) & (v <= hi));
+    }
+
+    for (; i < scan->count; i++)
+        if (r[i] < filter->dist_min || r[i] > filter->dist_max) r[i] = 0;
+}
+
+//  ===========================================================================
+//  Scalar median of the window centred on padded beam p.
+//  ===========================================================================
+static uint16_t filter_median_at(const uint16_t *p, int window)
+{
+    uint16_t a, b, c, d, e, f, g;
+
+    if (window == 3)
+    {
+        a = p[-1]; b = p[0]; c = p[1];
+        return MAX(MIN(a, b), MIN(MAX(a, b), c));
+    }
+
+    a = p[-2]; b = p[-1]; c = p[0]; d = p[1]; e = p[2];
+    f = MAX(MIN(a, b), MIN(c, d));
+    g = MIN(MAX(a, b), MAX(c, d));
+    return MAX(MIN(e, f), MIN(MAX(e, f), g));
+}
+
+//  ===========================================================================
+//  Median filter over window beams.
+//  ===========================================================================
+static void filter_median(filter_t *filter, scan_t *scan)
+{
+    const v8u16 zero = {0};
+    uint16_t *pad = filter->pad;
+    uint16_t *r = scan->range;
+    int n = scan->count;
+    int i;
+
+    if (n < 2) return;
+
+    // Copy with the ends repeated so every window is full.
+    memcpy(&pad[FILTER_PAD], r, n * sizeof(uint16_t));
+    pad[0] = pad[1] = r[0];
+    pad[n + FILTER_PAD] = pad[n + FILTER_PAD + 1] = r[n - 1];
+
+    /*
+        Each of a to e holds one position of the window for eight beams, so
+        the median networks below work on eight windows at once. For five,
+        the median of a, b, c, d, e is the median of e and the middle pair
+        of the two sorted pairs (a, b) and (c, d). Invalid centres stay 0.
+    */
+    if (filter->window == 3)
+    {
+        for (i = 0; i + FILTER_LANES <= n; i += FILTER_LANES)
+        {
+            v8u16 a = *(v8u16u *)&pad[i + 1];
+            v8u16 b = *(v8u16u *)&pad[i + 2];
+            v8u16 c = *(v8u16u *)&pad[i + 3];
+            v8u16 lo = VEC_MIN(a, b);
+            v8u16 hi = VEC_MAX(a, b);
+            v8u16 m = VEC_MIN(hi, c);
+
+            *(v8u16u *)&r[i] = VEC_MAX(lo, m) & (v8u16)(b != zero);
+        }
+    }
+    else
+    {
+        for (i = 0; i + FILTER_LANES <= n; i += FILTER_LANES)
+        {
+            v8u16 a = *(v8u16u *)&pad[i];
+            v8u16 b = *(v8u16u *)&pad[i + 1];
+            v8u16 c = *(v8u16u *)&pad[i + 2];
+            v8u16 d = *(v8u16u *)&pad[i + 3];
+            v8u16 e = *(v8u16u *)&pad[i + 4];
+            v8u16 ab_lo = VEC_MIN(a, b);
+            v8u16 ab_hi = VEC_MAX(a, b);
+            v8u16 cd_lo = VEC_MIN(c, d);
+            v8u16 cd_hi = VEC_MAX(c, d);
+            v8u16 f = VEC_MAX(ab_lo, cd_lo);
+            v8u16 g = VEC_MIN(ab_hi, cd_hi);
+            v8u16 lo = VEC_MIN(e, f);
+            v8u16 hi = VEC_MAX(e, f);
+            v8u16 m = VEC_MIN(hi, g);
+
+            *(v8u16u *)&r[i] = VEC_MAX(lo, m) & (v8u16)(c != zero);
+        }
+    }
+
+    for (; i < n; i++)
+        if (r[i] != 0)
+            r[i] = filter_median_at(&pad[i + FILTER_PAD], filter->window);
+}
+
+//  ===========================================================================
+//  Drops veiling points between edges.
+//  ===========================================================================
+static void filter_veil(filter_t *filter, scan_t *scan)
+{
+    float * restrict f = filter->range;
+    uint8_t * restrict drop = filter->drop;
+    uint16_t *r = scan->range;
+    float s, c, t, lo;
+    int n = scan->count;
+    int i;
+
+    if (n < 2) return;
+
+    s = sinf(filter->step_angle);
+    c = cosf(filter->step_angle);
+    t = filter->veil_tan;
+    lo = filter->dist_min;
+
+    for (i = 0; i < n; i++) f[i] = r[i];
+
+    /*
+        For beams i and i + 1 the joining line makes an angle phi with
+        beam i where tan(phi) = r2 sin(d) / (r1 - r2 cos(d)). The pair is
+        veiled when phi is within veil_angle of 0 or 180 degrees, written
+        without division. Bit 0 drops beam i, bit 1 drops beam i + 1.
+    */
+    drop[n - 1] = 0;
+    for (i = 0; i < n - 1; i++)
+    {
+        float r1 = f[i];
+        float r2 = f[i + 1];
+        float y = fabsf(r1 - r2 * c);
+        int veiled = (r1 >= lo) & (r2 >= lo) & (y * t > r2 * s);
+
+        drop[i] = veiled << ((r1 > r2) ? 0 : 1);
+    }
+
+    for (i = n - 1; i > 0; i--)
+        if ((drop[i] & 1) || (drop[i - 1] & 2)) r[i] = 0;
+    if (drop[0] & 1) r[0] = 0;
+}
+
+//  ===========================================================================
+//  Exponential smoothing over time.
+//  ===========================================================================
+static void filter_ema(filter_t *filter, scan_t *scan)
+{
+    float * restrict ema = filter->ema;
+    uint16_t *r = scan->range;
+    float a = filter->alpha;
+    float jump = filter->ema_reset;
+    float lo = filter->dist_min;
+    int n = scan->count;
+    int i;
+
+    if (filter->count != n)
+    {
+        for (i = 0; i < n; i++) ema[i] = r[i];
+        filter->count = n;
+        return;
+    }
+
+    // Branch free so the loop vectorises.
+    for (i = 0; i < n; i++)
+    {
+        float x = r[i];
+        float e = ema[i];
+        int restart = (x < lo) | (e < lo) | (fabsf(x - e) > jump);
+
+        e = restart ? x : e + a * (x - e);
+        ema[i] = e;
+        r[i] = (uint16_t)(e + 0.5f);
+    }
+}
+
+//  ===========================================================================
+//  Runs enabled stages on a frame in place.
+//  ===========================================================================
+void filter_apply(filter_t *filter, scan_t *scan)
+{
+    if (scan->count > SCAN_STEPS_MAX) return;
+
+    if (filter->stages & FILTER_MASK) filter_mask(filter, scan);
+    if (filter->stages & FILTER_MEDIAN) filter_median(filter, scan);
+    if (filter->stages & FILTER_VEIL) filter_veil(filter, scan);
+    if (filter->stages & FILTER_EMA) filter_ema(filter, scan);
+}
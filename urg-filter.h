@@ -0,0 +1,104 @@
+//  ===========================================================================
+//  Range filters for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+/*
+    Cleans up ranges in place, e.g. on frames taken from the pool, before
+    they are used. Each sensor has its own filter_t, which holds its
+    settings, temporal state and scratch space, so nothing is allocated
+    per frame. The enabled stages run in this order.
+
+    FILTER_MASK     Ranges below DMIN are error codes and ranges above DMAX
+                    are out of spec. Both are set to 0 so later stages and
+                    consumers only have one invalid value to check.
+
+    FILTER_MEDIAN   Median over a window of 3 or 5 beams using min/max
+                    sorting networks on eight beams at a time. The ends are
+                    padded by repeating the first and last beams. Invalid
+                    beams stay invalid and count as 0 in their neighbours'
+                    windows, so a beam with most of its window invalid is
+                    dropped as speckle.
+
+    FILTER_VEIL     Removes veiling (mixed) points that appear between an
+                    edge and the background behind it. For neighbouring
+                    beams the line joining the two points is checked against
+                    the beam; if it is within veil_angle of being parallel,
+                    the further point is dropped.
+
+    FILTER_EMA      Exponential smoothing over time per beam. A beam that
+                    jumps by more than ema_reset mm, or was invalid, starts
+                    again from the new range so moving objects are not
+                    smeared.
+*/
+
+//  ===========================================================================
+
+#ifndef URG_FILTER_H
+#define URG_FILTER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "urg-multi.h"
+
+//  Defines. ------------------------------------------------------------------
+
+/* Stages. */
+#define FILTER_MASK     0x01
+#define FILTER_MEDIAN   0x02
+#define FILTER_VEIL     0x04
+#define FILTER_EMA      0x08
+#define FILTER_ALL      0x0f
+
+#define FILTER_LANES    8
+#define FILTER_PAD      2           // Median padding each side.
+#define FILTER_STRIDE   ((SCAN_STEPS_MAX + 2 * FILTER_PAD + FILTER_LANES) \
+                         & ~(FILTER_LANES - 1))
+
+/* Defaults. */
+#define FILTER_WINDOW       3       // Median window (3 or 5).
+#define FILTER_ALPHA        0.3f    // EMA weight of new range.
+#define FILTER_EMA_RESET    100     // Jump that restarts EMA (mm).
+#define FILTER_VEIL_ANGLE   10.0f   // Veiling angle (degrees).
+
+//  Types. --------------------------------------------------------------------
+
+typedef struct
+{
+    uint8_t  stages;        // FILTER_ flags.
+    uint8_t  window;        // Median window.
+    uint16_t dist_min;      // DMIN (mm).
+    uint16_t dist_max;      // DMAX (mm).
+    uint16_t ema_reset;     // mm.
+    float    alpha;         // EMA weight.
+    float    veil_tan;      // tan(veil_angle).
+    float    step_angle;    // Angle between beams (radians).
+    uint16_t count;         // Beams in EMA state, 0 if none yet.
+    _Alignas(16) uint16_t pad[FILTER_STRIDE];   // Padded copy for median.
+    _Alignas(16) float ema[FILTER_STRIDE];      // Smoothed ranges (mm).
+    _Alignas(16) float range[FILTER_STRIDE];    // Ranges as float.
+    uint8_t  drop[FILTER_STRIDE];               // Veiled beams.
+} filter_t;
+
+//  Functions. ----------------------------------------------------------------
+
+void filter_init(filter_t *filter, const spec_t *spec, const acq_t *acq,
+                 uint8_t stages);
+void filter_set_veil(filter_t *filter, float angle);
+void filter_reset(filter_t *filter);
+void filter_apply(filter_t *filter, scan_t *scan);
+
+#endif
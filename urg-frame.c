@@ -0,0 +1,157 @@
+//  ===========================================================================
+//  Compact scan frames for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+#include "urg-frame.h"
+#include <stdio.h>	    // Standard Input/Output definitions.
+#include <stdlib.h>
+#include <string.h>	    // String function definitions.
+#include <stdint.h>	    // Standard type definitions.
+
+_Static_assert(sizeof(frame_t) == FRAME_HEADER, "Frame header size");
+
+//  ===========================================================================
+//  Returns offset of error bitmap for capacity ranges.
+//  ===========================================================================
+static size_t frame_error_offset(uint16_t capacity)
+{
+    return FRAME_HEADER + (((size_t)capacity * sizeof(uint16_t) + 7) & ~7);
+}
+
+//  ===========================================================================
+//  Returns bytes needed for a frame of capacity ranges.
+//  ===========================================================================
+size_t frame_size(uint16_t capacity)
+{
+    size_t size;
+
+    size = frame_error_offset(capacity)
+         + ((capacity + 63) / 64) * sizeof(uint64_t);
+
+    return (size + FRAME_ALIGN - 1) & ~(size_t)(FRAME_ALIGN - 1);
+}
+
+//  ===========================================================================
+//  Sets up an empty frame in frame_size(capacity) bytes.
+//  ===========================================================================
+void frame_init(frame_t *frame, uint16_t capacity)
+{
+    memset(frame, 0, frame_size(capacity));
+
+    frame->capacity = capacity;
+    frame->size = frame_size(capacity);
+    frame->error_offset = frame_error_offset(capacity);
+}
+
+//  ===========================================================================
+//  Allocates an aligned array of empty frames, NULL on failure.
+//  ===========================================================================
+frame_t *frame_alloc(uint16_t capacity, uint32_t frames)
+{
+    frame_t *frame;
+    uint32_t i;
+
+    if (posix_memalign((void **)&frame, FRAME_ALIGN,
+                       frame_size(capacity) * frames) != 0)
+    {
+        printf("Error allocating frames.\n");
+        return NULL;
+    }
+
+    for (i = 0; i < frames; i++)
+        frame_init((frame_t *)((uint8_t *)frame + i * frame_size(capacity)),
+                   capacity);
+
+    return (frame);
+}
+
+//  ===========================================================================
+//  Returns frame index of an array from frame_alloc().
+//  ===========================================================================
+frame_t *frame_at(frame_t *frames, uint32_t index)
+{
+    return (frame_t *)((uint8_t *)frames + (size_t)index * frames->size);
+}
+
+//  ===========================================================================
+//  Fills frame from a scan. Returns -1 if it does not fit.
+//  ===========================================================================
+/*
+    Ranges below dist_min are flagged in the error bitmap. Unused ranges
+    up to the next multiple of 8 are zeroed so vector loops can run over
+    whole vectors.
+*/
+int frame_from_scan(frame_t *frame, uint8_t sensor, uint16_t dist_min,
+                    const scan_t *scan)
+{
+    uint16_t *range = FRAME_RANGE(frame);
+    uint64_t *error = FRAME_ERRORS(frame);
+    uint64_t  word;
+    int       errors;
+    int       words;
+    int       end;
+    int       i, j;
+
+    if (scan->count > frame->capacity) return -1;
+
+    frame->host_time = scan->host_time;
+    frame->time = scan->time;
+    frame->first = scan->first;
+    frame->cluster = scan->cluster;
+    frame->count = scan->count;
+    frame->sensor = sensor;
+
+    memcpy(range, scan->range, scan->count * sizeof(uint16_t));
+
+    end = (scan->count + 7) & ~7;
+    if (end > frame->capacity) end = frame->capacity;
+    for (i = scan->count; i < end; i++) range[i] = 0;
+
+    // One word of flags per 64 beams, no branches.
+    words = (frame->capacity + 63) / 64;
+    errors = 0;
+
+    for (i = 0; i < words; i++)
+    {
+        word = 0;
+        end = (i + 1) * 64 < scan->count ? (i + 1) * 64 : scan->count;
+
+        for (j = i * 64; j < end; j++)
+            word |= (uint64_t)(range[j] < dist_min) << (j & 63);
+
+        error[i] = word;
+        errors += __builtin_popcountll(word);
+    }
+
+    frame->errors = errors;
+
+    return 0;
+}
+
+//  ===========================================================================
+//  Copies frame back into a scan.
+//  ===========================================================================
+void frame_to_scan(const frame_t *frame, scan_t *scan)
+{
+    scan->host_time = frame->host_time;
+    scan->time = frame->time;
+    scan->first = frame->first;
+    scan->cluster = frame->cluster;
+    scan->count = frame->count;
+
+    memcpy(scan->range, FRAME_RANGE(frame), frame->count * sizeof(uint16_t));
+}
@@ -0,0 +1,95 @@
+//  ===========================================================================
+//  Compact scan frames for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+/*
+    A scan sized to the beams it holds, for stages and buffers that keep
+    many of them. scan_t always has room for SCAN_STEPS_MAX ranges.
+
+    Layout:
+
+    ,--------------------------------------------------------------,
+    | Header (64 bytes) | Ranges (uint16_t) | Error bitmap (uint64_t) |
+    '--------------------------------------------------------------'
+
+    The header fills exactly one cache line, so reading a frame's metadata
+    costs one line. The ranges start on the next line and are followed by
+    the bitmap on the next 8 byte boundary, and the whole frame is padded
+    to a multiple of 64 bytes so frames in an array stay aligned.
+
+    Ranges are kept as the sensor sent them. The URG-04LX reaches 5.6 m so
+    a valid range needs 13 bits; values below DMIN are error codes. Bit i
+    of the bitmap is set when beam i is an error code, so stages can skip
+    invalid beams a word at a time without comparing every range.
+
+    For the URG-04LX's 682 usable steps a frame is 1536 bytes against 2184
+    for scan_t, and with 2 step clusters 832 bytes. A UTM-30LX's 1081 steps
+    take 2368 bytes.
+*/
+
+//  ===========================================================================
+
+#ifndef URG_FRAME_H
+#define URG_FRAME_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "urg-multi.h"
+
+//  Defines. ------------------------------------------------------------------
+
+#define FRAME_ALIGN     64      // Cache line.
+#define FRAME_HEADER    64      // Header bytes, one cache line.
+
+/* Flags. */
+#define FRAME_KEY       0x01    // For users, e.g. delta key frames.
+
+/* Accessors. */
+#define FRAME_RANGE(f)  ((uint16_t *)((uint8_t *)(f) + FRAME_HEADER))
+#define FRAME_ERRORS(f) ((uint64_t *)((uint8_t *)(f) + (f)->error_offset))
+#define FRAME_ERROR(f, i) ((FRAME_ERRORS(f)[(i) >> 6] >> ((i) & 63)) & 1)
+
+//  Types. --------------------------------------------------------------------
+
+typedef struct
+{
+    uint64_t host_time;     // Host time at arrival (us, monotonic).
+    uint32_t time;          // Sensor timestamp (ms).
+    uint32_t seq;           // Frame number for the sensor.
+    uint32_t size;          // Frame bytes including header.
+    uint32_t error_offset;  // Bytes from frame to error bitmap.
+    uint16_t capacity;      // Ranges there is room for.
+    uint16_t first;         // First step.
+    uint16_t cluster;       // Steps per range.
+    uint16_t count;         // Number of ranges.
+    uint16_t errors;        // Ranges that are error codes.
+    uint8_t  sensor;
+    uint8_t  flags;
+    uint8_t  reserved[28];
+} __attribute__((aligned(FRAME_ALIGN))) frame_t;
+
+//  Functions. ----------------------------------------------------------------
+
+size_t frame_size(uint16_t capacity);
+void frame_init(frame_t *frame, uint16_t capacity);
+frame_t *frame_alloc(uint16_t capacity, uint32_t frames);
+frame_t *frame_at(frame_t *frames, uint32_t index);
+int frame_from_scan(frame_t *frame, uint8_t sensor, uint16_t dist_min,
+                    const scan_t *scan);
+void frame_to_scan(const frame_t *frame, scan_t *scan);
+
+#endif
@@ -0,0 +1,290 @@
+//  ===========================================================================
+//  Multi-sensor fusion for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+#include "urg-fusion.h"
+#include <stdio.h>	    // Standard Input/Output definitions.
+#include <stdlib.h>
+#include <string.h>	    // String function definitions.
+#include <stdint.h>	    // Standard type definitions.
+#include <stdbool.h>	// Boolean definitions.
+#include <math.h>       // Maths definitions.
+
+//  ===========================================================================
+//  Initialises fusion stage.
+//  ===========================================================================
+int fusion_init(fusion_t *fusion, int policy, uint32_t wait_time,
+                workers_t *workers, fusion_emit_t emit, void *arg)
+{
+    int i;
+
+    memset(fusion, 0, sizeof(fusion_t));
+
+    if (sync_init(&fusion->sync, policy, wait_time) < 0) return -1;
+
+    fusion->workers = workers;
+    fusion->emit = emit;
+    fusion->arg = arg;
+
+    pthread_mutex_init(&fusion->lock, NULL);
+
+    for (i = 0; i < FUSION_CLOUDS; i++)
+    {
+        fusion->free[i] = malloc(sizeof(cloud_t));
+        if (fusion->free[i] == NULL)
+        {
+            printf("Error allocating fusion clouds.\n");
+            fusion_free(fusion);
+            return -1;
+        }
+        fusion->free_count++;
+    }
+
+    return 0;
+}
+
+//  ===========================================================================
+//  Builds body frame beam directions for a frame layout.
+//  ===========================================================================
+static void fusion_directions(fusion_sensor_t *sensor, const scan_t *scan)
+{
+    const spec_t *spec = sensor->spec;
+    float angle;
+    int   i;
+
+    for (i = 0; i < scan->count; i++)
+    {
+        angle = ((scan->first + i * scan->cluster) - spec->step_front)
+              * 2.0f * M_PI / spec->ang_res + sensor->extrinsic.theta;
+        sensor->dir_x[i] = 0.001f * cosf(angle);
+        sensor->dir_y[i] = 0.001f * sinf(angle);
+    }
+
+    sensor->first = scan->first;
+    sensor->cluster = scan->cluster;
+    sensor->count = scan->count;
+}
+
+//  ===========================================================================
+//  Adds a sensor with its pose in the body frame, returns its id.
+//  ===========================================================================
+int fusion_add_sensor(fusion_t *fusion, const spec_t *spec,
+                      const pose_t *extrinsic, pool_t *pool)
+{
+    fusion_sensor_t *sensor;
+
+    if (fusion->running || fusion->sensors >= SENSORS_MAX) return -1;
+    if (sync_add_sensor(&fusion->sync, pool) != fusion->sensors) return -1;
+
+    sensor = &fusion->sensor[fusion->sensors];
+    sensor->active = true;
+    sensor->extrinsic = *extrinsic;
+    sensor->spec = spec;
+    sensor->pending = NULL;
+    sensor->count = 0;
+
+    return fusion->sensors++;
+}
+
+//  ===========================================================================
+//  Transforms one sensor's frame into its region of the cloud.
+//  ===========================================================================
+static void fusion_task(void *arg, int task)
+{
+    fusion_t        *fusion = arg;
+    fusion_sensor_t *sensor = &fusion->sensor[task];
+    cloud_t         *cloud = fusion->cloud;
+    const scan_t    *scan = sensor->pending;
+    uint32_t         n;
+    int              i;
+
+    sensor->points = 0;
+    if (scan == NULL) return;
+
+    if (scan->first != sensor->first || scan->cluster != sensor->cluster ||
+        scan->count != sensor->count)
+        fusion_directions(sensor, scan);
+
+    n = sensor->offset;
+
+    for (i = 0; i < scan->count; i++)
+    {
+        if (scan->range[i] < sensor->spec->dist_min) continue;
+
+        cloud->x[n] = sensor->extrinsic.x + scan->range[i] * sensor->dir_x[i];
+        cloud->y[n] = sensor->extrinsic.y + scan->range[i] * sensor->dir_y[i];
+        cloud->sensor[n] = task;
+        n++;
+    }
+
+    sensor->points = n - sensor->offset;
+}
+
+//  ===========================================================================
+//  Merges a group into a cloud.
+//  ===========================================================================
+static cloud_t *fusion_merge(fusion_t *fusion, sync_group_t *group)
+{
+    fusion_sensor_t *sensor;
+    cloud_t  *cloud = NULL;
+    uint32_t  offset;
+    uint32_t  count;
+    int       i;
+
+    pthread_mutex_lock(&fusion->lock);
+    if (fusion->free_count > 0) cloud = fusion->free[--fusion->free_count];
+    pthread_mutex_unlock(&fusion->lock);
+
+    if (cloud == NULL)
+    {
+        // Consumer is holding every cloud, so this group is lost.
+        sync_release(&fusion->sync, group);
+        fusion->dropped++;
+        return NULL;
+    }
+
+    fusion->cloud = cloud;
+
+    offset = 0;
+    for (i = 0; i < fusion->sensors; i++)
+    {
+        sensor = &fusion->sensor[i];
+        sensor->pending = group->scan[i];
+        sensor->offset = offset;
+        if (sensor->pending != NULL) offset += sensor->pending->count;
+    }
+
+    if (fusion->workers != NULL)
+        workers_run(fusion->workers, fusion_task, fusion, fusion->sensors);
+    else
+        for (i = 0; i < fusion->sensors; i++) fusion_task(fusion, i);
+
+    // Pack regions together.
+    count = 0;
+    for (i = 0; i < fusion->sensors; i++)
+    {
+        sensor = &fusion->sensor[i];
+        if (sensor->offset != count)
+        {
+            memmove(&cloud->x[count], &cloud->x[sensor->offset],
+                    sensor->points * sizeof(float));
+            memmove(&cloud->y[count], &cloud->y[sensor->offset],
+                    sensor->points * sizeof(float));
+            memmove(&cloud->sensor[count], &cloud->sensor[sensor->offset],
+                    sensor->points * sizeof(uint8_t));
+        }
+        count += sensor->points;
+        sensor->pending = NULL;
+    }
+
+    cloud->count = count;
+    cloud->host_time = group->host_time;
+    cloud->skew = group->skew;
+    cloud->sensors = group->mask;
+    sync_release(&fusion->sync, group);
+    fusion->cloud = NULL;
+    fusion->groups++;
+
+    return (cloud);
+}
+
+//  ===========================================================================
+//  Fusion thread. Merges and emits groups until stopped.
+//  ===========================================================================
+static void *fusion_thread(void *arg)
+{
+    fusion_t    *fusion = arg;
+    sync_group_t group;
+    cloud_t     *cloud;
+
+    for (;;)
+    {
+        if (sync_next(&fusion->sync, &group, 1000000) < 0)
+        {
+            if (atomic_load(&fusion->sync.stop)) break;
+            continue;
+        }
+
+        cloud = fusion_merge(fusion, &group);
+        if (cloud == NULL) continue;
+
+        if (fusion->emit != NULL)
+            fusion->emit(cloud, fusion->arg);
+        else
+            fusion_release(fusion, cloud);
+    }
+
+    return NULL;
+}
+
+//  ===========================================================================
+//  Starts the fusion thread once every sensor has been added.
+//  ===========================================================================
+int fusion_start(fusion_t *fusion)
+{
+    if (fusion->running) return 0;
+
+    if (pthread_create(&fusion->thread, NULL, fusion_thread, fusion) != 0)
+    {
+        printf("Error starting fusion thread.\n");
+        return -1;
+    }
+    fusion->running = true;
+
+    return 0;
+}
+
+//  ===========================================================================
+//  Takes ownership of a sensor frame. Sensor's thread, does not block.
+//  ===========================================================================
+int fusion_push(fusion_t *fusion, int id, scan_t *scan)
+{
+    if (id < 0 || id >= fusion->sensors) return -1;
+
+    return sync_push(&fusion->sync, id, scan);
+}
+
+//  ===========================================================================
+//  Returns an emitted cloud for reuse.
+//  ===========================================================================
+void fusion_release(fusion_t *fusion, cloud_t *cloud)
+{
+    pthread_mutex_lock(&fusion->lock);
+    fusion->free[fusion->free_count++] = cloud;
+    pthread_mutex_unlock(&fusion->lock);
+}
+
+//  ===========================================================================
+//  Stops and releases fusion stage. Sensors must have stopped pushing and
+//  emitted clouds must have been returned.
+//  ===========================================================================
+void fusion_free(fusion_t *fusion)
+{
+    if (fusion->running)
+    {
+        sync_stop(&fusion->sync);
+        pthread_join(fusion->thread, NULL);
+        fusion->running = false;
+    }
+
+    sync_free(&fusion->sync);
+    while (fusion->free_count > 0) free(fusion->free[--fusion->free_count]);
+
+    fusion->sensors = 0;
+
+    pthread_mutex_destroy(&fusion->lock);
+}
@@ -0,0 +1,125 @@
+//  ===========================================================================
+//  Multi-sensor fusion for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+/*
+    Merges scans from several sensors into one point cloud in the body
+    frame.
+
+    Grouping:
+
+    fusion_push() hands frames to a urg-sync.h synchroniser and returns
+    without waiting. A fusion thread takes each group under the chosen
+    policy and merges it, so with SYNC_WAIT a slow sensor delays a cloud
+    by at most the wait time and is left out of it. Add every sensor
+    before fusion_start() starts the thread.
+
+    Merging:
+
+    Each sensor's extrinsic pose is folded into a per-beam direction table
+    so transforming a scan is a multiply-add per beam. One task per sensor
+    runs on the worker threads, each writing its points to its own region
+    of the cloud, and the regions are then packed together.
+
+    The worker pool may be shared with stages on other threads, whose
+    batches then alternate with fusion's (see urg-workers.h).
+
+    Clouds come from a small preallocated set. The emit callback runs on
+    the fusion thread and owns the cloud until it calls fusion_release().
+    Frames are returned to their sensor's frame pool once merged or
+    dropped.
+*/
+
+//  ===========================================================================
+
+#ifndef URG_FUSION_H
+#define URG_FUSION_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "urg-multi.h"
+#include "urg-pool.h"
+#include "urg-workers.h"
+#include "urg-sync.h"
+
+//  Defines. ------------------------------------------------------------------
+
+#define FUSION_CLOUDS     4     // Preallocated merged clouds.
+#define FUSION_POINTS_MAX (SENSORS_MAX * SCAN_STEPS_MAX)
+
+//  Types. --------------------------------------------------------------------
+
+typedef struct
+{
+    uint64_t host_time;         // Latest frame time in the group (us).
+    uint32_t skew;              // Spread of frame times in the group (us).
+    uint32_t sensors;           // Sensors in the cloud, bit per id.
+    uint32_t count;             // Number of points.
+    float    x[FUSION_POINTS_MAX];      // Body frame (m).
+    float    y[FUSION_POINTS_MAX];
+    uint8_t  sensor[FUSION_POINTS_MAX]; // Source sensor.
+} cloud_t;
+
+/* Called with each merged cloud. */
+typedef void (*fusion_emit_t)(cloud_t *cloud, void *arg);
+
+typedef struct
+{
+    bool      active;
+    pose_t    extrinsic;        // Sensor pose in body frame.
+    const spec_t *spec;
+    scan_t   *pending;          // Frame being merged, NULL if none.
+    uint16_t  first;            // Layout of direction table.
+    uint16_t  cluster;
+    uint16_t  count;
+    float     dir_x[SCAN_STEPS_MAX];    // Beam direction in body frame.
+    float     dir_y[SCAN_STEPS_MAX];
+    uint32_t  offset;           // Region in cloud being merged.
+    uint32_t  points;           // Points written to region.
+} fusion_sensor_t;
+
+typedef struct
+{
+    fusion_sensor_t sensor[SENSORS_MAX];
+    int        sensors;         // Number of sensors added.
+    sync_t     sync;
+    pthread_t  thread;          // Takes and merges groups.
+    bool       running;
+    workers_t *workers;         // NULL to merge on the fusion thread.
+    cloud_t   *free[FUSION_CLOUDS];
+    int        free_count;
+    cloud_t   *cloud;           // Cloud being merged.
+    fusion_emit_t emit;
+    void      *arg;
+    uint32_t   groups;          // Clouds emitted.
+    uint32_t   dropped;         // Groups lost with every cloud held.
+    pthread_mutex_t lock;       // Free clouds.
+} fusion_t;
+
+//  Functions. ----------------------------------------------------------------
+
+int fusion_init(fusion_t *fusion, int policy, uint32_t wait_time,
+                workers_t *workers, fusion_emit_t emit, void *arg);
+int fusion_start(fusion_t *fusion);
+int fusion_add_sensor(fusion_t *fusion, const spec_t *spec,
+                      const pose_t *extrinsic, pool_t *pool);
+int fusion_push(fusion_t *fusion, int id, scan_t *scan);
+void fusion_release(fusion_t *fusion, cloud_t *cloud);
+void fusion_free(fusion_t *fusion);
+
+#endif
@@ -0,0 +1,312 @@
+//  ===========================================================================
+//  Occupancy grid for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+#include "urg-grid.h"
+#include <stdio.h>	    // Standard Input/Output definitions.
+#include <stdlib.h>
+#include <string.h>	    // String function definitions.
+#include <stdint.h>	    // Standard type definitions.
+#include <stdbool.h>	// Boolean definitions.
+#include <math.h>       // Maths definitions.
+
+//  Types. --------------------------------------------------------------------
+
+/* Shared arguments for one update. */
+typedef struct
+{
+    grid_t         *grid;
+    const points_t *points;
+    float           c, s;       // Sensor heading.
+    float           x, y;       // Sensor position in grid cells.
+    int             chunk;      // Beams per task.
+} grid_job_t;
+
+//  ===========================================================================
+//  Initialises grid covering width x height metres.
+//  ===========================================================================
+int grid_init(grid_t *grid, float width, float height, float resolution,
+              float origin_x, float origin_y, workers_t *workers)
+{
+    size_t tiles;
+
+    grid->resolution = resolution;
+    grid->origin_x = origin_x;
+    grid->origin_y = origin_y;
+    grid->tiles_x = (int)ceilf(width / resolution / GRID_TILE);
+    grid->tiles_y = (int)ceilf(height / resolution / GRID_TILE);
+    grid->width = grid->tiles_x * GRID_TILE;
+    grid->height = grid->tiles_y * GRID_TILE;
+    grid->hit = GRID_HIT;
+    grid->miss = GRID_MISS;
+    grid->min = GRID_MIN;
+    grid->max = GRID_MAX;
+    grid->workers = workers;
+
+    tiles = (size_t)grid->tiles_x * grid->tiles_y;
+    grid->cells = calloc(tiles * GRID_TILE_CELLS, sizeof(int16_t));
+    grid->dirty = calloc(tiles, sizeof(uint8_t));
+
+    if (grid->cells == NULL || grid->dirty == NULL)
+    {
+        printf("Error allocating grid.\n");
+        grid_free(grid);
+        return -1;
+    }
+
+    return 0;
+}
+
+//  ===========================================================================
+//  Returns address of cell in tile-major layout.
+//  ===========================================================================
+static inline int16_t *grid_cell(const grid_t *grid, int x, int y, int *tile)
+{
+    *tile = (y / GRID_TILE) * grid->tiles_x + x / GRID_TILE;
+
+    return &grid->cells[*tile * GRID_TILE_CELLS
+                        + (y % GRID_TILE) * GRID_TILE + x % GRID_TILE];
+}
+
+//  ===========================================================================
+//  Adds log-odds to a cell with clamping and marks its tile dirty.
+//  ===========================================================================
+static inline void grid_add(grid_t *grid, int x, int y, int16_t delta)
+{
+    int16_t *cell;
+    int16_t  old;
+    int16_t  val;
+    int      tile;
+
+    cell = grid_cell(grid, x, y, &tile);
+    old = __atomic_load_n(cell, __ATOMIC_RELAXED);
+
+    do
+    {
+        val = old + delta;
+        if (val < grid->min) val = grid->min;
+        if (val > grid->max) val = grid->max;
+        if (val == old) return;
+    }
+    while (!__atomic_compare_exchange_n(cell, &old, val, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    if (!grid->dirty[tile]) __atomic_store_n(&grid->dirty[tile], 1,
+                                             __ATOMIC_RELAXED);
+}
+
+//  ===========================================================================
+//  Clips a ray to the grid (Liang-Barsky), returns -1 if it misses it.
+//  ===========================================================================
+static int grid_clip(const grid_t *grid, int *x0, int *y0, int *x1, int *y1)
+{
+    double dx = *x1 - *x0;
+    double dy = *y1 - *y0;
+    double p[4] = {-dx, dx, -dy, dy};
+    double q[4] = {*x0, grid->width - 1 - *x0, *y0, grid->height - 1 - *y0};
+    double t0 = 0;
+    double t1 = 1;
+    double t;
+    int    x, y;
+    int    i;
+
+    for (i = 0; i < 4; i++)
+    {
+        if (p[i] == 0)
+        {
+            if (q[i] < 0) return -1;
+            continue;
+        }
+
+        t = q[i] / p[i];
+        if (p[i] < 0)
+        {
+            if (t > t1) return -1;
+            if (t > t0) t0 = t;
+        }
+        else
+        {
+            if (t < t0) return -1;
+            if (t < t1) t1 = t;
+        }
+    }
+
+    x = *x0;
+    y = *y0;
+    *x0 = lround(x + t0 * dx);
+    *y0 = lround(y + t0 * dy);
+    *x1 = lround(x + t1 * dx);
+    *y1 = lround(y + t1 * dy);
+
+    return 0;
+}
+
+//  ===========================================================================
+//  Traces a ray between two cells, clipped to the grid.
+//  ===========================================================================
+/*
+    The sensor may be outside the grid, so the ray is clipped first rather
+    than walked from the sensor cell. The end cell only gets the hit value
+    if the point itself is inside the grid.
+*/
+static void grid_trace(grid_t *grid, int x0, int y0, int x1, int y1)
+{
+    int  dx, dy;
+    int  sx, sy;
+    int  err, e2;
+    bool hit;
+
+    hit = x1 >= 0 && y1 >= 0 && x1 < grid->width && y1 < grid->height;
+    if (grid_clip(grid, &x0, &y0, &x1, &y1) < 0) return;
+
+    dx =  abs(x1 - x0);
+    dy = -abs(y1 - y0);
+    sx = (x0 < x1) ? 1 : -1;
+    sy = (y0 < y1) ? 1 : -1;
+    err = dx + dy;
+
+    while (x0 != x1 || y0 != y1)
+    {
+        grid_add(grid, x0, y0, grid->miss);
+
+        e2 = 2 * err;
+        if (e2 >= dy) { err += dy; x0 += sx; }
+        if (e2 <= dx) { err += dx; y0 += sy; }
+    }
+
+    grid_add(grid, x1, y1, hit ? grid->hit : grid->miss);
+}
+
+//  ===========================================================================
+//  Traces one chunk of beams.
+//  ===========================================================================
+static void grid_task(void *arg, int task)
+{
+    grid_job_t     *job = arg;
+    const points_t *points = job->points;
+    float           px, py;
+    int             x0, y0;
+    int             first, last;
+    int             i;
+
+    first = task * job->chunk;
+    last = first + job->chunk;
+    if (last > points->count) last = points->count;
+
+    x0 = (int)floorf(job->x);
+    y0 = (int)floorf(job->y);
+
+    for (i = first; i < last; i++)
+    {
+        if (isnan(points->x[i])) continue;
+
+        px = points->x[i] / job->grid->resolution;
+        py = points->y[i] / job->grid->resolution;
+
+        grid_trace(job->grid, x0, y0,
+                   (int)floorf(job->x + job->c * px - job->s * py),
+                   (int)floorf(job->y + job->s * px + job->c * py));
+    }
+}
+
+//  ===========================================================================
+//  Updates grid from points in the sensor frame at a world pose.
+//  ===========================================================================
+void grid_update(grid_t *grid, const points_t *points, const pose_t *pose)
+{
+    grid_job_t job;
+    int        tasks;
+
+    job.grid = grid;
+    job.points = points;
+    job.c = cosf(pose->theta);
+    job.s = sinf(pose->theta);
+    job.x = (pose->x - grid->origin_x) / grid->resolution;
+    job.y = (pose->y - grid->origin_y) / grid->resolution;
+    job.chunk = (points->count + GRID_TASKS - 1) / GRID_TASKS;
+    if (job.chunk == 0) return;
+    tasks = (points->count + job.chunk - 1) / job.chunk;
+
+    if (grid->workers != NULL)
+    {
+        workers_run(grid->workers, grid_task, &job, tasks);
+    }
+    else
+    {
+        for (int task = 0; task < tasks; task++) grid_task(&job, task);
+    }
+}
+
+//  ===========================================================================
+//  Returns log-odds (x100) of a cell, 0 outside the grid.
+//  ===========================================================================
+int16_t grid_get(const grid_t *grid, int x, int y)
+{
+    int tile;
+
+    if (x < 0 || y < 0 || x >= grid->width || y >= grid->height) return 0;
+
+    return *grid_cell(grid, x, y, &tile);
+}
+
+//  ===========================================================================
+//  Converts log-odds (x100) to occupancy probability.
+//  ===========================================================================
+float grid_prob(int16_t value)
+{
+    return 1.0f - 1.0f / (1.0f + expf(value * 0.01f));
+}
+
+//  ===========================================================================
+//  Returns cells of a tile, row-major within the tile.
+//  ===========================================================================
+const int16_t *grid_tile(const grid_t *grid, int tile)
+{
+    return &grid->cells[tile * GRID_TILE_CELLS];
+}
+
+//  ===========================================================================
+//  Returns tiles changed since the last call and clears their flags.
+//  ===========================================================================
+int grid_dirty(grid_t *grid, uint32_t *tiles, int max)
+{
+    int count;
+    int tile;
+
+    count = 0;
+
+    for (tile = 0; tile < grid->tiles_x * grid->tiles_y && count < max; tile++)
+    {
+        if (!grid->dirty[tile]) continue;
+        grid->dirty[tile] = 0;
+        tiles[count++] = tile;
+    }
+
+    return (count);
+}
+
+//  ===========================================================================
+//  Releases grid.
+//  ===========================================================================
+void grid_free(grid_t *grid)
+{
+    free(grid->cells);
+    free(grid->dirty);
+
+    grid->cells = NULL;
+    grid->dirty = NULL;
+}
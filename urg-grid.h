@@ -0,0 +1,94 @@
+//  ===========================================================================
+//  Occupancy grid for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+/*
+    Log-odds occupancy grid updated incrementally from scans.
+
+    Layout:
+
+    The grid is split into square tiles of GRID_TILE cells, each stored
+    contiguously, so a consumer can copy a changed tile in one go. Cells
+    hold log-odds in hundredths, clamped so that cells can change state
+    again after a while.
+
+    Updating:
+
+    Each valid point is traced from the sensor cell with integer Bresenham
+    steps. Cells passed through get the miss value added, the end cell gets
+    the hit value. Rays are clipped to the grid first, so a sensor outside
+    it still updates the cells its rays cross. Beams are split into tasks
+    across the worker threads. Rays from neighbouring beams share cells
+    near the sensor, so cells are updated with an atomic compare and swap.
+
+    Every tile touched is flagged dirty until the consumer collects the
+    list with grid_dirty().
+*/
+
+//  ===========================================================================
+
+#ifndef URG_GRID_H
+#define URG_GRID_H
+
+#include <stdint.h>
+#include "urg-multi.h"
+#include "urg-workers.h"
+
+//  Defines. ------------------------------------------------------------------
+
+#define GRID_TILE       32      // Cells along the side of a tile.
+#define GRID_TILE_CELLS (GRID_TILE * GRID_TILE)
+
+#define GRID_HIT        85      // Log-odds added for a hit (x100).
+#define GRID_MISS      -40      // Log-odds added for a miss (x100).
+#define GRID_MIN      -200      // Lower clamp (x100).
+#define GRID_MAX       350      // Upper clamp (x100).
+
+#define GRID_TASKS      16      // Beam chunks per update.
+
+//  Types. --------------------------------------------------------------------
+
+typedef struct
+{
+    float     resolution;       // Cell size (m).
+    float     origin_x;         // World position of cell (0, 0) corner (m).
+    float     origin_y;
+    int       width;            // Cells.
+    int       height;
+    int       tiles_x;          // Tiles.
+    int       tiles_y;
+    int16_t   hit;              // Log-odds model (x100).
+    int16_t   miss;
+    int16_t   min;
+    int16_t   max;
+    int16_t  *cells;            // Tile-major cells.
+    uint8_t  *dirty;            // Per-tile dirty flags.
+    workers_t *workers;         // NULL to update on the caller.
+} grid_t;
+
+//  Functions. ----------------------------------------------------------------
+
+int grid_init(grid_t *grid, float width, float height, float resolution,
+              float origin_x, float origin_y, workers_t *workers);
+void grid_update(grid_t *grid, const points_t *points, const pose_t *pose);
+int16_t grid_get(const grid_t *grid, int x, int y);
+float grid_prob(int16_t value);
+const int16_t *grid_tile(const grid_t *grid, int tile);
+int grid_dirty(grid_t *grid, uint32_t *tiles, int max);
+void grid_free(grid_t *grid);
+
+#endif
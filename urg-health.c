@@ -0,0 +1,242 @@
+//  ===========================================================================
+//  Health monitoring for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+#include "urg-health.h"
+#include <stdio.h>	    // Standard Input/Output definitions.
+#include <stdlib.h>
+#include <string.h>	    // String function definitions.
+#include <stdint.h>	    // Standard type definitions.
+
+static const char *health_names[HEALTH_EVENTS] =
+{
+    "laser", "motor", "status", "scan", "no reply", "stall",
+};
+
+//  ===========================================================================
+//  Returns name of event type.
+//  ===========================================================================
+const char *health_event_name(int type)
+{
+    if (type < 0 || type >= HEALTH_EVENTS) return "unknown";
+
+    return health_names[type];
+}
+
+//  ===========================================================================
+//  Raises an event.
+//  ===========================================================================
+static void health_raise(health_t *health, int type, int value, int expected,
+                         const char *text, int len)
+{
+    health_event_t event;
+
+    event.type = type;
+    event.sensor = health->sensor;
+    event.host_time = host_time();
+    event.value = value;
+    event.expected = expected;
+
+    if (len > HEALTH_TEXT_MAX - 1) len = HEALTH_TEXT_MAX - 1;
+    if (text) memcpy(event.text, text, len);
+    event.text[text ? len : 0] = STRING_NULL;
+
+    health->events[type]++;
+    if (health->on_event) health->on_event(&event, health->arg);
+}
+
+//  ===========================================================================
+//  Keeps a diagnostic line and raises an event if it changed.
+//  ===========================================================================
+static void health_text(health_t *health, char last[HEALTH_TEXT_MAX],
+                        const char *value, int len)
+{
+    if (len > HEALTH_TEXT_MAX - 1) len = HEALTH_TEXT_MAX - 1;
+    if (strncmp(last, value, len) == 0 && last[len] == STRING_NULL) return;
+
+    // The first poll only sets the baseline.
+    if (health->seen)
+        health_raise(health, HEALTH_STATUS, 0, 0, value, len);
+
+    memcpy(last, value, len);
+    last[len] = STRING_NULL;
+}
+
+//  ===========================================================================
+//  Checks reported motor speed against the timing model.
+//  ===========================================================================
+static void health_motor(health_t *health, const char *value, int len)
+{
+    const char *rpm;
+    int  expected = health->timing ? health->timing->rpm : 0;
+    bool ok;
+
+    // e.g. "Initial(600[rpm])", the speed is the number before "[rpm]".
+    rpm = memchr(value, '(', len);
+    if (rpm == NULL) return;
+    health->rpm = atoi(rpm + 1);
+    if (expected <= 0) return;
+
+    ok = abs(health->rpm - expected) <= expected * HEALTH_RPM_TOLERANCE;
+    if (ok != health->motor_ok)
+        health_raise(health, HEALTH_MOTOR, health->rpm, expected, NULL, 0);
+    health->motor_ok = ok;
+}
+
+//  ===========================================================================
+//  Handles an II reply.
+//  ===========================================================================
+/*
+    Lines after the echo and status are KEY:value;sum.
+*/
+static void health_reply(ctl_cmd_t *cmd, void *arg)
+{
+    health_t   *health = arg;
+    const char *line;
+    const char *end;
+    const char *value;
+    const char *sum;
+    int  laser = -1;
+
+    health->polling = false;
+
+    if (atomic_load(&cmd->state) != CTL_DONE ||
+        strcmp(cmd->status, "00") != 0)
+    {
+        if (!health->no_reply)
+            health_raise(health, HEALTH_NO_REPLY, 0, 0, cmd->status, 2);
+        health->no_reply = true;
+        return;
+    }
+
+    health->no_reply = false;
+    health->polls++;
+    health->bytes += cmd->reply_len + 2;
+
+    for (line = cmd->reply; line < cmd->reply + cmd->reply_len; line = end + 1)
+    {
+        end = memchr(line, STRING_LF, cmd->reply + cmd->reply_len - line);
+        if (end == NULL) end = cmd->reply + cmd->reply_len;
+
+        sum = end;
+        while (sum > line && *sum != ';') sum--;
+        if (end - line < 6 || line[4] != ':' || sum == line) continue;
+        value = line + 5;
+
+        if      (strncmp(line, "LASR", 4) == 0)
+            laser = (strncmp(value, "ON", 2) == 0);
+        else if (strncmp(line, "SCSP", 4) == 0)
+            health_motor(health, value, sum - value);
+        else if (strncmp(line, "STAT", 4) == 0)
+            health_text(health, health->stat, value, sum - value);
+        else if (strncmp(line, "MESM", 4) == 0)
+            health_text(health, health->mode, value, sum - value);
+    }
+
+    if (laser >= 0 && health->laser >= 0 && laser != health->laser)
+        health_raise(health, HEALTH_LASER, laser, health->laser, NULL, 0);
+    if (laser >= 0) health->laser = laser;
+    health->seen = true;
+}
+
+//  ===========================================================================
+//  Checks a stream reply that ctl could not match.
+//  ===========================================================================
+static void health_other(const char *reply, int len, void *arg)
+{
+    health_t   *health = arg;
+    const char *status;
+
+    // Only scan commands matter, e.g. "MD...\n0x" ends a stream.
+    if (len < 2 || (reply[0] != 'M' && reply[0] != 'G') ||
+        (reply[1] != 'D' && reply[1] != 'S'))
+        return;
+
+    status = memchr(reply, STRING_LF, len);
+    if (status == NULL || reply + len - status < 3) return;
+    status++;
+
+    if (strncmp(status, "00", 2) != 0 && strncmp(status, "99", 2) != 0)
+        health_raise(health, HEALTH_SCAN, 0, 0, status, 2);
+}
+
+//  ===========================================================================
+//  Starts monitoring a sensor controlled through ctl.
+//  ===========================================================================
+/*
+    timing gives the expected motor speed and scan period and may be NULL.
+    period is the II poll interval (us), 0 to only watch scans.
+*/
+void health_init(health_t *health, uint8_t sensor, ctl_t *ctl,
+                 const timing_t *timing, uint64_t period,
+                 health_fn_t on_event, void *arg)
+{
+    memset(health, 0, sizeof(health_t));
+
+    health->sensor = sensor;
+    health->ctl = ctl;
+    health->timing = timing;
+    health->period = period;
+    health->next = host_time();
+    health->on_event = on_event;
+    health->arg = arg;
+    health->laser = -1;
+    health->motor_ok = true;
+
+    ctl_set_other(ctl, health_other, health);
+}
+
+//  ===========================================================================
+//  Polls when due and checks for a stall. Loop thread, after ctl_run().
+//  ===========================================================================
+void health_run(health_t *health)
+{
+    uint64_t now = host_time();
+    uint64_t gap;
+
+    if (health->period && !health->polling && now >= health->next)
+    {
+        if (ctl_submit(health->ctl, &health->poll, CMD_GET_RUN_STATE,
+                       health_reply, health) == 0)
+            health->polling = true;
+
+        health->next += health->period;
+        if (health->next < now) health->next = now + health->period;
+    }
+
+    if (health->last_scan == 0 || health->stalled || !health->timing) return;
+
+    gap = now - health->last_scan;
+    if (gap > HEALTH_STALL_SCANS * health->timing->scan_time)
+    {
+        health->stalled = true;
+        health_raise(health, HEALTH_STALL, gap, health->timing->scan_time,
+                     NULL, 0);
+    }
+}
+
+//  ===========================================================================
+//  Checks a scan as it arrives. Loop thread.
+//  ===========================================================================
+void health_scan(health_t *health, const raw_t *raw)
+{
+    health->last_scan = raw->host_time;
+    health->stalled = false;
+
+    if (strcmp(raw->status, "99") != 0 && strcmp(raw->status, "00") != 0)
+        health_raise(health, HEALTH_SCAN, 0, 0, raw->status, 2);
+}
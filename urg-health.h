@@ -0,0 +1,133 @@
+//  ===========================================================================
+//  Health monitoring for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+/*
+    Watches a streaming sensor for faults, so they are reported when they
+    happen instead of being noticed when scans stop.
+
+    Sources:
+
+    II          Polled every period through urg-ctl.h, so it is answered
+                between scans and costs none. The reply is about 160 bytes
+                against about 2.1 kB per URG-04LX scan, so at the default
+                period and 10 scans a second it adds under 0.4% to the
+                link.
+    Scans       health_scan() checks each scan's status (99 when streaming)
+                and when it arrived, from the raw scan the parser already
+                has. Nothing is decoded.
+    Replies     A stream ending with an error status arrives as a reply to
+                nothing outstanding, which ctl passes on.
+
+    Events:
+
+    Events are raised on changes, not on every poll, and passed to the
+    callback on the loop thread:
+
+    HEALTH_LASER    LASR differs from the last poll. value is 1 for on.
+    HEALTH_MOTOR    SCSP speed differs from the timing model by more than
+                    HEALTH_RPM_TOLERANCE, or returns within it. value is the
+                    reported rpm, expected the timing model's.
+    HEALTH_STATUS   STAT or MESM text changed. text holds the new line.
+    HEALTH_SCAN     A scan or stream reply with an error status. text holds
+                    the status.
+    HEALTH_NO_REPLY An II poll got no reply. Raised once until one does.
+    HEALTH_STALL    No scan for HEALTH_STALL_SCANS scan periods. value is
+                    the gap (us). Raised once until scans resume.
+*/
+
+//  ===========================================================================
+
+#ifndef URG_HEALTH_H
+#define URG_HEALTH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "urg-multi.h"
+#include "urg-raw.h"
+#include "urg-ctl.h"
+
+//  Defines. ------------------------------------------------------------------
+
+#define HEALTH_PERIOD           2000000 // Default II poll interval (us).
+#define HEALTH_RPM_TOLERANCE    0.01f   // Fraction of expected speed.
+#define HEALTH_STALL_SCANS      5       // Missing scan periods for a stall.
+#define HEALTH_TEXT_MAX         64
+
+/* Event types. */
+#define HEALTH_LASER            0
+#define HEALTH_MOTOR            1
+#define HEALTH_STATUS           2
+#define HEALTH_SCAN             3
+#define HEALTH_NO_REPLY         4
+#define HEALTH_STALL            5
+#define HEALTH_EVENTS           6
+
+//  Types. --------------------------------------------------------------------
+
+typedef struct
+{
+    int      type;
+    uint8_t  sensor;
+    uint64_t host_time;                 // Host time raised (us).
+    int      value;
+    int      expected;
+    char     text[HEALTH_TEXT_MAX];
+} health_event_t;
+
+/* Called on the loop thread with each event. */
+typedef void (*health_fn_t)(const health_event_t *event, void *arg);
+
+typedef struct
+{
+    uint8_t  sensor;
+    ctl_t   *ctl;
+    const timing_t *timing;             // Expected motor speed.
+    uint64_t period;                    // Poll interval (us), 0 for none.
+    uint64_t next;                      // Host time of next poll.
+    ctl_cmd_t poll;
+    bool     polling;                   // poll submitted, not done.
+    health_fn_t on_event;
+    void    *arg;
+
+    // Last seen.
+    bool     seen;                      // A poll has been parsed.
+    int      laser;                     // -1 if not reported.
+    int      rpm;
+    bool     motor_ok;
+    char     stat[HEALTH_TEXT_MAX];
+    char     mode[HEALTH_TEXT_MAX];
+    uint64_t last_scan;                 // Host time (us), 0 before one.
+    bool     stalled;
+    bool     no_reply;
+
+    // Statistics.
+    uint32_t polls;
+    uint32_t events[HEALTH_EVENTS];
+    uint64_t bytes;                     // II reply bytes.
+} health_t;
+
+//  Functions. ----------------------------------------------------------------
+
+void health_init(health_t *health, uint8_t sensor, ctl_t *ctl,
+                 const timing_t *timing, uint64_t period,
+                 health_fn_t on_event, void *arg);
+void health_run(health_t *health);
+void health_scan(health_t *health, const raw_t *raw);
+const char *health_event_name(int type);
+
+#endif
@@ -0,0 +1,349 @@
+//  ===========================================================================
+//  Scan matching odometry for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+#include "urg-icp.h"
+#include <string.h>	    // String function definitions.
+#include <stdint.h>	    // Standard type definitions.
+#include <stdbool.h>	// Boolean definitions.
+#include <math.h>       // Maths definitions.
+
+//  ===========================================================================
+//  Returns a followed by b.
+//  ===========================================================================
+static pose_t pose_compose(pose_t a, pose_t b)
+{
+    pose_t p;
+    float  c = cosf(a.theta);
+    float  s = sinf(a.theta);
+
+    p.x = a.x + c * b.x - s * b.y;
+    p.y = a.y + s * b.x + c * b.y;
+    p.theta = remainderf(a.theta + b.theta, 2.0f * M_PI);
+
+    return (p);
+}
+
+//  ===========================================================================
+//  Returns inverse of a.
+//  ===========================================================================
+static pose_t pose_inverse(pose_t a)
+{
+    pose_t p;
+    float  c = cosf(a.theta);
+    float  s = sinf(a.theta);
+
+    p.x = -c * a.x - s * a.y;
+    p.y =  s * a.x - c * a.y;
+    p.theta = -a.theta;
+
+    return (p);
+}
+
+//  ===========================================================================
+//  Initialises scan matcher.
+//  ===========================================================================
+void icp_init(icp_t *icp, const spec_t *spec, workers_t *workers)
+{
+    memset(icp, 0, sizeof(icp_t));
+
+    icp->window = 5;
+    icp->max_dist = 0.3f;
+    icp->max_iter = 20;
+    icp->epsilon = 1e-4f;
+    icp->sigma = 0.01f;
+    icp->key_dist = 0.3f;
+    icp->key_angle = 0.2f;
+    icp->min_matches = 30;
+
+    icp->step_angle = 2.0f * M_PI / spec->ang_res;
+    icp->step_front = spec->step_front;
+    icp->workers = workers;
+}
+
+//  ===========================================================================
+//  Makes points the keyframe and computes surface normals.
+//  ===========================================================================
+static void icp_keyframe(icp_t *icp, const scan_t *scan,
+                         const points_t *points)
+{
+    const float max2 = 0.04f;   // Neighbours within 0.2 m.
+    float tx, ty;
+    float len;
+    int   i;
+
+    icp->key = *points;
+    icp->key_angle0 = (scan->first - icp->step_front) * icp->step_angle;
+    icp->key_step = scan->cluster * icp->step_angle;
+
+    for (i = 0; i < points->count; i++)
+    {
+        icp->key_nx[i] = NAN;
+        icp->key_ny[i] = NAN;
+
+        if (i == 0 || i == points->count - 1) continue;
+        if (isnan(points->x[i - 1]) || isnan(points->x[i + 1]) ||
+            isnan(points->x[i])) continue;
+
+        tx = points->x[i + 1] - points->x[i - 1];
+        ty = points->y[i + 1] - points->y[i - 1];
+        len = tx * tx + ty * ty;
+        if (len > 4.0f * max2 || len < 1e-8f) continue;
+
+        len = sqrtf(len);
+        icp->key_nx[i] = -ty / len;
+        icp->key_ny[i] =  tx / len;
+    }
+
+    icp->key_valid = true;
+}
+
+//  ===========================================================================
+//  Accumulates normal equations for one chunk of points.
+//  ===========================================================================
+static void icp_task(void *arg, int task)
+{
+    icp_t          *icp = arg;
+    const points_t *points = icp->points;
+    icp_sum_t      *sum = &icp->sum[task];
+    float c, s;
+    float px, py;
+    float dx, dy;
+    float d2, best;
+    float nx, ny;
+    float j2, r;
+    int   chunk;
+    int   first, last;
+    int   k, k0, k1;
+    int   best_k;
+    int   i;
+
+    memset(sum, 0, sizeof(icp_sum_t));
+
+    chunk = (points->count + ICP_TASKS - 1) / ICP_TASKS;
+    first = task * chunk;
+    last = first + chunk;
+    if (last > points->count) last = points->count;
+
+    c = cosf(icp->guess.theta);
+    s = sinf(icp->guess.theta);
+
+    for (i = first; i < last; i++)
+    {
+        if (isnan(points->x[i])) continue;
+
+        px = icp->guess.x + c * points->x[i] - s * points->y[i];
+        py = icp->guess.y + s * points->x[i] + c * points->y[i];
+
+        // Keyframe beam this point projects onto.
+        k = lroundf((atan2f(py, px) - icp->key_angle0) / icp->key_step);
+        k0 = (k - icp->window < 0) ? 0 : k - icp->window;
+        k1 = (k + icp->window >= icp->key.count) ? icp->key.count - 1
+                                                 : k + icp->window;
+
+        best = icp->max_dist * icp->max_dist;
+        best_k = -1;
+
+        for (k = k0; k <= k1; k++)
+        {
+            if (isnan(icp->key_nx[k])) continue;
+
+            dx = px - icp->key.x[k];
+            dy = py - icp->key.y[k];
+            d2 = dx * dx + dy * dy;
+            if (d2 < best)
+            {
+                best = d2;
+                best_k = k;
+            }
+        }
+
+        if (best_k < 0) continue;
+
+        nx = icp->key_nx[best_k];
+        ny = icp->key_ny[best_k];
+        r = nx * (px - icp->key.x[best_k]) + ny * (py - icp->key.y[best_k]);
+        j2 = ny * px - nx * py;
+
+        sum->h[0] += nx * nx;
+        sum->h[1] += nx * ny;
+        sum->h[2] += nx * j2;
+        sum->h[3] += ny * ny;
+        sum->h[4] += ny * j2;
+        sum->h[5] += j2 * j2;
+        sum->g[0] += nx * r;
+        sum->g[1] += ny * r;
+        sum->g[2] += j2 * r;
+        sum->error += r * r;
+        sum->matches++;
+    }
+}
+
+//  ===========================================================================
+//  Inverts symmetric 3x3 matrix given by upper triangle.
+//  ===========================================================================
+static int icp_invert(const double h[6], double inv[3][3])
+{
+    double a = h[0], b = h[1], c = h[2];
+    double d = h[3], e = h[4], f = h[5];
+    double det;
+
+    inv[0][0] = d * f - e * e;
+    inv[0][1] = c * e - b * f;
+    inv[0][2] = b * e - c * d;
+    inv[1][1] = a * f - c * c;
+    inv[1][2] = b * c - a * e;
+    inv[2][2] = a * d - b * b;
+
+    det = a * inv[0][0] + b * inv[0][1] + c * inv[0][2];
+    if (fabs(det) < 1e-12) return -1;
+
+    inv[0][0] /= det; inv[0][1] /= det; inv[0][2] /= det;
+    inv[1][1] /= det; inv[1][2] /= det; inv[2][2] /= det;
+    inv[1][0] = inv[0][1];
+    inv[2][0] = inv[0][2];
+    inv[2][1] = inv[1][2];
+
+    return 0;
+}
+
+//  ===========================================================================
+//  Restarts from the current scan after a failed match.
+//  ===========================================================================
+/*
+    The scan's pose is taken from the prediction, so the accumulated pose
+    carries on from it, and the velocity is forgotten.
+*/
+static void icp_rekey(icp_t *icp, const scan_t *scan, const points_t *points,
+                      pose_t predicted, icp_result_t *result)
+{
+    result->delta = pose_compose(pose_inverse(icp->estimate), predicted);
+    result->pose = pose_compose(icp->key_pose, predicted);
+
+    icp->key_pose = result->pose;
+    memset(&icp->estimate, 0, sizeof(pose_t));
+    memset(&icp->previous, 0, sizeof(pose_t));
+    icp_keyframe(icp, scan, points);
+}
+
+//  ===========================================================================
+//  Matches scan against keyframe, returns 0 on success.
+//  ===========================================================================
+/*
+    On failure the scan becomes the keyframe, result holds the predicted
+    pose and -1 is returned.
+*/
+int icp_match(icp_t *icp, const scan_t *scan, const points_t *points,
+              icp_result_t *result)
+{
+    icp_sum_t total;
+    double    inv[3][3];
+    pose_t    step;
+    pose_t    velocity;
+    pose_t    predicted;
+    pose_t    estimate;
+    float     c, s;
+    int       iter;
+    int       i, j;
+
+    memset(result, 0, sizeof(icp_result_t));
+
+    if (!icp->key_valid)
+    {
+        icp_keyframe(icp, scan, points);
+        memset(&icp->estimate, 0, sizeof(pose_t));
+        memset(&icp->previous, 0, sizeof(pose_t));
+        memset(&icp->key_pose, 0, sizeof(pose_t));
+        return 0;
+    }
+
+    // Start from a constant velocity prediction.
+    velocity = pose_compose(pose_inverse(icp->previous), icp->estimate);
+    predicted = pose_compose(icp->estimate, velocity);
+    icp->guess = predicted;
+    icp->points = points;
+    memset(&total, 0, sizeof(icp_sum_t));
+
+    if (icp->max_iter < 1) return -1;
+
+    for (iter = 0; iter < icp->max_iter; iter++)
+    {
+        if (icp->workers != NULL)
+            workers_run(icp->workers, icp_task, icp, ICP_TASKS);
+        else
+            for (i = 0; i < ICP_TASKS; i++) icp_task(icp, i);
+
+        memset(&total, 0, sizeof(icp_sum_t));
+        for (i = 0; i < ICP_TASKS; i++)
+        {
+            for (j = 0; j < 6; j++) total.h[j] += icp->sum[i].h[j];
+            for (j = 0; j < 3; j++) total.g[j] += icp->sum[i].g[j];
+            total.error += icp->sum[i].error;
+            total.matches += icp->sum[i].matches;
+        }
+
+        if (total.matches < icp->min_matches || icp_invert(total.h, inv) < 0)
+        {
+            icp_rekey(icp, scan, points, predicted, result);
+            return -1;
+        }
+
+        // Solve H d = -g and apply d on the left of the estimate.
+        step.x = -(inv[0][0] * total.g[0] + inv[0][1] * total.g[1]
+                 + inv[0][2] * total.g[2]);
+        step.y = -(inv[1][0] * total.g[0] + inv[1][1] * total.g[1]
+                 + inv[1][2] * total.g[2]);
+        step.theta = -(inv[2][0] * total.g[0] + inv[2][1] * total.g[1]
+                     + inv[2][2] * total.g[2]);
+
+        c = cosf(step.theta);
+        s = sinf(step.theta);
+        estimate.x = step.x + c * icp->guess.x - s * icp->guess.y;
+        estimate.y = step.y + s * icp->guess.x + c * icp->guess.y;
+        estimate.theta = icp->guess.theta + step.theta;
+        icp->guess = estimate;
+
+        if (fabsf(step.x) < icp->epsilon && fabsf(step.y) < icp->epsilon &&
+            fabsf(step.theta) < icp->epsilon) break;
+    }
+
+    for (i = 0; i < 3; i++)
+        for (j = 0; j < 3; j++)
+            result->cov[i][j] = icp->sigma * icp->sigma * inv[i][j];
+
+    result->matches = total.matches;
+    result->iterations = (iter < icp->max_iter) ? iter + 1 : iter;
+    result->error = sqrtf(total.error / total.matches);
+    result->delta = pose_compose(pose_inverse(icp->estimate), icp->guess);
+    result->pose = pose_compose(icp->key_pose, icp->guess);
+
+    icp->previous = icp->estimate;
+    icp->estimate = icp->guess;
+
+    // Replace keyframe once far enough from it.
+    if (hypotf(icp->estimate.x, icp->estimate.y) > icp->key_dist ||
+        fabsf(icp->estimate.theta) > icp->key_angle)
+    {
+        icp->key_pose = result->pose;
+        icp->previous = pose_compose(pose_inverse(icp->estimate),
+                                     icp->previous);
+        memset(&icp->estimate, 0, sizeof(pose_t));
+        icp_keyframe(icp, scan, points);
+    }
+
+    return 0;
+}
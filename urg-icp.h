@@ -0,0 +1,124 @@
+//  ===========================================================================
+//  Scan matching odometry for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+/*
+    Estimates sensor motion by aligning each scan to a keyframe scan with
+    point-to-line ICP.
+
+    Correspondences:
+
+    The keyframe is an ordered scan, so instead of a tree search each new
+    point is transformed by the current estimate and its bearing gives the
+    keyframe beam it projects onto. The nearest keyframe point within a few
+    beams either side is taken, along with the normal of the surface there
+    (from its neighbours). Pairs further apart than max_dist are rejected.
+
+    Solving:
+
+    Each pair contributes n.(R p + t - q) to a linearised least squares
+    problem in (tx, ty, theta). Points are split into tasks across the
+    worker threads, each summing its own normal equations, which are then
+    added together and solved. This repeats until the update is small.
+
+    The covariance is sigma^2 times the inverse of the normal matrix.
+
+    Keyframes:
+
+    The keyframe is replaced by the current scan once the estimate moves
+    further than key_dist or turns more than key_angle from it, which keeps
+    drift down while the platform is slow or stationary.
+
+    A failed match (too few pairs or a singular normal matrix) makes the
+    current scan the keyframe at the predicted pose, so odometry picks up
+    again from the next scan instead of matching against a stale keyframe.
+*/
+
+//  ===========================================================================
+
+#ifndef URG_ICP_H
+#define URG_ICP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "urg-multi.h"
+#include "urg-workers.h"
+
+//  Defines. ------------------------------------------------------------------
+
+#define ICP_TASKS 8         // Point chunks per iteration.
+
+//  Types. --------------------------------------------------------------------
+
+typedef struct
+{
+    pose_t delta;           // Motion since previous scan.
+    pose_t pose;            // Accumulated pose since start.
+    float  cov[3][3];       // Covariance of match (x, y, theta).
+    int    matches;         // Correspondences used.
+    int    iterations;
+    float  error;           // RMS point to line distance (m).
+} icp_result_t;
+
+typedef struct
+{
+    double h[6];            // Upper triangle of normal matrix.
+    double g[3];            // Right hand side.
+    double error;           // Sum of squared residuals.
+    int    matches;
+} icp_sum_t;
+
+typedef struct
+{
+    // Settings.
+    int    window;          // Beams searched either side of projection.
+    float  max_dist;        // Max correspondence distance (m).
+    int    max_iter;
+    float  epsilon;         // Convergence threshold (m or radians).
+    float  sigma;           // Point noise for covariance (m).
+    float  key_dist;        // Keyframe distance (m).
+    float  key_angle;       // Keyframe angle (radians).
+    int    min_matches;     // Fewer matches is a failed match.
+
+    // Keyframe.
+    bool     key_valid;
+    points_t key;
+    float    key_nx[SCAN_STEPS_MAX];    // Surface normals, NAN if none.
+    float    key_ny[SCAN_STEPS_MAX];
+    float    key_angle0;    // Bearing of first keyframe beam.
+    float    key_step;      // Bearing between keyframe beams.
+    pose_t   key_pose;      // Keyframe pose since start.
+
+    pose_t   estimate;      // Current scan relative to keyframe.
+    pose_t   previous;      // Previous scan relative to keyframe.
+    float    step_angle;    // Radians per step.
+    int      step_front;
+
+    // Current iteration.
+    workers_t      *workers;
+    const points_t *points;
+    pose_t          guess;
+    icp_sum_t       sum[ICP_TASKS];
+} icp_t;
+
+//  Functions. ----------------------------------------------------------------
+
+void icp_init(icp_t *icp, const spec_t *spec, workers_t *workers);
+int icp_match(icp_t *icp, const scan_t *scan, const points_t *points,
+              icp_result_t *result);
+
+#endif
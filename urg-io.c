@@ -0,0 +1,267 @@
+//  ===========================================================================
+//  Serial reader backends for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+#include "urg-io.h"
+#include <unistd.h>	    // UNIX standard function definitions.
+#include <stdio.h>	    // Standard Input/Output definitions.
+#include <stdlib.h>
+#include <string.h>	    // String function definitions.
+#include <stdint.h>	    // Standard type definitions.
+#include <errno.h>      // Error numbers.
+#include <fcntl.h>	    // File control definitions.
+#include <sys/epoll.h>  // Event polling.
+
+//  Epoll backend. ------------------------------------------------------------
+
+typedef struct
+{
+    int  fd;
+    char buffer[IO_BUFFER_SIZE];
+} epoll_priv_t;
+
+//  ===========================================================================
+//  Creates epoll instance.
+//  ===========================================================================
+static int epoll_init(io_t *io)
+{
+    epoll_priv_t *priv;
+
+    priv = malloc(sizeof(epoll_priv_t));
+    if (priv == NULL) return -1;
+
+    priv->fd = epoll_create1(EPOLL_CLOEXEC);
+    if (priv->fd < 0)
+    {
+        perror("epoll_create1");
+        free(priv);
+        return -1;
+    }
+
+    io->priv = priv;
+
+    return 0;
+}
+
+//  ===========================================================================
+//  Watches port for input.
+//  ===========================================================================
+static int epoll_add(io_t *io, int index)
+{
+    epoll_priv_t *priv = io->priv;
+    struct epoll_event ev;
+    int flags;
+
+    flags = fcntl(io->fd[index], F_GETFL);
+    if (flags < 0 || fcntl(io->fd[index], F_SETFL, flags | O_NONBLOCK) < 0)
+    {
+        perror("Set port non-blocking");
+        return -1;
+    }
+
+    ev.events = EPOLLIN;
+    ev.data.u32 = index;
+
+    if (epoll_ctl(priv->fd, EPOLL_CTL_ADD, io->fd[index], &ev) < 0)
+    {
+        perror("epoll_ctl");
+        return -1;
+    }
+
+    return 0;
+}
+
+//  ===========================================================================
+//  Waits for input and reads once from each ready port.
+//  ===========================================================================
+/*
+    Level triggered, so a port with more than one buffer waiting is simply
+    reported again by the next epoll_wait() instead of being read until
+    EAGAIN, which would cost an extra read() per port every time.
+*/
+static int epoll_poll(io_t *io, int timeout_ms)
+{
+    epoll_priv_t *priv = io->priv;
+    struct epoll_event ev[IO_SOURCES_MAX];
+    int index;
+    int count;
+    int len;
+    int i;
+
+    count = epoll_wait(priv->fd, ev, IO_SOURCES_MAX, timeout_ms);
+    io->syscalls++;
+
+    if (count < 0) return (errno == EINTR) ? 0 : -1;
+
+    for (i = 0; i < count; i++)
+    {
+        index = ev[i].data.u32;
+
+        len = read(io->fd[index], priv->buffer, IO_BUFFER_SIZE);
+        io->syscalls++;
+
+        if (len > 0)
+        {
+            io_data(io, index, priv->buffer, len);
+        }
+        else if (len == 0 || (errno != EAGAIN && errno != EINTR))
+        {
+            epoll_ctl(priv->fd, EPOLL_CTL_DEL, io->fd[index], NULL);
+            io_drop(io, index);
+        }
+    }
+
+    return (count);
+}
+
+//  ===========================================================================
+//  Frees epoll instance.
+//  ===========================================================================
+static void epoll_free(io_t *io)
+{
+    epoll_priv_t *priv = io->priv;
+
+    close(priv->fd);
+    free(priv);
+}
+
+const io_ops_t io_epoll_ops =
+{
+    .name = "epoll",
+    .init = epoll_init,
+    .add  = epoll_add,
+    .poll = epoll_poll,
+    .free = epoll_free,
+};
+
+//  Common. -------------------------------------------------------------------
+
+//  ===========================================================================
+//  Initialises reader with the chosen backend.
+//  ===========================================================================
+int io_init(io_t *io, int backend)
+{
+    memset(io, 0, sizeof(io_t));
+
+    switch (backend)
+    {
+    case IO_EPOLL: io->ops = &io_epoll_ops; break;
+    case IO_URING: io->ops = &io_uring_ops; break;
+    default:
+        printf("Unknown reader backend %d.\n", backend);
+        return -1;
+    }
+
+    if (io->ops->init(io) < 0)
+    {
+        io->ops = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+//  ===========================================================================
+//  Adds a port. Returns its index.
+//  ===========================================================================
+int io_add(io_t *io, int fd, parser_t *parser)
+{
+    int index = io->count;
+
+    if (index >= IO_SOURCES_MAX)
+    {
+        printf("Too many ports.\n");
+        return -1;
+    }
+
+    io->fd[index] = fd;
+    io->parser[index] = parser;
+
+    if (io->ops->add(io, index) < 0) return -1;
+
+    io->open[index] = true;
+    io->count++;
+
+    return (index);
+}
+
+//  ===========================================================================
+//  Adds a descriptor read for a handler. Returns its index.
+//  ===========================================================================
+int io_watch(io_t *io, int fd, io_handler_t handler, void *arg)
+{
+    int index = io->count;
+
+    if (index >= IO_SOURCES_MAX)
+    {
+        printf("Too many ports.\n");
+        return -1;
+    }
+
+    io->handler[index] = handler;
+    io->handler_arg[index] = arg;
+
+    return io_add(io, fd, NULL);
+}
+
+//  ===========================================================================
+//  Waits up to timeout_ms (-1 forever) for input and parses it.
+//  ===========================================================================
+/*
+    Returns the number of reads handled, 0 on timeout or -1 on error.
+    Scans are delivered through the parsers' callbacks before it returns.
+*/
+int io_poll(io_t *io, int timeout_ms)
+{
+    return io->ops->poll(io, timeout_ms);
+}
+
+//  ===========================================================================
+//  Passes data read from a port to its parser or handler. Used by backends.
+//  ===========================================================================
+void io_data(io_t *io, int index, const char *data, int len)
+{
+    io->reads++;
+    io->bytes += len;
+
+    if (io->handler[index])
+        io->handler[index](data, len, io->handler_arg[index]);
+    else
+        parser_feed(io->parser[index], data, len);
+}
+
+//  ===========================================================================
+//  Marks a port as closed after end of file or an error. Used by backends.
+//  ===========================================================================
+void io_drop(io_t *io, int index)
+{
+    if (!io->open[index]) return;
+
+    io->open[index] = false;
+    io->closed++;
+    if (io->parser[index]) parser_reset(io->parser[index]);
+}
+
+//  ===========================================================================
+//  Frees backend. Ports are left open for the caller to close.
+//  ===========================================================================
+void io_free(io_t *io)
+{
+    if (io->ops) io->ops->free(io);
+    io->ops = NULL;
+    io->priv = NULL;
+}
@@ -0,0 +1,111 @@
+//  ===========================================================================
+//  Serial reader backends for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+/*
+    Reads many sensor ports from one thread and feeds whatever arrives to
+    each port's parser (urg-parser.h), which calls back with whole scans.
+
+    Backends:
+
+    IO_EPOLL    epoll_wait() for ready ports, then one read() per ready
+                port. Costs one syscall per wakeup plus one per port with
+                data.
+    IO_URING    A read is kept outstanding on every port into a registered
+                buffer. Each io_poll() is a single io_uring_enter() that
+                both submits the reads re-armed since the last call and
+                waits for completions, so the syscall count no longer grows
+                with the number of ports. Needs Linux 5.11 or later.
+
+    Both backends share io_add() and io_poll() so the caller picks one at
+    io_init() and nothing else changes. io_init() fails for IO_URING if the
+    kernel does not support it, and the caller can fall back to IO_EPOLL.
+
+    io_watch() adds any other readable descriptor, e.g. an eventfd used to
+    wake the loop, with a handler called with whatever is read from it.
+
+    A port that reports end of file or an error is dropped and counted in
+    closed. Ports are added in blocking or non-blocking mode as the backend
+    needs, so they should not be read elsewhere.
+*/
+
+//  ===========================================================================
+
+#ifndef URG_IO_H
+#define URG_IO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "urg-parser.h"
+
+//  Defines. ------------------------------------------------------------------
+
+#define IO_SOURCES_MAX      64      // Ports per reader.
+#define IO_BUFFER_SIZE      4096    // Read size per port.
+
+/* Backends. */
+#define IO_EPOLL            0
+#define IO_URING            1
+
+//  Types. --------------------------------------------------------------------
+
+typedef struct io_s io_t;
+
+/* Called with data read from a descriptor added with io_watch(). */
+typedef void (*io_handler_t)(const char *data, int len, void *arg);
+
+typedef struct
+{
+    const char *name;
+    int  (*init)(io_t *io);
+    int  (*add)(io_t *io, int index);
+    int  (*poll)(io_t *io, int timeout_ms);
+    void (*free)(io_t *io);
+} io_ops_t;
+
+struct io_s
+{
+    const io_ops_t *ops;
+    void    *priv;                      // Backend state.
+    int      count;                     // Ports added.
+    int      fd[IO_SOURCES_MAX];
+    parser_t *parser[IO_SOURCES_MAX];  // NULL for watched descriptors.
+    io_handler_t handler[IO_SOURCES_MAX];
+    void    *handler_arg[IO_SOURCES_MAX];
+    bool     open[IO_SOURCES_MAX];
+
+    // Statistics.
+    uint64_t syscalls;                  // Made by io_poll().
+    uint64_t reads;                     // Reads that returned data.
+    uint64_t bytes;
+    uint32_t closed;                    // Ports dropped.
+};
+
+extern const io_ops_t io_epoll_ops;
+extern const io_ops_t io_uring_ops;
+
+//  Functions. ----------------------------------------------------------------
+
+int io_init(io_t *io, int backend);
+int io_add(io_t *io, int fd, parser_t *parser);
+int io_watch(io_t *io, int fd, io_handler_t handler, void *arg);
+int io_poll(io_t *io, int timeout_ms);
+void io_data(io_t *io, int index, const char *data, int len);
+void io_drop(io_t *io, int index);
+void io_free(io_t *io);
+
+#endif
@@ -0,0 +1,281 @@
+//  ===========================================================================
+//  Line segment extraction for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+#include "urg-lines.h"
+#include <stdint.h>	    // Standard type definitions.
+#include <stdbool.h>	// Boolean definitions.
+#include <math.h>       // Maths definitions.
+
+//  ===========================================================================
+//  Initialises line extractor.
+//  ===========================================================================
+void lines_init(lines_t *lines, float split_dist, float max_gap, float sigma,
+                uint16_t min_points, float min_length)
+{
+    lines->split_dist = split_dist;
+    lines->max_gap = max_gap;
+    lines->sigma = sigma;
+    lines->min_points = (min_points < 2) ? 2 : min_points;
+    lines->min_length = min_length;
+    lines->count = 0;
+}
+
+//  ===========================================================================
+//  Returns index of point furthest from chord, distance in *dist.
+//  ===========================================================================
+static int lines_furthest(const points_t *points, int first, int last,
+                          float *dist)
+{
+    float dx, dy;
+    float len;
+    float d;
+    int   max_i;
+    int   i;
+
+    dx = points->x[last] - points->x[first];
+    dy = points->y[last] - points->y[first];
+    len = sqrtf(dx * dx + dy * dy);
+    if (len < 1e-6f) len = 1e-6f;
+
+    *dist = 0;
+    max_i = first;
+
+    for (i = first + 1; i < last; i++)
+    {
+        d = fabsf(dx * (points->y[i] - points->y[first])
+                - dy * (points->x[i] - points->x[first]));
+        if (d > *dist)
+        {
+            *dist = d;
+            max_i = i;
+        }
+    }
+
+    *dist /= len;
+
+    return (max_i);
+}
+
+//  ===========================================================================
+//  Fits line to points first..last, returns max point distance.
+//  ===========================================================================
+static float lines_fit(const lines_t *lines, const points_t *points,
+                       int first, int last, segment_t *seg)
+{
+    float xc, yc;
+    float sxx, syy, sxy;
+    float dx, dy;
+    float c, s;
+    float n;
+    float d;
+    float dist;
+    float spread;
+    float m;
+    float var;
+    int   i;
+
+    n = last - first + 1;
+    xc = yc = 0;
+    for (i = first; i <= last; i++)
+    {
+        xc += points->x[i];
+        yc += points->y[i];
+    }
+    xc /= n;
+    yc /= n;
+
+    sxx = syy = sxy = 0;
+    for (i = first; i <= last; i++)
+    {
+        dx = points->x[i] - xc;
+        dy = points->y[i] - yc;
+        sxx += dx * dx;
+        syy += dy * dy;
+        sxy += dx * dy;
+    }
+
+    // Normal is the minor axis of the scatter.
+    seg->alpha = 0.5f * atan2f(-2.0f * sxy, syy - sxx);
+    c = cosf(seg->alpha);
+    s = sinf(seg->alpha);
+    seg->r = xc * c + yc * s;
+    if (seg->r < 0)
+    {
+        seg->r = -seg->r;
+        seg->alpha += (seg->alpha < 0) ? M_PI : -M_PI;
+        c = -c;
+        s = -s;
+    }
+
+    // Project end points onto line.
+    d = points->x[first] * c + points->y[first] * s - seg->r;
+    seg->x1 = points->x[first] - d * c;
+    seg->y1 = points->y[first] - d * s;
+    d = points->x[last] * c + points->y[last] * s - seg->r;
+    seg->x2 = points->x[last] - d * c;
+    seg->y2 = points->y[last] - d * s;
+
+    seg->first = first;
+    seg->last = last;
+
+    // Covariance from spread along the line.
+    spread = sxx * s * s + syy * c * c - 2.0f * sxy * s * c;
+    if (spread < 1e-9f) spread = 1e-9f;
+    m = -xc * s + yc * c;
+    var = lines->sigma * lines->sigma;
+
+    seg->cov[0] = var / spread;
+    seg->cov[1] = m * seg->cov[0];
+    seg->cov[2] = var / n + m * m * seg->cov[0];
+
+    dist = 0;
+    for (i = first; i <= last; i++)
+    {
+        d = fabsf(points->x[i] * c + points->y[i] * s - seg->r);
+        if (d > dist) dist = d;
+    }
+
+    return (dist);
+}
+
+//  ===========================================================================
+//  Splits run first..last into pieces, returns new piece count.
+//  ===========================================================================
+static int lines_split(lines_t *lines, const points_t *points,
+                       int first, int last, int pieces)
+{
+    float dist;
+    int   top;
+    int   mid;
+
+    top = 0;
+    lines->stack[top++] = first;
+    lines->stack[top++] = last;
+
+    // Take the right half last so pieces come out in scan order.
+    while (top > 0)
+    {
+        last = lines->stack[--top];
+        first = lines->stack[--top];
+
+        mid = lines_furthest(points, first, last, &dist);
+
+        if (dist > lines->split_dist && mid > first && mid < last)
+        {
+            lines->stack[top++] = mid;
+            lines->stack[top++] = last;
+            lines->stack[top++] = first;
+            lines->stack[top++] = mid;
+        }
+        else
+        {
+            lines->piece[pieces++] = first;
+            lines->piece[pieces++] = last;
+        }
+    }
+
+    return (pieces);
+}
+
+//  ===========================================================================
+//  Extracts line segments, returns number found.
+//  ===========================================================================
+int lines_extract(lines_t *lines, const points_t *points)
+{
+    segment_t merged;
+    segment_t *seg;
+    float dx, dy;
+    float gap2;
+    int   pieces;
+    int   first;
+    int   i, j;
+
+    gap2 = lines->max_gap * lines->max_gap;
+    pieces = 0;
+    first = -1;
+
+    // Break into runs of valid, closely spaced points and split each.
+    for (i = 0; i <= points->count; i++)
+    {
+        bool end = (i == points->count) || isnan(points->x[i]);
+
+        if (!end && first >= 0)
+        {
+            dx = points->x[i] - points->x[i - 1];
+            dy = points->y[i] - points->y[i - 1];
+            if (dx * dx + dy * dy > gap2)
+            {
+                if (i - first >= lines->min_points)
+                    pieces = lines_split(lines, points, first, i - 1, pieces);
+                first = i;
+                continue;
+            }
+        }
+
+        if (end)
+        {
+            if (first >= 0 && i - first >= lines->min_points)
+                pieces = lines_split(lines, points, first, i - 1, pieces);
+            first = -1;
+        }
+        else if (first < 0)
+        {
+            first = i;
+        }
+    }
+
+    // Fit pieces and merge with previous segment where collinear.
+    lines->count = 0;
+
+    for (j = 0; j < pieces; j += 2)
+    {
+        seg = &lines->segment[lines->count];
+
+        // Pieces of one run share an end point, runs never do.
+        if (lines->count > 0 &&
+            seg[-1].last == lines->piece[j] &&
+            lines_fit(lines, points, seg[-1].first, lines->piece[j + 1],
+                      &merged) <= lines->split_dist)
+        {
+            seg[-1] = merged;
+            continue;
+        }
+
+        if (lines->count == LINES_MAX) break;
+
+        lines_fit(lines, points, lines->piece[j], lines->piece[j + 1], seg);
+        lines->count++;
+    }
+
+    // Drop short segments.
+    for (i = j = 0; i < lines->count; i++)
+    {
+        seg = &lines->segment[i];
+        dx = seg->x2 - seg->x1;
+        dy = seg->y2 - seg->y1;
+
+        if (seg->last - seg->first + 1 < lines->min_points ||
+            dx * dx + dy * dy < lines->min_length * lines->min_length)
+            continue;
+
+        lines->segment[j++] = *seg;
+    }
+    lines->count = j;
+
+    return (lines->count);
+}
@@ -0,0 +1,99 @@
+//  ===========================================================================
+//  Line segment extraction for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+/*
+    Split-and-merge line extraction on the ordered points of a scan.
+
+    Split:
+
+    Points are first broken into runs at invalid points and at gaps wider
+    than max_gap. Each run is split at the point furthest from the chord
+    between its ends until every point is within split_dist of its chord.
+
+    Fit:
+
+    Each piece is fitted by total least squares to the line
+    x cos(alpha) + y sin(alpha) = r, with r >= 0. With isotropic point
+    noise sigma the covariance of (alpha, r) is approximately
+
+    var(alpha)    = sigma^2 / S
+    cov(alpha, r) = m var(alpha)
+    var(r)        = sigma^2 / n + m^2 var(alpha)
+
+    where S is the spread of the points along the line and m is the
+    position of their centroid along it.
+
+    Merge:
+
+    Neighbouring segments split from the same run are refitted together
+    and merged if every point is within split_dist of the combined line.
+    Segments either side of a gap are never merged, so collinear walls
+    either side of a doorway stay apart.
+
+    All scratch space lives in lines_t so extraction does not allocate.
+*/
+
+//  ===========================================================================
+
+#ifndef URG_LINES_H
+#define URG_LINES_H
+
+#include <stdint.h>
+#include "urg-multi.h"
+
+//  Defines. ------------------------------------------------------------------
+
+/*
+    Split pieces share their end points, so a run of n points can give up
+    to n - 1 segments.
+*/
+#define LINES_MAX SCAN_STEPS_MAX        // Max segments per scan.
+
+//  Types. --------------------------------------------------------------------
+
+typedef struct
+{
+    float    x1, y1;            // End points projected onto line (m).
+    float    x2, y2;
+    float    alpha;             // Normal angle (radians).
+    float    r;                 // Distance from origin (m).
+    float    cov[3];            // var(alpha), cov(alpha, r), var(r).
+    uint16_t first;             // First point index.
+    uint16_t last;              // Last point index.
+} segment_t;
+
+typedef struct
+{
+    float     split_dist;       // Max point to line distance (m).
+    float     max_gap;          // Max gap between neighbours (m).
+    float     sigma;            // Range noise for covariance (m).
+    uint16_t  min_points;       // Min points in a segment.
+    float     min_length;       // Min segment length (m).
+    int       count;            // Segments found.
+    segment_t segment[LINES_MAX];
+    uint16_t  stack[2 * SCAN_STEPS_MAX + 4];    // Split scratch.
+    uint16_t  piece[2 * SCAN_STEPS_MAX];        // Pieces after split.
+} lines_t;
+
+//  Functions. ----------------------------------------------------------------
+
+void lines_init(lines_t *lines, float split_dist, float max_gap, float sigma,
+                uint16_t min_points, float min_length);
+int lines_extract(lines_t *lines, const points_t *points);
+
+#endif
@@ -0,0 +1,154 @@
+//  ===========================================================================
+//  Model specific kernels for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+#include "urg-model.h"
+#include <stdint.h>	    // Standard type definitions.
+#include <math.h>       // Maths definitions.
+#include <pthread.h>    // Threads, for one time table set up.
+
+/* Decodes one 3 or 2 character range. */
+#define DECODE3(p) \
+    ((((p)[0] - 0x30) << 12) | (((p)[1] - 0x30) << 6) | ((p)[2] - 0x30))
+#define DECODE2(p) \
+    ((((p)[0] - 0x30) << 6) | ((p)[1] - 0x30))
+
+/*
+    Generates name_decode() and name_to_points() for a full 3 character
+    scan of a model with cluster 1. The sine and cosine of each step are
+    worked out the same way as scan_to_points() does, on first use.
+*/
+#define MODEL_KERNELS(name, ares, amin, amax, afrt)                         \
+                                                                            \
+static float name##_cos[(amax) - (amin) + 1];                               \
+static float name##_sin[(amax) - (amin) + 1];                               \
+static pthread_once_t name##_once = PTHREAD_ONCE_INIT;                      \
+                                                                            \
+static void name##_table(void)                                              \
+{                                                                           \
+    float step_angle = 2.0f * M_PI / (ares);                                \
+    float angle;                                                            \
+    int   i;                                                                \
+                                                                            \
+    for (i = 0; i < (amax) - (amin) + 1; i++)                               \
+    {                                                                       \
+        angle = ((amin) + i - (afrt)) * step_angle;                         \
+        name##_cos[i] = cosf(angle);                                        \
+        name##_sin[i] = sinf(angle);                                        \
+    }                                                                       \
+}                                                                           \
+                                                                            \
+static void name##_decode(const char *data, uint16_t *range)                \
+{                                                                           \
+    const uint8_t *p = (const uint8_t *)data;                               \
+    int i;                                                                  \
+                                                                            \
+    for (i = 0; i < (amax) - (amin) + 1; i++, p += 3)                       \
+        range[i] = DECODE3(p);                                              \
+}                                                                           \
+                                                                            \
+static void name##_to_points(const uint16_t *range, int dist_min,           \
+                             float *x, float *y)                            \
+{                                                                           \
+    float r;                                                                \
+    int   i;                                                                \
+                                                                            \
+    pthread_once(&name##_once, name##_table);                               \
+                                                                            \
+    for (i = 0; i < (amax) - (amin) + 1; i++)                               \
+    {                                                                       \
+        r = range[i] * 0.001f;                                              \
+        x[i] = (range[i] < dist_min) ? NAN : r * name##_cos[i];             \
+        y[i] = (range[i] < dist_min) ? NAN : r * name##_sin[i];             \
+    }                                                                       \
+}
+
+MODEL_KERNELS(urg04lx, 1024, 44, 725, 384)
+MODEL_KERNELS(utm30lx, 1440, 0, 1080, 540)
+
+/* Known models. */
+static const model_t models[] =
+{
+    { "URG-04LX", 1024, 44, 725, 384, urg04lx_decode, urg04lx_to_points },
+    { "UTM-30LX/UST", 1440, 0, 1080, 540, utm30lx_decode, utm30lx_to_points },
+};
+
+#define MODELS (int)(sizeof(models) / sizeof(models[0]))
+
+//  ===========================================================================
+//  Returns the known model with the given geometry or NULL.
+//  ===========================================================================
+const model_t *model_find(const spec_t *spec)
+{
+    int i;
+
+    for (i = 0; i < MODELS; i++)
+        if (models[i].ang_res == spec->ang_res &&
+            models[i].step_min == spec->step_min &&
+            models[i].step_max == spec->step_max &&
+            models[i].step_front == spec->step_front)
+            return &models[i];
+
+    return NULL;
+}
+
+//  ===========================================================================
+//  Decodes count ranges of enc characters.
+//  ===========================================================================
+void model_decode(const char *data, int enc, int count, uint16_t *range)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    int i;
+
+    if (enc == 2)
+    {
+        for (i = 0; i < count; i++, p += 2) range[i] = DECODE2(p);
+        return;
+    }
+
+    // Full scans of a known model have a kernel.
+    for (i = 0; i < MODELS; i++)
+    {
+        if (count == models[i].step_max - models[i].step_min + 1)
+        {
+            models[i].decode(data, range);
+            return;
+        }
+    }
+
+    for (i = 0; i < count; i++, p += 3) range[i] = DECODE3(p);
+}
+
+//  ===========================================================================
+//  Converts a full scan of a known model to points. -1 if not.
+//  ===========================================================================
+int model_to_points(const spec_t *spec, const scan_t *scan, points_t *points)
+{
+    const model_t *model;
+
+    if (scan->first != spec->step_min || scan->cluster != 1 ||
+        scan->count != spec->step_max - spec->step_min + 1)
+        return -1;
+
+    model = model_find(spec);
+    if (model == NULL) return -1;
+
+    model->to_points(scan->range, spec->dist_min, points->x, points->y);
+    points->count = scan->count;
+
+    return 0;
+}
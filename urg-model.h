@@ -0,0 +1,69 @@
+//  ===========================================================================
+//  Model specific kernels for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+/*
+    The driver takes its geometry from the PP reply, so any SCIP 2.0 sensor
+    with up to SCAN_STEPS_MAX steps works with the generic code. Decoding
+    and conversion to points are paid on every scan though, so for models
+    in use they are also generated with the model's step count and angles
+    as constants. The loops then have a fixed trip count and need no
+    remainder handling, and the compiler unrolls and vectorises them.
+
+    Models are recognised by geometry, not by name, since firmware names
+    vary:
+
+    Model               ARES  AMIN  AMAX  AFRT  Steps
+    URG-04LX(-UG01)     1024    44   725   384    682
+    UTM-30LX, UST-xxLX  1440     0  1080   540   1081
+
+    model_decode() decodes any payload and uses a kernel when the count is
+    a full scan of a known model. model_to_points() converts a full scan
+    with cluster 1 and returns -1 for anything else, which scan_to_points()
+    then converts generically. Adding a model is one MODEL_KERNELS() line
+    and one table entry in urg-model.c.
+*/
+
+//  ===========================================================================
+
+#ifndef URG_MODEL_H
+#define URG_MODEL_H
+
+#include <stdint.h>
+#include "urg-multi.h"
+
+//  Types. --------------------------------------------------------------------
+
+typedef struct
+{
+    const char *name;
+    int  ang_res;           // ARES.
+    int  step_min;          // AMIN.
+    int  step_max;          // AMAX.
+    int  step_front;        // AFRT.
+    void (*decode)(const char *data, uint16_t *range);
+    void (*to_points)(const uint16_t *range, int dist_min, float *x, float *y);
+} model_t;
+
+//  Functions. ----------------------------------------------------------------
+
+const model_t *model_find(const spec_t *spec);
+void model_decode(const char *data, int enc, int count, uint16_t *range);
+int model_to_points(const spec_t *spec, const scan_t *scan,
+                    points_t *points);
+
+#endif
@@ -17,6 +17,7 @@
 //  ===========================================================================
 
 #include "urg-multi.h"
+#include "urg-model.h"
 #include <unistd.h>	    // UNIX standard function definitions.
 #include <stdio.h>	    // Standard Input/Output definitions.
 #include <stdlib.h>
@@ -25,6 +26,11 @@
 #include <fcntl.h>	    // File control definitions.
 #include <stdbool.h>	// Boolean definitions.
 #include <termios.h>	// POSIX terminal control definitions.
+#include <time.h>       // Clock definitions.
+#include <math.h>       // Maths definitions.
+
+//  Array of sensors.
+sensor_t *sensor[SENSORS_MAX];
 
 //  Commands ------------------------------------------------------------------
 
@@ -158,6 +164,9 @@ char get_data_sum(char *data)
 //  ===========================================================================
 //  Returns data block from sensor.
 //  ===========================================================================
+/*
+    Characters past DATA_BLOCK_LEN - 1 are read and dropped.
+*/
 int get_data(serial_t *serial, char data[DATA_BLOCK_LEN])
 {
     char c;
@@ -167,13 +176,34 @@ int get_data(serial_t *serial, char data[DATA_BLOCK_LEN])
 
     while (read(serial->fd, &c, 1) > 0 && (c != STRING_LF))
     {
-        data[i++] = c;
+        if (i < DATA_BLOCK_LEN - 1) data[i++] = c;
     }
+    data[i] = STRING_NULL;
 
     return (i-1);
 
 }
 
+//  ===========================================================================
+//  Reads a version line into a version_t field.
+//  ===========================================================================
+/*
+    Fields are allocated to fit, since lengths differ between models.
+*/
+static int get_version_line(sensor_t *sensor, char **field)
+{
+    int err;
+
+    err = get_data(&sensor->serial, sensor->info->data);
+    if (err < 0) return (err);
+
+    free(*field);
+    *field = strdup(sensor->info->data);
+    if (*field == NULL) return (-1);
+
+    return (err);
+}
+
 //  ===========================================================================
 //  Returns version information in version_t.
 //  ===========================================================================
@@ -211,31 +241,436 @@ int get_version(sensor_t *sensor, char string[16])
     if (err < 0 ) return (err);
     err = get_data(&sensor->serial, str_ret); // String echo.
     if (err < 0 ) return (err);
-    err = get_data(&sensor->serial, sensor->version.vendor);
+    err = get_version_line(sensor, &sensor->info->version.vendor);
     if (err < 0 ) return (err);
-    printf("\tVendor   = %s.\n", sensor->version.vendor);
-    err = get_data(&sensor->serial, sensor->version.product);
+    printf("\tVendor   = %s.\n", sensor->info->version.vendor);
+    err = get_version_line(sensor, &sensor->info->version.product);
     if (err < 0 ) return (err);
-    printf("\tProduct  = %s.\n", sensor->version.product);
-    err = get_data(&sensor->serial, sensor->version.firmware);
+    printf("\tProduct  = %s.\n", sensor->info->version.product);
+    err = get_version_line(sensor, &sensor->info->version.firmware);
     if (err < 0 ) return (err);
-    printf("\tFirmware = %s.\n", sensor->version.firmware);
-    err = get_data(&sensor->serial, sensor->version.protocol);
+    printf("\tFirmware = %s.\n", sensor->info->version.firmware);
+    err = get_version_line(sensor, &sensor->info->version.protocol);
     if (err < 0 ) return (err);
-    printf("\tProtocol = %s.\n", sensor->version.protocol);
-    err = get_data(&sensor->serial, sensor->version.serial);
+    printf("\tProtocol = %s.\n", sensor->info->version.protocol);
+    err = get_version_line(sensor, &sensor->info->version.serial);
     if (err < 0 ) return (err);
-    printf("\tSerial   = %s.\n", sensor->version.serial);
+    printf("\tSerial   = %s.\n", sensor->info->version.serial);
     printf("\n");
 
     return 0;
 }
 
 //  ===========================================================================
-//  Initialises sensor instance.
+//  Returns sensor specification in spec_t.
+//  ===========================================================================
+int get_spec(sensor_t *sensor)
+{
+    char cmd[DATA_CMD_LEN + DATA_STRING_LEN];
+    char line[DATA_BLOCK_LEN];
+    char *value;
+    char *end;
+    char *payload;
+    const model_t *model;
+    int  size;
+    int  err;
+    int  i;
+
+    strcpy(cmd, CMD_GET_SPEC);
+    strcat(cmd, LF);
+
+    if (DEBUG) PRINT_CMD(CMD_GET_SPEC);
+
+    serial_flush(&sensor->serial);
+    err = write(sensor->serial.fd, cmd, strlen(cmd));
+
+    if (err < 0)
+    {
+        printf("Error writing command.\n");
+        perror("Write to port");
+        return (err);
+    }
+
+    usleep( 100000 );
+
+    err = get_data(&sensor->serial, line); // Command echo.
+    if (err < 0 ) return (err);
+    err = get_data(&sensor->serial, line); // Status.
+    if (err < 0 ) return (err);
+
+    /*
+        Each line is of the form KEY:value;sum so the value sits between
+        the colon and the last semicolon.
+    */
+    for (i = 0; i < 8; i++)
+    {
+        err = get_data(&sensor->serial, line);
+        if (err < 0 ) return (err);
+
+        value = strchr(line, ':');
+        end = strrchr(line, ';');
+        if (value == NULL || end == NULL || end < value) return (-1);
+        *end = STRING_NULL;
+        value++;
+
+        if      (strncmp(line, "MODL", 4) == 0)
+        {
+            strncpy(sensor->spec.model, value, sizeof(sensor->spec.model));
+            sensor->spec.model[sizeof(sensor->spec.model) - 1] = STRING_NULL;
+        }
+        else if (strncmp(line, "DMIN", 4) == 0)
+            sensor->spec.dist_min = atoi(value);
+        else if (strncmp(line, "DMAX", 4) == 0)
+            sensor->spec.dist_max = atoi(value);
+        else if (strncmp(line, "ARES", 4) == 0)
+            sensor->spec.ang_res = atoi(value);
+        else if (strncmp(line, "AMIN", 4) == 0)
+            sensor->spec.step_min = atoi(value);
+        else if (strncmp(line, "AMAX", 4) == 0)
+            sensor->spec.step_max = atoi(value);
+        else if (strncmp(line, "AFRT", 4) == 0)
+            sensor->spec.step_front = atoi(value);
+        else if (strncmp(line, "SCAN", 4) == 0)
+            sensor->spec.scan_rpm = atoi(value);
+    }
+
+    if (sensor->spec.ang_res <= 0 || sensor->spec.scan_rpm <= 0) return (-1);
+
+    if (SPEC_STEPS(&sensor->spec) < 1 ||
+        SPEC_STEPS(&sensor->spec) > SCAN_STEPS_MAX)
+    {
+        printf("Unsupported steps %d-%d.\n", sensor->spec.step_min,
+                                             sensor->spec.step_max);
+        return (-1);
+    }
+
+    // Room for a full scan at the widest encoding.
+    size = SPEC_STEPS(&sensor->spec) * SCAN_ENC_LEN;
+    payload = realloc(sensor->info->payload, size);
+    if (payload == NULL) return (-1);
+    sensor->info->payload = payload;
+    sensor->info->payload_size = size;
+
+    set_timing(&sensor->timing, &sensor->spec, sensor->spec.scan_rpm);
+
+    if (DEBUG)
+    {
+        printf("\tModel    = %s.\n", sensor->spec.model);
+        printf("\tRange    = %d-%d mm.\n", sensor->spec.dist_min,
+                                           sensor->spec.dist_max);
+        printf("\tSteps    = %d-%d of %d, front %d.\n", sensor->spec.step_min,
+                                                        sensor->spec.step_max,
+                                                        sensor->spec.ang_res,
+                                                        sensor->spec.step_front);
+        printf("\tSpeed    = %d rpm.\n", sensor->spec.scan_rpm);
+        model = model_find(&sensor->spec);
+        printf("\tKernels  = %s.\n", model ? model->name : "generic");
+        printf("\n");
+    }
+
+    return 0;
+}
+
+//  ===========================================================================
+//  Sets timing model for a given motor speed.
+//  ===========================================================================
+void set_timing(timing_t *timing, const spec_t *spec, int rpm)
+{
+    timing->rpm = rpm;
+    timing->scan_time = 60.0e6f / rpm;
+    timing->step_time = timing->scan_time / spec->ang_res;
+}
+
+//  ===========================================================================
+//  Decodes a 2, 3 or 4 character encoded value.
+//  ===========================================================================
+uint32_t decode(const char *data, int len)
+{
+    uint32_t val;
+    int      i;
+
+    val = 0;
+
+    for (i = 0; i < len; i++)
+    {
+        val <<= 6;
+        val |= (data[i] - 0x30) & 0x3f;
+    }
+
+    return (val);
+}
+
+//  ===========================================================================
+//  Encodes a value in 2, 3 or 4 characters.
+//  ===========================================================================
+void encode(uint32_t val, char *data, int len)
+{
+    int i;
+
+    for (i = len - 1; i >= 0; i--)
+    {
+        data[i] = (val & 0x3f) + 0x30;
+        val >>= 6;
+    }
+}
+
+//  ===========================================================================
+//  Returns monotonic host time (us).
+//  ===========================================================================
+uint64_t host_time(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+//  ===========================================================================
+//  Sets motor speed level and updates timing model from the actual speed.
+//  ===========================================================================
+int set_motor_speed(sensor_t *sensor, int level)
+{
+    char cmd[DATA_CMD_LEN + DATA_STRING_LEN];
+    char line[DATA_BLOCK_LEN];
+    int  err;
+    int  rpm;
+
+    if ((level < MOTOR_DEFAULT || level > MOTOR_MAX) && level != MOTOR_RESET)
+        return (-1);
+
+    sprintf(cmd, "%s%02d%s", CMD_SET_MOTOR_SPEED, level, LF);
+
+    if (DEBUG) PRINT_CMD(CMD_SET_MOTOR_SPEED);
+
+    serial_flush(&sensor->serial);
+    err = write(sensor->serial.fd, cmd, strlen(cmd));
+
+    if (err < 0)
+    {
+        printf("Error writing command.\n");
+        perror("Write to port");
+        return (err);
+    }
+
+    usleep( 100000 );
+
+    err = get_data(&sensor->serial, line); // Command echo.
+    if (err < 0 ) return (err);
+    err = get_data(&sensor->serial, line); // Status.
+    if (err < 0 ) return (err);
+
+    // 03 means the motor is already at the requested speed.
+    if (strncmp(line, "00", DATA_STATUS_LEN) != 0 &&
+        strncmp(line, "03", DATA_STATUS_LEN) != 0)
+    {
+        printf("Motor speed status %s.\n", line);
+        return (-1);
+    }
+    get_data(&sensor->serial, line); // Terminating LF.
+
+    sensor->acq.motor = (level == MOTOR_RESET) ? MOTOR_DEFAULT : level;
+
+    // Motor takes a while to settle, so read back the speed it reports.
+    usleep( 500000 );
+    rpm = get_motor_speed(sensor);
+    if (rpm <= 0) return (-1);
+
+    set_timing(&sensor->timing, &sensor->spec, rpm);
+
+    return (rpm);
+}
+
+//  ===========================================================================
+//  Returns motor speed (rpm) reported by II.
+//  ===========================================================================
+int get_motor_speed(sensor_t *sensor)
+{
+    char cmd[DATA_CMD_LEN + DATA_STRING_LEN];
+    char line[DATA_BLOCK_LEN];
+    char *rpm;
+    int  err;
+    int  ret;
+
+    strcpy(cmd, CMD_GET_RUN_STATE);
+    strcat(cmd, LF);
+
+    if (DEBUG) PRINT_CMD(CMD_GET_RUN_STATE);
+
+    serial_flush(&sensor->serial);
+    err = write(sensor->serial.fd, cmd, strlen(cmd));
+
+    if (err < 0)
+    {
+        printf("Error writing command.\n");
+        perror("Write to port");
+        return (err);
+    }
+
+    usleep( 100000 );
+
+    err = get_data(&sensor->serial, line); // Command echo.
+    if (err < 0 ) return (err);
+    err = get_data(&sensor->serial, line); // Status.
+    if (err < 0 ) return (err);
+
+    /*
+        The speed line looks like SCSP:600[rpm];sum, or with a qualifier
+        such as SCSP:Initial(600[rpm]);sum, so look back from [rpm].
+    */
+    ret = -1;
+
+    while (get_data(&sensor->serial, line) >= 0)
+    {
+        if (strncmp(line, "SCSP", 4) != 0) continue;
+
+        rpm = strstr(line, "[rpm]");
+        if (rpm == NULL) continue;
+
+        while (rpm > line && rpm[-1] >= '0' && rpm[-1] <= '9') rpm--;
+        ret = atoi(rpm);
+    }
+
+    return (ret);
+}
+
+//  ===========================================================================
+//  Returns a single scan of all valid steps in scan_t.
+//  ===========================================================================
+int get_scan(sensor_t *sensor, scan_t *scan)
+{
+    char cmd[DATA_CMD_LEN + DATA_STRING_LEN];
+    char line[DATA_BLOCK_LEN];
+    char sum;
+    int  len;
+    int  err;
+
+    /*
+        Encoded data is split into lines of up to 64 characters plus a sum,
+        and a range can be split across lines, so the payload is buffered
+        before decoding. The buffer is sized from the spec.
+    */
+    char *payload = sensor->info->payload;
+    int  size;
+    int  enc;
+
+    if (payload == NULL) return (-1);
+
+    enc = sensor->acq.encoding;
+
+    sprintf(cmd, "%s%04d%04d%02d%s",
+            (enc == 2) ? CMD_GET_DATA_SING2 : CMD_GET_DATA_SING3,
+            sensor->spec.step_min, sensor->spec.step_max,
+            sensor->acq.cluster, LF);
+
+    if (DEBUG) PRINT_CMD(cmd);
+
+    serial_flush(&sensor->serial);
+    err = write(sensor->serial.fd, cmd, strlen(cmd));
+
+    if (err < 0)
+    {
+        printf("Error writing command.\n");
+        perror("Write to port");
+        return (err);
+    }
+
+    usleep( 100000 );
+
+    err = get_data(&sensor->serial, line); // Command echo.
+    if (err < 0 ) return (err);
+    err = get_data(&sensor->serial, line); // Status.
+    if (err < 0 ) return (err);
+    if (strncmp(line, "00", DATA_STATUS_LEN) != 0)
+    {
+        printf("Scan status %s.\n", line);
+        return (-1);
+    }
+
+    err = get_data(&sensor->serial, line); // Timestamp.
+    if (err < SCAN_TIME_LEN) return (-1);
+    scan->time = decode(line, SCAN_TIME_LEN);
+
+    size = 0;
+
+    while ((len = get_data(&sensor->serial, line) + 1) > 0)
+    {
+        // Check and strip sum.
+        sum = line[len - 1];
+        line[len - 1] = STRING_NULL;
+        if (get_data_sum(line) != sum)
+        {
+            printf("Scan checksum error.\n");
+            return (-1);
+        }
+        len--;
+
+        // The buffer has room for 3 characters a step, so with 2 it would
+        // hold more ranges than scan_t does.
+        if (size + len > sensor->info->payload_size ||
+            size + len > SPEC_STEPS(&sensor->spec) * enc) return (-1);
+        memcpy(&payload[size], line, len);
+        size += len;
+    }
+
+    scan->host_time = host_time();
+    scan->first = sensor->spec.step_min;
+    scan->cluster = sensor->acq.cluster;
+    scan->count = size / enc;
+
+    model_decode(payload, enc, scan->count, scan->range);
+
+    return (scan->count);
+}
+
+//  ===========================================================================
+//  Converts scan ranges to Cartesian points in the sensor frame.
+//  ===========================================================================
+void scan_to_points(const spec_t *spec, const scan_t *scan, points_t *points)
+{
+    float step_angle;
+    float angle;
+    float r;
+    int   i;
+
+    // Full scans of known models have a kernel.
+    if (model_to_points(spec, scan, points) == 0) return;
+
+    step_angle = 2.0f * M_PI / spec->ang_res;
+
+    for (i = 0; i < scan->count; i++)
+    {
+        angle = ((scan->first + i * scan->cluster) - spec->step_front)
+              * step_angle;
+        r = scan->range[i] * 0.001f;
+
+        if (scan->range[i] < spec->dist_min)
+        {
+            points->x[i] = NAN;
+            points->y[i] = NAN;
+        }
+        else
+        {
+            points->x[i] = r * cosf(angle);
+            points->y[i] = r * sinf(angle);
+        }
+    }
+
+    points->count = scan->count;
+}
+
+//  ===========================================================================
+//  Initialises sensor instance on the default port.
 //  ===========================================================================
 int sensor_init(void)
-//int sensor_init(sensor_t *sensor)
+{
+    return sensor_open(USB_PORT);
+}
+
+//  ===========================================================================
+//  Initialises sensor instance on a port.
+//  ===========================================================================
+int sensor_open(const char *device)
 {
 /*
     Use this to allocate resources to each sensor instance.
@@ -271,13 +706,17 @@ int sensor_init(void)
 
     if (id < 0) return -1;      // Didn't initialise!
 
-    // Allocate memory for sensor struct.
-    sensor_temp = malloc(sizeof(sensor));
+    // Allocate memory for sensor struct, cache aligned, and its cold data.
+    if (posix_memalign((void **)&sensor_temp, 64, sizeof(sensor_t)) != 0)
+        return -1;
 
-    // Return if unable to allocate memory.
-    if (sensor_temp == NULL) return -1;
+    sensor_temp->info = calloc(1, sizeof(sensor_info_t));
+    if (sensor_temp->info == NULL)
+    {
+        free(sensor_temp);
+        return -1;
+    }
 
-    const char *device = "/dev/ttyACM0"; // Serial port (assumed same for all).
     long baud = BIT_RATE_0;              // Initial baud setting.
 
     // Not needed because not running anything on 1st init only!
@@ -286,10 +725,13 @@ int sensor_init(void)
         init = true;
     }
 
-    // Need to open next available USB /edv/ttyACMx port here.
+    // The caller names the port, sensor_init() uses USB_PORT.
 
     // Create the instance.
     sensor_temp->id = id;
+    sensor_temp->acq.encoding = SCAN_ENC_LEN;
+    sensor_temp->acq.cluster = 1;
+    sensor_temp->acq.motor = MOTOR_DEFAULT;
 
     // Allocate a port - not sure if this stays the same for multiple sensors.
 
@@ -307,12 +749,25 @@ int sensor_init(void)
         return -1;
     }
 
+    err = get_spec(sensor_temp);
+    if (err < 0)
+    {
+        printf("Error getting specification for sensor %d.\n", id);
+        return -1;
+    }
+
     sensor[index] = sensor_temp;
     index++;
 
     return 0;
 }
 
+/*
+    Programs built on the driver (e.g. the scan daemon) supply their own
+    main and define URG_NO_MAIN.
+*/
+#ifndef URG_NO_MAIN
+
 //  ===========================================================================
 //  Main routine.
 //  ===========================================================================
@@ -341,14 +796,15 @@ int main(void)
     {
         printf("Sensor ID = %d.\n\n", sensor[i]->id);
         printf("\tSerial ID = %d.\n", sensor[i]->serial.fd);
-        printf("\tVendor    = %s.\n", sensor[i]->version.vendor);
-        printf("\tProduct   = %s.\n", sensor[i]->version.vendor);
-        printf("\tFirmware  = %s.\n", sensor[i]->version.vendor);
-        printf("\tProtocol  = %s.\n", sensor[i]->version.vendor);
-        printf("\tSerial    = %s.\n", sensor[i]->version.vendor);
+        printf("\tVendor    = %s.\n", sensor[i]->info->version.vendor);
+        printf("\tProduct   = %s.\n", sensor[i]->info->version.product);
+        printf("\tFirmware  = %s.\n", sensor[i]->info->version.firmware);
+        printf("\tProtocol  = %s.\n", sensor[i]->info->version.protocol);
+        printf("\tSerial    = %s.\n", sensor[i]->info->version.serial);
         printf("\n");
     }
 
     return (0);
 }
 
+#endif
@@ -96,6 +96,9 @@
 
 //  ===========================================================================
 
+#ifndef URG_MULTI_H
+#define URG_MULTI_H
+
 #include <stdint.h>
 #include <termios.h>
 
@@ -159,21 +162,38 @@
 #define STRING_LF   '\n'
 #define STRING_CR   '\r'
 
-#define USB_PORT "/dev/ttyACM0" // Output port for USB.
+#define USB_PORT "/dev/ttyACM0" // Default port for USB.
 
 #define SENSORS_MAX 4   // Max number of sensors.
 
+/*
+    Scan geometry. The actual steps come from PP, this only bounds them
+    for fixed size buffers such as scan_t. UTM-30LX and UST have the most.
+*/
+#define SCAN_STEPS_MAX 1081 // Steps per scan (UTM-30LX steps 0-1080).
+#define SCAN_ENC_LEN     3  // Characters per range (GD/MD encoding).
+#define SCAN_TIME_LEN    4  // Characters in timestamp.
+#define SCAN_LINE_LEN   64  // Data characters per line before sum.
+
+/* Valid steps in a sensor's spec. */
+#define SPEC_STEPS(spec) ((spec)->step_max - (spec)->step_min + 1)
+
+/* Motor speed levels for CR. */
+#define MOTOR_DEFAULT    0  // Standard speed.
+#define MOTOR_MAX       10  // Slowest speed level.
+#define MOTOR_RESET     99  // Reset to initial speed.
+
 //  Types. --------------------------------------------------------------------
 
 typedef struct
 {
 //    char command[64];
 //    char string[64];
-    char vendor[64];
-    char product[64];
-    char firmware[64];
-    char protocol[64];
-    char serial[64];
+    char *vendor;   // Lines as received, allocated by get_version().
+    char *product;
+    char *firmware;
+    char *protocol;
+    char *serial;
 /*
     char command[DATA_BLOCK_LEN];
     char string[DATA_BLOCK_LEN];
@@ -199,14 +219,125 @@ typedef struct
     struct termios settings;
 } serial_t;
 
+/*
+    Sensor specification returned by PP.
+
+    Steps are numbered from 0 at the start of the sweep. The front of the
+    sensor is step_front and each step is 360 / ang_res degrees.
+*/
+typedef struct
+{
+    char model[64];
+    int  dist_min;      // DMIN, minimum range (mm).
+    int  dist_max;      // DMAX, maximum range (mm).
+    int  ang_res;       // ARES, steps per revolution.
+    int  step_min;      // AMIN, first valid step.
+    int  step_max;      // AMAX, last valid step.
+    int  step_front;    // AFRT, step facing forwards.
+    int  scan_rpm;      // SCAN, standard motor speed (rpm).
+} spec_t;
+
+/*
+    Timing model derived from the motor speed.
+
+    Initially set from the PP standard speed and updated whenever the motor
+    speed is changed.
+*/
+typedef struct
+{
+    int   rpm;          // Motor speed (rpm).
+    float step_time;    // Time between adjacent steps (us).
+    float scan_time;    // Time for one revolution (us).
+} timing_t;
+
+/* Acquisition settings used when requesting scans. */
+typedef struct
+{
+    uint8_t encoding;   // Characters per range (2 or 3).
+    uint8_t cluster;    // Adjacent steps merged into one range.
+    uint8_t motor;      // CR motor speed level.
+} acq_t;
+
+typedef struct
+{
+    uint64_t host_time;             // Host time at arrival (us, monotonic).
+    uint32_t time;                  // Sensor timestamp (ms).
+    uint16_t first;                 // First step.
+    uint16_t cluster;               // Steps per range.
+    uint16_t count;                 // Number of ranges.
+    uint16_t range[SCAN_STEPS_MAX]; // Ranges (mm), < DMIN are error codes.
+} scan_t;
+
+typedef struct
+{
+    uint16_t count;
+    float x[SCAN_STEPS_MAX];        // Metres, NAN for invalid ranges.
+    float y[SCAN_STEPS_MAX];
+} points_t;
+
+typedef struct
+{
+    float x;                        // Metres.
+    float y;
+    float theta;                    // Radians.
+} pose_t;
+
+/*
+    Identity and the buffers for command replies. Only used while setting
+    up or polling, so kept apart from the per-scan state. The payload is
+    sized from the sensor's spec by get_spec().
+*/
 typedef struct
 {
-    uint8_t id;
     version_t version;
-    serial_t serial;
     char data[DATA_BLOCK_LEN];
-} sensor_t;
+    char *payload;              // Encoded ranges for get_scan().
+    int   payload_size;
+} sensor_info_t;
+
+/*
+    What a scan reads, the acquisition settings, the info pointer, the
+    spec's steps and the port's descriptor, lies in the first two cache
+    lines. spec.model and serial.settings, only used while setting up, sit
+    before and after those. spec_t is also the shared memory header's and
+    serial_t the serial functions' type, so they are not split. The rest of
+    the identity data is allocated separately.
+*/
+typedef struct
+{
+    uint8_t id;
+    acq_t acq;
+    timing_t timing;
+    sensor_info_t *info;
+    spec_t spec;                // model first, then the steps.
+    serial_t serial;            // fd first, then the termios.
+} __attribute__((aligned(64))) sensor_t;
 
 //  Array of sensors.
-sensor_t *sensor[SENSORS_MAX];
+extern sensor_t *sensor[SENSORS_MAX];
+
+//  Functions. ----------------------------------------------------------------
+
+void serial_flush(serial_t *serial);
+int serial_set_baud(serial_t *serial, long baud);
+int serial_open(serial_t *serial, const char *device, long baud);
+int serial_close(serial_t *serial);
+int write_command(serial_t *serial, const char *data, int size);
+char get_data_sum(char *data);
+int get_data(serial_t *serial, char data[DATA_BLOCK_LEN]);
+int get_version(sensor_t *sensor, char string[16]);
+int get_spec(sensor_t *sensor);
+void set_timing(timing_t *timing, const spec_t *spec, int rpm);
+uint32_t decode(const char *data, int len);
+void encode(uint32_t val, char *data, int len);
+uint64_t host_time(void);
+int set_motor_speed(sensor_t *sensor, int level);
+int get_motor_speed(sensor_t *sensor);
+int get_scan(sensor_t *sensor, scan_t *scan);
+void scan_to_points(const spec_t *spec, const scan_t *scan,
+                    points_t *points);
+int sensor_open(const char *device);
+int sensor_init(void);
+
+#endif
 
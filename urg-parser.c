@@ -0,0 +1,275 @@
+//  ===========================================================================
+//  SCIP stream parser for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+#include "urg-parser.h"
+#include <stdio.h>	    // Standard Input/Output definitions.
+#include <string.h>	    // String function definitions.
+#include <stdint.h>	    // Standard type definitions.
+
+//  ===========================================================================
+//  Initialises parser.
+//  ===========================================================================
+void parser_init(parser_t *parser, parser_scan_t on_scan,
+                 parser_reply_t on_reply, void *arg)
+{
+    memset(parser, 0, sizeof(parser_t));
+
+    parser->on_scan = on_scan;
+    parser->on_reply = on_reply;
+    parser->arg = arg;
+    parser->reply_arg = arg;
+    parser->state = PARSER_ECHO;
+}
+
+//  ===========================================================================
+//  Sets callback for undecoded scans.
+//  ===========================================================================
+void parser_set_raw(parser_t *parser, parser_raw_t on_raw)
+{
+    parser->on_raw = on_raw;
+}
+
+//  ===========================================================================
+//  Sets callback for text replies with its own argument.
+//  ===========================================================================
+void parser_set_reply(parser_t *parser, parser_reply_t on_reply, void *arg)
+{
+    parser->on_reply = on_reply;
+    parser->reply_arg = arg;
+}
+
+//  ===========================================================================
+//  Drops any partial reply.
+//  ===========================================================================
+void parser_reset(parser_t *parser)
+{
+    parser->state = PARSER_ECHO;
+    parser->line_len = 0;
+    parser->discard = false;
+    parser->size = 0;
+    parser->reply_len = 0;
+}
+
+//  ===========================================================================
+//  Returns true if the last character of line is the sum of the rest.
+//  ===========================================================================
+static bool parser_sum(const char *line, int len)
+{
+    unsigned int val = 0;
+    int i;
+
+    if (len < 2) return false;
+
+    for (i = 0; i < len - 1; i++) val += (uint8_t)line[i];
+
+    return (char)((val & 0x3f) + 0x30) == line[len - 1];
+}
+
+//  ===========================================================================
+//  Returns value of len decimal digits.
+//  ===========================================================================
+static int parser_dec(const char *data, int len)
+{
+    int val = 0;
+    int i;
+
+    for (i = 0; i < len; i++) val = val * 10 + (data[i] - '0');
+
+    return (val);
+}
+
+//  ===========================================================================
+//  Appends a line to the text reply.
+//  ===========================================================================
+static void parser_keep(parser_t *parser, const char *line, int len)
+{
+    if (parser->reply_len + len + 2 > PARSER_REPLY_MAX) return;
+
+    if (parser->reply_len > 0) parser->reply[parser->reply_len++] = '\n';
+    memcpy(&parser->reply[parser->reply_len], line, len);
+    parser->reply_len += len;
+}
+
+//  ===========================================================================
+//  Completes a reply at its empty line.
+//  ===========================================================================
+static void parser_end(parser_t *parser)
+{
+    raw_t *raw = &parser->raw;
+
+    switch (parser->state)
+    {
+    case PARSER_DATA:
+        raw->host_time = host_time();
+        raw->enc = parser->enc;
+        raw->count = parser->size / parser->enc;
+        if (raw->count > SCAN_STEPS_MAX) raw->count = SCAN_STEPS_MAX;
+        raw_reset(raw);
+
+        parser->scans++;
+        if (parser->on_raw) parser->on_raw(raw, parser->arg);
+        if (parser->on_scan)
+        {
+            raw_to_scan(raw, &parser->scan);
+            parser->on_scan(&parser->scan, parser->arg);
+        }
+        break;
+
+    case PARSER_STATUS:
+    case PARSER_TIME:
+    case PARSER_REPLY:
+        parser->reply[parser->reply_len] = STRING_NULL;
+        parser->replies++;
+        if (parser->on_reply)
+            parser->on_reply(parser->reply, parser->reply_len,
+                             parser->reply_arg);
+        break;
+    }
+
+    parser_reset(parser);
+}
+
+//  ===========================================================================
+//  Handles one line without its LF.
+//  ===========================================================================
+static void parser_line(parser_t *parser, const char *line, int len)
+{
+    raw_t *raw = &parser->raw;
+
+    if (len > 0 && line[len - 1] == STRING_CR) len--;
+
+    if (len == 0)
+    {
+        if (parser->state != PARSER_ECHO) parser_end(parser);
+        return;
+    }
+
+    switch (parser->state)
+    {
+    case PARSER_ECHO:
+        parser->reply_len = 0;
+        parser_keep(parser, line, len);
+
+        // Scan commands echo CMD, first (4), last (4), cluster (2), ...
+        if (len >= 12 && (line[0] == 'G' || line[0] == 'M') &&
+            (line[1] == 'D' || line[1] == 'S'))
+        {
+            parser->enc = (line[1] == 'S') ? 2 : SCAN_ENC_LEN;
+            raw->first = parser_dec(&line[2], 4);
+            raw->cluster = parser_dec(&line[10], 2);
+            if (raw->cluster == 0) raw->cluster = 1;
+            parser->state = PARSER_STATUS;
+        }
+        else
+        {
+            parser->state = PARSER_REPLY;
+        }
+        break;
+
+    case PARSER_STATUS:
+        parser_keep(parser, line, len);
+        if (len != 3 || !parser_sum(line, len))
+        {
+            parser->errors++;
+            parser->state = PARSER_SKIP;
+            break;
+        }
+        raw->status[0] = line[0];
+        raw->status[1] = line[1];
+        raw->status[2] = STRING_NULL;
+        parser->state = PARSER_TIME;
+        break;
+
+    case PARSER_TIME:
+        if (len != SCAN_TIME_LEN + 1 || !parser_sum(line, len))
+        {
+            parser->errors++;
+            parser->state = PARSER_SKIP;
+            break;
+        }
+        raw->time = decode(line, SCAN_TIME_LEN);
+        parser->size = 0;
+        parser->state = PARSER_DATA;
+        break;
+
+    case PARSER_DATA:
+        if (!parser_sum(line, len) ||
+            parser->size + len - 1 > (int)sizeof(raw->payload))
+        {
+            parser->errors++;
+            parser->state = PARSER_SKIP;
+            break;
+        }
+        memcpy(&raw->payload[parser->size], line, len - 1);
+        parser->size += len - 1;
+        break;
+
+    case PARSER_REPLY:
+        parser_keep(parser, line, len);
+        break;
+
+    default:
+        break;
+    }
+}
+
+//  ===========================================================================
+//  Feeds bytes as read from the sensor.
+//  ===========================================================================
+void parser_feed(parser_t *parser, const char *data, size_t len)
+{
+    const char *end = data + len;
+    const char *lf;
+    size_t n;
+
+    while (data < end)
+    {
+        lf = memchr(data, STRING_LF, end - data);
+        n = (lf ? lf : end) - data;
+
+        // Whole lines are handled where they lie, pieces are gathered.
+        if (parser->discard)
+        {
+            parser->discard = (lf == NULL);
+        }
+        else if (lf && parser->line_len == 0)
+        {
+            parser_line(parser, data, n);
+        }
+        else if (parser->line_len + n > PARSER_LINE_MAX)
+        {
+            parser->errors++;
+            parser->state = PARSER_SKIP;
+            parser->line_len = 0;
+            parser->discard = (lf == NULL);
+        }
+        else
+        {
+            memcpy(&parser->line[parser->line_len], data, n);
+            parser->line_len += n;
+            if (lf)
+            {
+                parser_line(parser, parser->line, parser->line_len);
+                parser->line_len = 0;
+            }
+        }
+
+        if (!lf) break;
+        data = lf + 1;
+    }
+}
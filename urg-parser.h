@@ -0,0 +1,108 @@
+//  ===========================================================================
+//  SCIP stream parser for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+/*
+    Parses SCIP replies from a byte stream in whatever pieces they arrive,
+    so a reader can hand over everything a read() returned instead of
+    reading a byte at a time.
+
+    Replies:
+
+    A reply is the command echo, then lines, then an empty line. Replies
+    to GD, GS, MD and MS carry scans: status (with sum), timestamp (with
+    sum), then data lines of up to 64 characters plus a sum. The first step
+    and cluster are taken from the echo and the encoding from the command.
+    Every data line's sum is checked and a scan with a bad sum is dropped.
+
+    Scans are kept as their characters in a raw_t (urg-raw.h). The raw
+    callback gets them undecoded, to decode only the part it needs or pass
+    them on as they are; the scan callback gets them decoded. A parser with
+    no scan callback decodes nothing.
+
+    A scan reply without data, e.g. the "00" acknowledgement of MD, and
+    replies to all other commands go to the reply callback as text, lines
+    separated by LF, without the final empty line.
+*/
+
+//  ===========================================================================
+
+#ifndef URG_PARSER_H
+#define URG_PARSER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "urg-multi.h"
+#include "urg-raw.h"
+
+//  Defines. ------------------------------------------------------------------
+
+#define PARSER_LINE_MAX     128     // Longest line accepted.
+#define PARSER_REPLY_MAX    1024    // Longest text reply kept.
+
+/* States. */
+#define PARSER_ECHO         0       // Waiting for command echo.
+#define PARSER_STATUS       1       // Scan reply status.
+#define PARSER_TIME         2       // Scan timestamp.
+#define PARSER_DATA         3       // Scan data lines.
+#define PARSER_REPLY        4       // Lines of a text reply.
+#define PARSER_SKIP         5       // Discarding to the end of a reply.
+
+//  Types. --------------------------------------------------------------------
+
+/* Called with each complete scan, valid until the callback returns. */
+typedef void (*parser_scan_t)(const scan_t *scan, void *arg);
+
+/* Called with each complete scan undecoded, before the scan callback. */
+typedef void (*parser_raw_t)(raw_t *raw, void *arg);
+
+/* Called with each text reply. */
+typedef void (*parser_reply_t)(const char *reply, int len, void *arg);
+
+typedef struct
+{
+    int      state;
+    char     line[PARSER_LINE_MAX];
+    int      line_len;
+    bool     discard;       // Dropping rest of an overlong line.
+    int      enc;           // Characters per range.
+    int      size;          // Payload characters.
+    raw_t    raw;           // Scan being received.
+    char     reply[PARSER_REPLY_MAX];
+    int      reply_len;
+    scan_t   scan;
+    parser_scan_t  on_scan;
+    parser_reply_t on_reply;
+    parser_raw_t   on_raw;
+    void    *arg;
+    void    *reply_arg;     // For on_reply, arg unless set apart.
+    uint32_t scans;         // Scans delivered.
+    uint32_t replies;       // Text replies delivered.
+    uint32_t errors;        // Replies dropped (sums, overlong lines).
+} parser_t;
+
+//  Functions. ----------------------------------------------------------------
+
+void parser_init(parser_t *parser, parser_scan_t on_scan,
+                 parser_reply_t on_reply, void *arg);
+void parser_set_raw(parser_t *parser, parser_raw_t on_raw);
+void parser_set_reply(parser_t *parser, parser_reply_t on_reply, void *arg);
+void parser_reset(parser_t *parser);
+void parser_feed(parser_t *parser, const char *data, size_t len);
+
+#endif
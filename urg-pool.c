@@ -0,0 +1,172 @@
+//  ===========================================================================
+//  Frame pool for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+#include "urg-pool.h"
+#include <stdio.h>	    // Standard Input/Output definitions.
+#include <stdlib.h>
+#include <string.h>	    // String function definitions.
+#include <stdint.h>	    // Standard type definitions.
+#include <pthread.h>    // POSIX threads.
+
+//  ===========================================================================
+//  Returns number of frames needed to hold buffer_time of scans.
+//  ===========================================================================
+static int pool_frames(uint32_t buffer_time, const timing_t *timing)
+{
+    int frames;
+
+    frames = (int)(buffer_time * 1000.0f / timing->scan_time) + 1;
+    if (frames < POOL_FRAMES_MIN) frames = POOL_FRAMES_MIN;
+
+    return (frames);
+}
+
+//  ===========================================================================
+//  Allocates or releases free frames to reach target (lock held).
+//  ===========================================================================
+static int pool_adjust(pool_t *pool)
+{
+    scan_t **stack;
+    scan_t  *scan;
+
+    if (pool->target > pool->capacity)
+    {
+        stack = realloc(pool->free, pool->target * sizeof(scan_t *));
+        if (stack == NULL) return -1;
+        pool->free = stack;
+        pool->capacity = pool->target;
+    }
+
+    while (pool->size < pool->target)
+    {
+        scan = malloc(sizeof(scan_t));
+        if (scan == NULL) return -1;
+        pool->free[pool->count++] = scan;
+        pool->size++;
+    }
+
+    while (pool->size > pool->target && pool->count > 0)
+    {
+        free(pool->free[--pool->count]);
+        pool->size--;
+    }
+
+    return 0;
+}
+
+//  ===========================================================================
+//  Initialises pool to hold buffer_time (ms) of scans.
+//  ===========================================================================
+int pool_init(pool_t *pool, uint32_t buffer_time, const timing_t *timing)
+{
+    int err;
+
+    pool->free = NULL;
+    pool->count = 0;
+    pool->size = 0;
+    pool->capacity = 0;
+    pool->buffer_time = buffer_time;
+    pool->target = pool_frames(buffer_time, timing);
+
+    pthread_mutex_init(&pool->lock, NULL);
+
+    err = pool_adjust(pool);
+    if (err < 0)
+    {
+        printf("Error allocating frame pool.\n");
+        pool_free(pool);
+    }
+
+    return (err);
+}
+
+//  ===========================================================================
+//  Resizes pool after a change of timing model.
+//  ===========================================================================
+int pool_resize(pool_t *pool, const timing_t *timing)
+{
+    int err;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->target = pool_frames(pool->buffer_time, timing);
+    err = pool_adjust(pool);
+    pthread_mutex_unlock(&pool->lock);
+
+    if (DEBUG) printf("Frame pool %d frames.\n", pool->target);
+
+    return (err);
+}
+
+//  ===========================================================================
+//  Takes a frame from the pool, NULL if none are free.
+//  ===========================================================================
+scan_t *pool_get(pool_t *pool)
+{
+    scan_t *scan = NULL;
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->count > 0) scan = pool->free[--pool->count];
+    pthread_mutex_unlock(&pool->lock);
+
+    return (scan);
+}
+
+//  ===========================================================================
+//  Returns a frame to the pool.
+//  ===========================================================================
+void pool_put(pool_t *pool, scan_t *scan)
+{
+    pthread_mutex_lock(&pool->lock);
+    if (pool->size > pool->target)
+    {
+        free(scan);
+        pool->size--;
+    }
+    else
+    {
+        pool->free[pool->count++] = scan;
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+//  ===========================================================================
+//  Writes every free frame so none page faults on first use.
+//  ===========================================================================
+void pool_prefault(pool_t *pool)
+{
+    int i;
+
+    pthread_mutex_lock(&pool->lock);
+    for (i = 0; i < pool->count; i++) memset(pool->free[i], 0, sizeof(scan_t));
+    pthread_mutex_unlock(&pool->lock);
+}
+
+//  ===========================================================================
+//  Releases pool. All frames must have been returned.
+//  ===========================================================================
+void pool_free(pool_t *pool)
+{
+    while (pool->count > 0) free(pool->free[--pool->count]);
+
+    free(pool->free);
+    pool->free = NULL;
+    pool->size = 0;
+    pool->capacity = 0;
+
+    pthread_mutex_destroy(&pool->lock);
+}
@@ -0,0 +1,63 @@
+//  ===========================================================================
+//  Frame pool for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+/*
+    Preallocated scan frames so that acquisition and processing never call
+    malloc per frame.
+
+    The pool is sized to hold a fixed amount of time worth of scans, so the
+    number of frames follows the motor speed. When the pool shrinks, frames
+    still in use are released as they are returned.
+*/
+
+//  ===========================================================================
+
+#ifndef URG_POOL_H
+#define URG_POOL_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include "urg-multi.h"
+
+//  Defines. ------------------------------------------------------------------
+
+#define POOL_FRAMES_MIN 4   // Minimum number of frames in a pool.
+
+//  Types. --------------------------------------------------------------------
+
+typedef struct
+{
+    scan_t  **free;         // Stack of free frames.
+    int       count;        // Number of free frames.
+    int       size;         // Number of frames allocated.
+    int       target;       // Number of frames wanted.
+    int       capacity;     // Length of free stack.
+    uint32_t  buffer_time;  // Time worth of scans to hold (ms).
+    pthread_mutex_t lock;
+} pool_t;
+
+//  Functions. ----------------------------------------------------------------
+
+int pool_init(pool_t *pool, uint32_t buffer_time, const timing_t *timing);
+int pool_resize(pool_t *pool, const timing_t *timing);
+scan_t *pool_get(pool_t *pool);
+void pool_put(pool_t *pool, scan_t *scan);
+void pool_prefault(pool_t *pool);
+void pool_free(pool_t *pool);
+
+#endif
@@ -0,0 +1,83 @@
+//  ===========================================================================
+//  Acquisition profiles for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+#include "urg-profile.h"
+#include <stdio.h>	    // Standard Input/Output definitions.
+#include <string.h>	    // String function definitions.
+
+//  Profiles. -----------------------------------------------------------------
+
+static const profile_t profiles[] =
+{
+    { "low-latency",    MOTOR_DEFAULT, 2, 1 },
+    { "max-resolution", MOTOR_DEFAULT, 3, 1 },
+    { "low-power",      MOTOR_MAX,     3, 2 },
+};
+
+#define PROFILES (sizeof(profiles) / sizeof(profiles[0]))
+
+//  ===========================================================================
+//  Returns profile by name, NULL if unknown.
+//  ===========================================================================
+const profile_t *get_profile(const char *name)
+{
+    unsigned int i;
+
+    for (i = 0; i < PROFILES; i++)
+        if (strcmp(profiles[i].name, name) == 0) return &profiles[i];
+
+    return NULL;
+}
+
+//  ===========================================================================
+//  Applies profile to sensor and resizes frame pool to suit.
+//  ===========================================================================
+int set_profile(sensor_t *sensor, pool_t *pool, const char *name)
+{
+    const profile_t *profile;
+    int err;
+
+    profile = get_profile(name);
+    if (profile == NULL)
+    {
+        printf("Unknown profile %s.\n", name);
+        return -1;
+    }
+
+    err = set_motor_speed(sensor, profile->motor);
+    if (err < 0)
+    {
+        printf("Error setting motor speed for sensor %d.\n", sensor->id);
+        return (err);
+    }
+
+    sensor->acq.encoding = profile->encoding;
+    sensor->acq.cluster = profile->cluster;
+
+    if (pool != NULL)
+    {
+        err = pool_resize(pool, &sensor->timing);
+        if (err < 0) return (err);
+    }
+
+    if (DEBUG)
+        printf("Sensor %d profile %s, %d rpm.\n", sensor->id, profile->name,
+                                                  sensor->timing.rpm);
+
+    return 0;
+}
@@ -0,0 +1,55 @@
+//  ===========================================================================
+//  Acquisition profiles for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+/*
+    A profile picks motor speed, encoding and cluster count together.
+
+    low-latency     Standard motor speed, 2 character encoding. Shortest
+                    transfer per scan but ranges are limited to 4095 mm.
+    max-resolution  Standard motor speed, 3 character encoding, every step.
+    low-power       Slowest motor speed, 3 character encoding, pairs of
+                    steps clustered. Fewer scans and half the data.
+
+    Applying a profile updates the sensor timing model from the speed the
+    sensor reports and resizes the frame pool to match.
+*/
+
+//  ===========================================================================
+
+#ifndef URG_PROFILE_H
+#define URG_PROFILE_H
+
+#include "urg-multi.h"
+#include "urg-pool.h"
+
+//  Types. --------------------------------------------------------------------
+
+typedef struct
+{
+    const char *name;
+    uint8_t motor;      // CR motor speed level.
+    uint8_t encoding;   // Characters per range.
+    uint8_t cluster;    // Adjacent steps merged into one range.
+} profile_t;
+
+//  Functions. ----------------------------------------------------------------
+
+const profile_t *get_profile(const char *name);
+int set_profile(sensor_t *sensor, pool_t *pool, const char *name);
+
+#endif
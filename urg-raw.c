@@ -0,0 +1,132 @@
+//  ===========================================================================
+//  Lazily decoded scans for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+#include "urg-raw.h"
+#include "urg-model.h"
+#include <string.h>	    // String function definitions.
+#include <stdint.h>	    // Standard type definitions.
+#include <math.h>       // Maths definitions.
+
+//  ===========================================================================
+//  Forgets decoded ranges, after the payload has been replaced.
+//  ===========================================================================
+void raw_reset(raw_t *raw)
+{
+    raw->decoded = 0;
+}
+
+//  ===========================================================================
+//  Decodes one block.
+//  ===========================================================================
+static void raw_block(raw_t *raw, int block)
+{
+    int i, end;
+
+    i = block * RAW_BLOCK;
+    end = i + RAW_BLOCK < raw->count ? i + RAW_BLOCK : raw->count;
+
+    model_decode(&raw->payload[i * raw->enc], raw->enc, end - i,
+                 &raw->range[i]);
+
+    raw->decoded |= 1u << block;
+}
+
+//  ===========================================================================
+//  Returns ranges with those from index from to to - 1 decoded.
+//  ===========================================================================
+const uint16_t *raw_ranges(raw_t *raw, int from, int to)
+{
+    int block;
+
+    if (from < 0) from = 0;
+    if (to > raw->count) to = raw->count;
+
+    for (block = from / RAW_BLOCK; from < to && block <= (to - 1) / RAW_BLOCK;
+         block++)
+        if (!(raw->decoded & (1u << block))) raw_block(raw, block);
+
+    return (raw->range);
+}
+
+//  ===========================================================================
+//  Decodes ranges covering steps step_from to step_to inclusive.
+//  ===========================================================================
+/*
+    Sets from and to to the range indices to use, to exclusive.
+*/
+const uint16_t *raw_steps(raw_t *raw, int step_from, int step_to,
+                          int *from, int *to)
+{
+    int cluster = raw->cluster ? raw->cluster : 1;
+
+    *from = (step_from - raw->first) / cluster;
+    *to = (step_to - raw->first) / cluster + 1;
+
+    if (*from < 0) *from = 0;
+    if (*to > raw->count) *to = raw->count;
+    if (*to < *from) *to = *from;
+
+    return raw_ranges(raw, *from, *to);
+}
+
+//  ===========================================================================
+//  Decodes ranges between two angles (radians, 0 forwards, anticlockwise).
+//  ===========================================================================
+const uint16_t *raw_angles(raw_t *raw, const spec_t *spec, float angle_from,
+                           float angle_to, int *from, int *to)
+{
+    float steps = spec->ang_res / (2.0f * M_PI);
+
+    return raw_steps(raw, spec->step_front + floorf(angle_from * steps),
+                     spec->step_front + ceilf(angle_to * steps), from, to);
+}
+
+//  ===========================================================================
+//  Decodes every range.
+//  ===========================================================================
+/*
+    A scan with nothing decoded yet is decoded in one go, which uses the
+    model's kernel for a full scan (urg-model.h).
+*/
+void raw_decode(raw_t *raw)
+{
+    if (raw->decoded == 0)
+    {
+        model_decode(raw->payload, raw->enc, raw->count, raw->range);
+        raw->decoded = (1u << ((raw->count + RAW_BLOCK - 1) / RAW_BLOCK)) - 1;
+        return;
+    }
+
+    raw_ranges(raw, 0, raw->count);
+}
+
+//  ===========================================================================
+//  Decodes into a scan.
+//  ===========================================================================
+void raw_to_scan(raw_t *raw, scan_t *scan)
+{
+    raw_decode(raw);
+
+    scan->host_time = raw->host_time;
+    scan->time = raw->time;
+    scan->first = raw->first;
+    scan->cluster = raw->cluster;
+    scan->count = raw->count;
+
+    memcpy(scan->range, raw->range, raw->count * sizeof(uint16_t));
+}
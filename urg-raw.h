@@ -0,0 +1,81 @@
+//  ===========================================================================
+//  Lazily decoded scans for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+/*
+    A scan kept as the SCIP characters the sensor sent, decoded only where
+    and when it is looked at.
+
+    Payload:
+
+    The parser checks each data line's sum and appends the line without
+    its sum and LF, so the payload is the encoded ranges back to back and
+    range i starts at character i * enc, whichever line it arrived on. No
+    per line index is needed.
+
+    Decoding:
+
+    Ranges are decoded in blocks of RAW_BLOCK and a bitmap records which
+    blocks are done, so asking for the forward 90 degrees decodes about a
+    quarter of the scan and asking again decodes nothing. raw_decode()
+    decodes everything at once for consumers that want it all, and
+    raw_to_scan() gives a plain scan_t.
+
+    Ranges outside the blocks asked for are stale and must not be read.
+*/
+
+//  ===========================================================================
+
+#ifndef URG_RAW_H
+#define URG_RAW_H
+
+#include <stdint.h>
+#include "urg-multi.h"
+
+//  Defines. ------------------------------------------------------------------
+
+#define RAW_BLOCK       64      // Ranges decoded together.
+#define RAW_BLOCKS      ((SCAN_STEPS_MAX + RAW_BLOCK - 1) / RAW_BLOCK)
+
+//  Types. --------------------------------------------------------------------
+
+typedef struct
+{
+    uint64_t host_time;             // Host time at arrival (us, monotonic).
+    uint32_t time;                  // Sensor timestamp (ms).
+    uint16_t first;                 // First step.
+    uint16_t cluster;               // Steps per range.
+    uint16_t count;                 // Number of ranges.
+    uint8_t  enc;                   // Characters per range (2 or 3).
+    char     status[3];             // Scan status, "99" when streaming.
+    uint32_t decoded;               // Bit per block already decoded.
+    char     payload[SCAN_STEPS_MAX * SCAN_ENC_LEN];
+    uint16_t range[SCAN_STEPS_MAX]; // Decoded ranges (mm).
+} raw_t;
+
+//  Functions. ----------------------------------------------------------------
+
+void raw_reset(raw_t *raw);
+const uint16_t *raw_ranges(raw_t *raw, int from, int to);
+const uint16_t *raw_steps(raw_t *raw, int step_from, int step_to,
+                          int *from, int *to);
+const uint16_t *raw_angles(raw_t *raw, const spec_t *spec, float angle_from,
+                           float angle_to, int *from, int *to);
+void raw_decode(raw_t *raw);
+void raw_to_scan(raw_t *raw, scan_t *scan);
+
+#endif
@@ -0,0 +1,445 @@
+//  ===========================================================================
+//  Flight recorder for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+#include "urg-recorder.h"
+#include <unistd.h>	    // UNIX standard function definitions.
+#include <stdio.h>	    // Standard Input/Output definitions.
+#include <stdlib.h>
+#include <string.h>	    // String function definitions.
+#include <stdint.h>	    // Standard type definitions.
+#include <fcntl.h>	    // File control definitions.
+#include <sys/mman.h>   // Memory mapping.
+#include <sys/stat.h>   // File modes.
+
+#define RECORDER_MIN_DATA   (64 * 1024)     // Smallest usable data ring.
+#define RECORDER_INDEX_PER  256             // Data bytes per index entry.
+
+/* Largest frame in either mode. */
+#define RECORDER_FRAME_MAX  (sizeof(recorder_frame_t) + DELTA_SIZE_MAX)
+
+//  ===========================================================================
+//  Rounds size up to a page.
+//  ===========================================================================
+static uint64_t recorder_align(uint64_t size)
+{
+    return (size + RECORDER_PAGE - 1) & ~(uint64_t)(RECORDER_PAGE - 1);
+}
+
+//  ===========================================================================
+//  Returns true if entry still describes frame seq.
+//  ===========================================================================
+static bool recorder_valid(recorder_t *rec, const recorder_entry_t *entry,
+                           uint64_t seq)
+{
+    uint64_t end = rec->header->end;
+
+    return atomic_load_explicit(&((recorder_entry_t *)entry)->seq,
+                                memory_order_acquire) == seq &&
+           entry->pos + rec->header->data_size >= end;
+}
+
+//  ===========================================================================
+//  Lays out a new recorder file.
+//  ===========================================================================
+static void recorder_format(recorder_t *rec, int mode, uint32_t key_interval)
+{
+    recorder_header_t *header = rec->header;
+    uint64_t entries;
+    uint64_t index_size;
+
+    entries = rec->size / RECORDER_INDEX_PER;
+    if (entries > RECORDER_ENTRIES) entries = RECORDER_ENTRIES;
+    index_size = recorder_align(entries * sizeof(recorder_entry_t));
+
+    memset(header, 0, sizeof(recorder_header_t));
+    memset((uint8_t *)header + RECORDER_PAGE, 0, index_size);
+
+    header->version = RECORDER_VERSION;
+    header->mode = mode;
+    header->index_offset = RECORDER_PAGE;
+    header->data_offset = RECORDER_PAGE + index_size;
+    header->data_size = rec->size - header->data_offset;
+    header->entries = entries;
+    header->key_interval = key_interval;
+    atomic_store(&header->head, 0);
+    atomic_store(&header->frozen, false);
+
+    // Magic last, so a half formatted file is formatted again.
+    atomic_thread_fence(memory_order_release);
+    header->magic = RECORDER_MAGIC;
+}
+
+//  ===========================================================================
+//  Opens recorder file, carrying on from its contents if compatible.
+//  ===========================================================================
+int recorder_open(recorder_t *rec, const char *path, size_t size, int mode,
+                  uint32_t key_interval)
+{
+    recorder_header_t *header;
+    struct stat st;
+    bool   reuse;
+    void  *map;
+    int    i;
+
+    memset(rec, 0, sizeof(recorder_t));
+    rec->fd = -1;
+    pthread_mutex_init(&rec->lock, NULL);
+
+    size = recorder_align(size);
+    if (size < RECORDER_PAGE + RECORDER_MIN_DATA) return -1;
+    rec->size = size;
+
+    rec->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (rec->fd < 0)
+    {
+        perror("Recorder open");
+        return -1;
+    }
+
+    if (fstat(rec->fd, &st) < 0)
+    {
+        perror("Recorder stat");
+        recorder_close(rec);
+        return -1;
+    }
+    reuse = (size_t)st.st_size == size;
+
+    if (!reuse && ftruncate(rec->fd, size) < 0)
+    {
+        perror("Recorder size");
+        recorder_close(rec);
+        return -1;
+    }
+
+    map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, rec->fd, 0);
+    if (map == MAP_FAILED)
+    {
+        perror("Recorder map");
+        recorder_close(rec);
+        return -1;
+    }
+    header = rec->header = map;
+
+    // Keep what survived a previous run if it was laid out the same way.
+    if (!reuse || header->magic != RECORDER_MAGIC ||
+        header->version != RECORDER_VERSION || header->mode != (uint32_t)mode ||
+        header->data_offset + header->data_size != size)
+        recorder_format(rec, mode, key_interval);
+
+    header->key_interval = key_interval;
+    if (atomic_load(&header->frozen))
+        printf("Recorder %s is frozen from a previous run and will not "
+               "record.\nExport it, then thaw it.\n", path);
+
+    rec->index = (recorder_entry_t *)((uint8_t *)map + header->index_offset);
+    rec->data = (uint8_t *)map + header->data_offset;
+
+    if (mode == RECORDER_DELTA)
+    {
+        if (posix_memalign((void **)&rec->delta, 16,
+                           SENSORS_MAX * sizeof(delta_t)) != 0)
+        {
+            rec->delta = NULL;
+            printf("Error allocating recorder encoders.\n");
+            recorder_close(rec);
+            return -1;
+        }
+        for (i = 0; i < SENSORS_MAX; i++)
+            delta_init(&rec->delta[i], DELTA_THRESHOLD, key_interval);
+    }
+
+    return 0;
+}
+
+//  ===========================================================================
+//  Appends a frame, returns -1 if not recorded.
+//  ===========================================================================
+int recorder_write(recorder_t *rec, uint8_t sensor, const scan_t *scan)
+{
+    recorder_header_t *header = rec->header;
+    recorder_frame_t  *frame;
+    recorder_entry_t  *entry;
+    uint64_t pos;
+    uint64_t off;
+    uint64_t seq;
+    size_t   size;
+
+    if (sensor >= SENSORS_MAX || scan->count > SCAN_STEPS_MAX) return -1;
+
+    pthread_mutex_lock(&rec->lock);
+
+    if (atomic_load(&header->frozen))
+    {
+        rec->dropped++;
+        pthread_mutex_unlock(&rec->lock);
+        return -1;
+    }
+
+    // Frames are contiguous, so skip to the start rather than wrap.
+    pos = header->end;
+    off = pos % header->data_size;
+    if (off + RECORDER_FRAME_MAX > header->data_size)
+    {
+        pos += header->data_size - off;
+        off = 0;
+    }
+
+    // Claim the space first so frames being overwritten are invalid.
+    header->end = pos + RECORDER_FRAME_MAX;
+    atomic_thread_fence(memory_order_seq_cst);
+
+    frame = (recorder_frame_t *)(rec->data + off);
+    frame->host_time = scan->host_time;
+    frame->time = scan->time;
+    frame->first = scan->first;
+    frame->cluster = scan->cluster;
+    frame->count = scan->count;
+    frame->sensor = sensor;
+
+    if (rec->delta != NULL)
+    {
+        frame->size = delta_encode(&rec->delta[sensor], scan,
+                                   (uint8_t *)(frame + 1));
+        frame->flags = (((delta_hdr_t *)(frame + 1))->flags & DELTA_KEY)
+                     ? RECORDER_KEY : 0;
+    }
+    else
+    {
+        frame->size = scan->count * sizeof(uint16_t);
+        memcpy(frame + 1, scan->range, frame->size);
+        frame->flags = RECORDER_KEY;
+    }
+    size = sizeof(recorder_frame_t) + frame->size;
+
+    // Publish index entry, then head.
+    seq = atomic_load(&header->head) + 1;
+    entry = &rec->index[seq % header->entries];
+    atomic_store_explicit(&entry->seq, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    entry->pos = pos;
+    entry->host_time = scan->host_time;
+    entry->size = size;
+    entry->sensor = sensor;
+    entry->flags = frame->flags;
+    atomic_store_explicit(&entry->seq, seq, memory_order_release);
+
+    header->end = pos + ((size + 7) & ~(size_t)7);
+    atomic_store_explicit(&header->head, seq, memory_order_release);
+
+    pthread_mutex_unlock(&rec->lock);
+
+    return 0;
+}
+
+//  ===========================================================================
+//  Stops recording so the current window is kept.
+//  ===========================================================================
+void recorder_freeze(recorder_t *rec)
+{
+    pthread_mutex_lock(&rec->lock);
+    atomic_store(&rec->header->frozen, true);
+    pthread_mutex_unlock(&rec->lock);
+}
+
+//  ===========================================================================
+//  Resumes recording.
+//  ===========================================================================
+void recorder_thaw(recorder_t *rec)
+{
+    int i;
+
+    pthread_mutex_lock(&rec->lock);
+    atomic_store(&rec->header->frozen, false);
+
+    // Frames were missed, so each sensor starts again from a key frame.
+    if (rec->delta != NULL)
+        for (i = 0; i < SENSORS_MAX; i++) delta_reset(&rec->delta[i]);
+
+    pthread_mutex_unlock(&rec->lock);
+}
+
+//  ===========================================================================
+//  Returns true while frozen, including by a previous run.
+//  ===========================================================================
+bool recorder_frozen(recorder_t *rec)
+{
+    return atomic_load(&rec->header->frozen);
+}
+
+//  ===========================================================================
+//  Positions iterator at the oldest frame still held.
+//  ===========================================================================
+void recorder_first(recorder_t *rec, recorder_iter_t *iter)
+{
+    uint64_t head;
+    uint64_t seq;
+
+    head = atomic_load_explicit(&rec->header->head, memory_order_acquire);
+    seq = (head >= rec->header->entries) ? head - rec->header->entries + 1
+                                         : 1;
+
+    while (seq <= head &&
+           !recorder_valid(rec, &rec->index[seq % rec->header->entries], seq))
+        seq++;
+
+    iter->seq = seq;
+    iter->key = 0;
+}
+
+//  ===========================================================================
+//  Decodes next frame, returns 1 if read, 0 at the end.
+//  ===========================================================================
+int recorder_next(recorder_t *rec, recorder_iter_t *iter, uint8_t *sensor,
+                  scan_t *scan)
+{
+    const recorder_entry_t *entry;
+    const recorder_frame_t *frame;
+    const uint8_t *payload;
+    uint16_t *range;
+    uint64_t head;
+    uint64_t seq;
+    int ret;
+
+    head = atomic_load_explicit(&rec->header->head, memory_order_acquire);
+
+    while (iter->seq <= head)
+    {
+        seq = iter->seq++;
+        entry = &rec->index[seq % rec->header->entries];
+        if (!recorder_valid(rec, entry, seq)) continue;
+
+        frame = (const recorder_frame_t *)
+                (rec->data + entry->pos % rec->header->data_size);
+        payload = (const uint8_t *)(frame + 1);
+
+        if (frame->sensor >= SENSORS_MAX || frame->count > SCAN_STEPS_MAX ||
+            sizeof(recorder_frame_t) + frame->size != entry->size)
+            continue;
+
+        range = iter->range[frame->sensor];
+
+        if (rec->header->mode == RECORDER_DELTA)
+        {
+            // Deltas only apply on top of this sensor's key frame.
+            if (!(frame->flags & RECORDER_KEY) &&
+                !(iter->key & (1u << frame->sensor)))
+                continue;
+
+            ret = delta_decode(range, frame->count, payload, frame->size);
+            if (ret < 0) continue;
+        }
+        else
+        {
+            if (frame->size != frame->count * sizeof(uint16_t)) continue;
+            memcpy(range, payload, frame->size);
+        }
+        iter->key |= 1u << frame->sensor;
+
+        *sensor = frame->sensor;
+        scan->host_time = frame->host_time;
+        scan->time = frame->time;
+        scan->first = frame->first;
+        scan->cluster = frame->cluster;
+        scan->count = frame->count;
+        memcpy(scan->range, range, frame->count * sizeof(uint16_t));
+
+        return 1;
+    }
+
+    return 0;
+}
+
+//  ===========================================================================
+//  Writes frames held to a stream file, returns number of frames.
+//  ===========================================================================
+int recorder_export(recorder_t *rec, const char *path)
+{
+    static __thread recorder_iter_t iter;
+    static __thread scan_t scan;
+    recorder_frame_t frame;
+    uint8_t sensor;
+    FILE   *file;
+    int     frames;
+
+    file = fopen(path, "wb");
+    if (file == NULL)
+    {
+        perror("Recorder export");
+        return -1;
+    }
+    setvbuf(file, NULL, _IOFBF, 1 << 20);
+
+    fwrite(RECORDER_STREAM, 1, strlen(RECORDER_STREAM), file);
+
+    frames = 0;
+    recorder_first(rec, &iter);
+    while (recorder_next(rec, &iter, &sensor, &scan) > 0)
+    {
+        memset(&frame, 0, sizeof(frame));
+        frame.host_time = scan.host_time;
+        frame.time = scan.time;
+        frame.first = scan.first;
+        frame.cluster = scan.cluster;
+        frame.count = scan.count;
+        frame.sensor = sensor;
+        frame.flags = RECORDER_KEY;
+        frame.size = scan.count * sizeof(uint16_t);
+
+        fwrite(&frame, sizeof(frame), 1, file);
+        fwrite(scan.range, sizeof(uint16_t), scan.count, file);
+        frames++;
+    }
+
+    if (fclose(file) != 0)
+    {
+        perror("Recorder export");
+        return -1;
+    }
+
+    return (frames);
+}
+
+//  ===========================================================================
+//  Freezes, exports and resumes, returns number of frames exported.
+//  ===========================================================================
+int recorder_trigger(recorder_t *rec, const char *path)
+{
+    int frames;
+
+    recorder_freeze(rec);
+    frames = recorder_export(rec, path);
+    recorder_thaw(rec);
+
+    return (frames);
+}
+
+//  ===========================================================================
+//  Unmaps recorder. The file keeps the frames for next time.
+//  ===========================================================================
+void recorder_close(recorder_t *rec)
+{
+    if (rec->header != NULL) munmap(rec->header, rec->size);
+    if (rec->fd >= 0) close(rec->fd);
+
+    free(rec->delta);
+    pthread_mutex_destroy(&rec->lock);
+
+    rec->header = NULL;
+    rec->delta = NULL;
+    rec->fd = -1;
+}
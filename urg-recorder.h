@@ -0,0 +1,171 @@
+//  ===========================================================================
+//  Flight recorder for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+/*
+    Keeps the most recent frames from all sensors in a fixed size file so
+    the scans leading up to an incident are available afterwards.
+
+    Layout:
+
+    ,-------------------------------------------,
+    | Header | Index (entries) | Data (ring)    |
+    '-------------------------------------------'
+
+    The file is mapped shared, so writing a frame is a memcpy into the page
+    cache and the data survives the process crashing. Each frame is stored
+    contiguously in the data ring at a logical position that only grows;
+    a frame that would run past the end starts again at the beginning. The
+    index is a ring of entries giving each frame's position, size, sensor
+    and time, and the header holds the number of the last complete frame.
+    The frame is written first, then its index entry, then the header, so
+    a crash at any point leaves the file describing only complete frames.
+
+    A frame is valid while its index entry still holds its number and its
+    data is within the last data_size bytes written. Size the file for the
+    time wanted, e.g. 5 minutes of one sensor at 10 Hz in raw mode is about
+    5 * 60 * 10 * 1.4 kB = 4.2 MB.
+
+    Modes:
+
+    RECORDER_RAW    Ranges as uint16_t.
+    RECORDER_DELTA  Changed beams only (urg-delta.h), with a key frame per
+                    sensor every key_interval frames. Reading starts from
+                    each sensor's first key frame still in the ring.
+
+    Freeze and export:
+
+    recorder_freeze() stops new frames being written so the window leading
+    up to the trigger is not overwritten, recorder_export() decodes it into
+    a stream file and recorder_thaw() carries on recording. recorder_trigger()
+    does all three.
+
+    The frozen flag is kept in the file, so if the process dies between
+    freeze and thaw the window is still there after a restart, and nothing
+    is recorded over it. recorder_open() reports a frozen file and
+    recorder_frozen() returns true. To recover, recorder_export() the
+    window and then recorder_thaw() to start recording again.
+
+    Export stream format:
+
+    "URGREC1\n" then per frame: recorder_frame_t, count uint16_t ranges.
+*/
+
+//  ===========================================================================
+
+#ifndef URG_RECORDER_H
+#define URG_RECORDER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "urg-multi.h"
+#include "urg-delta.h"
+
+//  Defines. ------------------------------------------------------------------
+
+#define RECORDER_MAGIC      0x3143455247525510ULL   // "\x10URGREC1".
+#define RECORDER_VERSION    1
+#define RECORDER_PAGE       4096
+#define RECORDER_ENTRIES    65536   // Default index entries.
+#define RECORDER_STREAM     "URGREC1\n"
+
+/* Modes. */
+#define RECORDER_RAW        0
+#define RECORDER_DELTA      1
+
+/* Frame flags. */
+#define RECORDER_KEY        0x01    // Frame holds every beam.
+
+//  Types. --------------------------------------------------------------------
+
+/* Frame header, in the ring and in exported streams. */
+typedef struct
+{
+    uint64_t host_time;     // Host time at arrival (us, monotonic).
+    uint32_t time;          // Sensor timestamp (ms).
+    uint16_t first;
+    uint16_t cluster;
+    uint16_t count;
+    uint8_t  sensor;
+    uint8_t  flags;         // RECORDER_KEY.
+    uint32_t size;          // Payload bytes following.
+} recorder_frame_t;
+
+typedef struct
+{
+    atomic_uint_fast64_t seq;   // Frame number, 0 if unused.
+    uint64_t pos;               // Logical position in data ring.
+    uint64_t host_time;
+    uint32_t size;              // Frame header plus payload.
+    uint8_t  sensor;
+    uint8_t  flags;
+} recorder_entry_t;
+
+typedef struct
+{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t mode;
+    uint64_t index_offset;
+    uint64_t data_offset;
+    uint64_t data_size;
+    uint32_t entries;
+    uint32_t key_interval;
+    atomic_uint_fast64_t head;  // Last complete frame, 0 if none.
+    uint64_t end;               // Logical position after last frame.
+    atomic_bool frozen;         // Persisted so a crash keeps the window.
+} recorder_header_t;
+
+typedef struct
+{
+    int      fd;
+    size_t   size;
+    recorder_header_t *header;
+    recorder_entry_t  *index;
+    uint8_t  *data;
+    delta_t  *delta;            // Per sensor encoders in delta mode.
+    pthread_mutex_t lock;       // Serialises writers with freeze.
+    uint64_t dropped;           // Frames not recorded while frozen.
+} recorder_t;
+
+/* Position when reading frames back. */
+typedef struct
+{
+    uint64_t seq;               // Next frame.
+    uint32_t key;               // Sensors with a key frame seen.
+    uint16_t range[SENSORS_MAX][SCAN_STEPS_MAX];
+} recorder_iter_t;
+
+//  Functions. ----------------------------------------------------------------
+
+int recorder_open(recorder_t *rec, const char *path, size_t size, int mode,
+                  uint32_t key_interval);
+int recorder_write(recorder_t *rec, uint8_t sensor, const scan_t *scan);
+void recorder_freeze(recorder_t *rec);
+void recorder_thaw(recorder_t *rec);
+bool recorder_frozen(recorder_t *rec);
+void recorder_first(recorder_t *rec, recorder_iter_t *iter);
+int recorder_next(recorder_t *rec, recorder_iter_t *iter, uint8_t *sensor,
+                  scan_t *scan);
+int recorder_export(recorder_t *rec, const char *path);
+int recorder_trigger(recorder_t *rec, const char *path);
+void recorder_close(recorder_t *rec);
+
+#endif
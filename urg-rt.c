@@ -0,0 +1,341 @@
+//  ===========================================================================
+//  Real-time support for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+#include "urg-rt.h"
+#include <stdio.h>	    // Standard Input/Output definitions.
+#include <stdlib.h>
+#include <string.h>	    // String function definitions.
+#include <stdint.h>	    // Standard type definitions.
+#include <time.h>       // Clock definitions.
+#include <malloc.h>     // Allocator tuning and statistics.
+#include <pthread.h>    // POSIX threads.
+#include <unistd.h>	    // UNIX standard function definitions.
+#include <sys/mman.h>   // Memory locking.
+#include <sys/resource.h>   // Resource usage.
+
+//  ===========================================================================
+//  Initialises statistics. Timing gives the expected frame period.
+//  ===========================================================================
+void rt_init(rt_t *rt, const timing_t *timing)
+{
+    memset(rt, 0, sizeof(rt_t));
+
+    rt->period = timing->scan_time;
+}
+
+//  ===========================================================================
+//  Parses a CPU list such as "2", "2,3" or "1-3" into a set.
+//  ===========================================================================
+int rt_cpus(const char *list, cpu_set_t *cpus)
+{
+    char *end;
+    long  first;
+    long  last;
+
+    CPU_ZERO(cpus);
+
+    while (*list)
+    {
+        first = strtol(list, &end, 10);
+        if (end == list || first < 0 || first >= CPU_SETSIZE) return -1;
+        last = first;
+
+        if (*end == '-')
+        {
+            list = end + 1;
+            last = strtol(list, &end, 10);
+            if (end == list || last < first || last >= CPU_SETSIZE)
+                return -1;
+        }
+
+        for (; first <= last; first++) CPU_SET(first, cpus);
+
+        if (*end == ',') end++;
+        else if (*end != STRING_NULL) return -1;
+        list = end;
+    }
+
+    return CPU_COUNT(cpus) > 0 ? 0 : -1;
+}
+
+//  ===========================================================================
+//  Locks memory and keeps freed heap memory in the process.
+//  ===========================================================================
+int rt_lock_memory(void)
+{
+    // Freed memory stays mapped and locked, so reusing it cannot fault.
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_MMAP_MAX, 0);
+
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0)
+    {
+        perror("mlockall");
+        return -1;
+    }
+
+    return 0;
+}
+
+//  ===========================================================================
+//  Touches every page so none fault when first used.
+//  ===========================================================================
+void rt_prefault(void *data, size_t size)
+{
+    volatile uint8_t *byte = data;
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t i;
+
+    for (i = 0; i < size; i += page) byte[i] = byte[i];
+    if (size > 0) byte[size - 1] = byte[size - 1];
+}
+
+//  ===========================================================================
+//  Grows the stack by RT_STACK_SIZE so later calls find it mapped.
+//  ===========================================================================
+static __attribute__((noinline)) void rt_prefault_stack(void)
+{
+    volatile uint8_t stack[RT_STACK_SIZE];
+
+    memset((uint8_t *)stack, 0, RT_STACK_SIZE);
+}
+
+//  ===========================================================================
+//  Pins calling thread, makes it SCHED_FIFO and prefaults its stack.
+//  ===========================================================================
+/*
+    cpus NULL or empty leaves the affinity alone and priority 0 leaves the
+    policy alone. Returns -1 if either could not be set.
+*/
+int rt_thread(const cpu_set_t *cpus, int priority)
+{
+    struct sched_param param;
+    int ret = 0;
+    int err;
+
+    if (cpus && CPU_COUNT(cpus) > 0)
+    {
+        err = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t),
+                                     cpus);
+        if (err != 0)
+        {
+            printf("Couldn't pin thread: %s.\n", strerror(err));
+            ret = -1;
+        }
+    }
+
+    if (priority > 0)
+    {
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = priority;
+
+        err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (err != 0)
+        {
+            printf("Couldn't set SCHED_FIFO: %s.\n", strerror(err));
+            ret = -1;
+        }
+    }
+
+    rt_prefault_stack();
+
+    return (ret);
+}
+
+//  ===========================================================================
+//  Measures wakeup latency of the calling thread.
+//  ===========================================================================
+void rt_calibrate(rt_t *rt, int loops, uint32_t interval)
+{
+    struct timespec next;
+    struct timespec now;
+    int64_t late;
+    int i;
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    for (i = 0; i < loops; i++)
+    {
+        next.tv_nsec += interval * 1000L;
+        while (next.tv_nsec >= 1000000000L)
+        {
+            next.tv_nsec -= 1000000000L;
+            next.tv_sec++;
+        }
+
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+        late = (now.tv_sec - next.tv_sec) * 1000000000LL
+             + (now.tv_nsec - next.tv_nsec);
+        rt_hist_add(&rt->wakeup, late > 0 ? late / 1000 : 0);
+    }
+}
+
+//  ===========================================================================
+//  Returns bytes allocated from the heap.
+//  ===========================================================================
+static size_t rt_heap(void)
+{
+    struct mallinfo2 info = mallinfo2();
+
+    return info.uordblks + info.hblkhd;
+}
+
+//  ===========================================================================
+//  Takes start-up snapshot for the calling thread.
+//  ===========================================================================
+void rt_arm(rt_t *rt)
+{
+    struct rusage usage;
+
+    getrusage(RUSAGE_THREAD, &usage);
+
+    rt->heap = rt_heap();
+    rt->minflt = usage.ru_minflt;
+    rt->majflt = usage.ru_majflt;
+    rt->armed = true;
+}
+
+//  ===========================================================================
+//  Returns 0 if nothing has been allocated or faulted in since rt_arm().
+//  ===========================================================================
+/*
+    Call from the thread that called rt_arm(), since faults are counted per
+    thread. Heap use is process wide.
+*/
+int rt_check(rt_t *rt)
+{
+    struct rusage usage;
+
+    if (!rt->armed) return -1;
+
+    getrusage(RUSAGE_THREAD, &usage);
+
+    rt->heap_growth = (long)rt_heap() - (long)rt->heap;
+    rt->faults = (usage.ru_minflt - rt->minflt)
+               + (usage.ru_majflt - rt->majflt);
+    rt->checked = true;
+
+    return (rt->heap_growth > 0 || rt->faults > 0) ? 1 : 0;
+}
+
+//  ===========================================================================
+//  Records delivery jitter of a frame from sensor id arriving at time (us).
+//  ===========================================================================
+void rt_frame(rt_t *rt, uint8_t id, uint64_t time)
+{
+    uint64_t interval;
+    uint64_t periods;
+    uint64_t expect;
+
+    if (id >= SENSORS_MAX) return;
+
+    if (rt->last[id] && rt->period && time > rt->last[id])
+    {
+        // Nearest whole number of periods, in case frames were lost.
+        interval = time - rt->last[id];
+        periods = (interval + rt->period / 2) / rt->period;
+        if (periods == 0) periods = 1;
+        expect = periods * rt->period;
+
+        rt_hist_add(&rt->jitter, interval > expect ? interval - expect
+                                                   : expect - interval);
+    }
+
+    rt->last[id] = time;
+}
+
+//  ===========================================================================
+//  Adds a sample (us) to a histogram.
+//  ===========================================================================
+void rt_hist_add(rt_hist_t *hist, uint64_t us)
+{
+    hist->bucket[us < RT_HIST_MAX ? us : RT_HIST_MAX]++;
+    hist->count++;
+    hist->sum += us;
+    if (us > hist->max) hist->max = us;
+}
+
+//  ===========================================================================
+//  Returns the p (0 to 1) percentile (us), RT_HIST_MAX if beyond range.
+//  ===========================================================================
+uint64_t rt_hist_percentile(const rt_hist_t *hist, double p)
+{
+    uint64_t target;
+    uint64_t seen = 0;
+    int i;
+
+    if (hist->count == 0) return 0;
+
+    target = (uint64_t)(p * hist->count);
+    if (target < 1) target = 1;
+
+    for (i = 0; i <= RT_HIST_MAX; i++)
+    {
+        seen += hist->bucket[i];
+        if (seen >= target) return (i);
+    }
+
+    return (RT_HIST_MAX);
+}
+
+//  ===========================================================================
+//  Prints one histogram.
+//  ===========================================================================
+static void rt_hist_print(const char *name, const rt_hist_t *hist)
+{
+    if (hist->count == 0)
+    {
+        printf("%-8s no samples.\n", name);
+        return;
+    }
+
+    printf("%-8s %llu samples, mean %llu us, p50 %llu, p99 %llu, "
+           "p99.9 %llu, max %llu us.\n", name,
+           (unsigned long long)hist->count,
+           (unsigned long long)(hist->sum / hist->count),
+           (unsigned long long)rt_hist_percentile(hist, 0.5),
+           (unsigned long long)rt_hist_percentile(hist, 0.99),
+           (unsigned long long)rt_hist_percentile(hist, 0.999),
+           (unsigned long long)hist->max);
+}
+
+//  ===========================================================================
+//  Prints latency statistics and allocation check.
+//  ===========================================================================
+void rt_report(rt_t *rt)
+{
+    uint64_t p999;
+
+    rt_hist_print("Wakeup", &rt->wakeup);
+    rt_hist_print("Jitter", &rt->jitter);
+
+    if (rt->jitter.count)
+    {
+        p999 = rt_hist_percentile(&rt->jitter, 0.999);
+        printf("Jitter p99.9 %s target of %d us.\n",
+               p999 < RT_JITTER_MAX ? "within" : "OVER", RT_JITTER_MAX);
+    }
+
+    // Reported as last checked, since shutdown itself frees and faults.
+    if (!rt->checked) return;
+
+    printf("Since start-up: heap %+ld bytes, %ld page faults.%s\n",
+           rt->heap_growth, rt->faults,
+           (rt->heap_growth > 0 || rt->faults > 0) ? " ALLOCATED" : "");
+}
@@ -0,0 +1,118 @@
+//  ===========================================================================
+//  Real-time support for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+/*
+    Opt-in real-time mode for acquisition threads that need bounded latency.
+
+    Set up:
+
+    rt_lock_memory()    Locks all current and future pages in RAM and stops
+                        malloc handing memory back to the kernel, so memory
+                        freed and reused never faults again.
+    rt_thread()         Pins the calling thread to a set of CPUs, makes it
+                        SCHED_FIFO and prefaults RT_STACK_SIZE of its stack.
+    pool_prefault()     (urg-pool.h) Touches every frame of a pool.
+
+    Everything a thread will use must be allocated before rt_arm(), which
+    takes a snapshot of heap use and of the thread's page faults.
+    rt_check() compares against it, so an allocation after start-up shows
+    up as heap growth and anything that touches new memory as a fault.
+    Allocations freed again before the check are not seen, but with memory
+    locked and trimming off they cost no faults either.
+
+    Measurement:
+
+    rt_calibrate()      Sleeps to absolute deadlines and records how late
+                        the thread wakes, as cyclictest does, to give the
+                        worst case wakeup latency of the thread as set up.
+    rt_frame()          Records how far the interval between a sensor's
+                        frames is from the scan period (or a multiple of it,
+                        if frames were missed), i.e. delivery jitter.
+
+    Both histograms have 1 us buckets up to RT_HIST_MAX, and rt_report()
+    prints percentiles up to p99.9, the worst case and the result of the
+    last rt_check(), so call that before shutting anything down.
+    The target is a p99.9 jitter below RT_JITTER_MAX.
+
+    Needs CAP_SYS_NICE for SCHED_FIFO and CAP_IPC_LOCK or a large enough
+    RLIMIT_MEMLOCK for mlockall(). Either failing is reported and leaves
+    the thread running as before. Build with _GNU_SOURCE for cpu_set_t.
+*/
+
+//  ===========================================================================
+
+#ifndef URG_RT_H
+#define URG_RT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sched.h>
+#include "urg-multi.h"
+
+//  Defines. ------------------------------------------------------------------
+
+#define RT_PRIORITY     80              // Default SCHED_FIFO priority.
+#define RT_STACK_SIZE   (256 * 1024)    // Stack prefaulted per thread.
+#define RT_HIST_MAX     10000           // Histogram range (us).
+#define RT_JITTER_MAX   1000            // Target p99.9 jitter (us).
+
+//  Types. --------------------------------------------------------------------
+
+typedef struct
+{
+    uint32_t bucket[RT_HIST_MAX + 1];   // 1 us each, last is overflow.
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+} rt_hist_t;
+
+typedef struct
+{
+    uint32_t  period;                   // Scan period (us).
+    uint64_t  last[SENSORS_MAX];        // Host time of last frame.
+    rt_hist_t jitter;                   // Frame delivery jitter (us).
+    rt_hist_t wakeup;                   // Wakeup latency (us).
+
+    // Start-up snapshot.
+    bool      armed;
+    size_t    heap;                     // Bytes allocated.
+    long      minflt;                   // Thread page faults.
+    long      majflt;
+
+    // Last check.
+    bool      checked;
+    long      heap_growth;
+    long      faults;
+} rt_t;
+
+//  Functions. ----------------------------------------------------------------
+
+void rt_init(rt_t *rt, const timing_t *timing);
+int rt_cpus(const char *list, cpu_set_t *cpus);
+int rt_lock_memory(void);
+int rt_thread(const cpu_set_t *cpus, int priority);
+void rt_prefault(void *data, size_t size);
+void rt_calibrate(rt_t *rt, int loops, uint32_t interval);
+void rt_arm(rt_t *rt);
+int rt_check(rt_t *rt);
+void rt_frame(rt_t *rt, uint8_t id, uint64_t time);
+void rt_hist_add(rt_hist_t *hist, uint64_t us);
+uint64_t rt_hist_percentile(const rt_hist_t *hist, double p);
+void rt_report(rt_t *rt);
+
+#endif
@@ -0,0 +1,169 @@
+//  ===========================================================================
+//  Sector nearest obstacle index for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+#include "urg-sector.h"
+#include <stdint.h>	    // Standard type definitions.
+#include <stdatomic.h>  // Atomic operations.
+#include <math.h>       // Maths definitions.
+
+//  ===========================================================================
+//  Initialises sector index.
+//  ===========================================================================
+void sector_init(sector_t *sector, const spec_t *spec)
+{
+    atomic_init(&sector->buf[0].seq, 0);
+    atomic_init(&sector->buf[1].seq, 0);
+    atomic_init(&sector->current, -1);
+
+    sector->dist_min = spec->dist_min;
+    sector->step_front = spec->step_front;
+    sector->step_angle = 2.0f * M_PI / spec->ang_res;
+}
+
+//  ===========================================================================
+//  Builds index for a new scan and publishes it.
+//  ===========================================================================
+void sector_update(sector_t *sector, const scan_t *scan)
+{
+    sector_buf_t *buf;
+    uint32_t *row;
+    uint32_t *prev;
+    uint32_t  a, b;
+    uint16_t  range;
+    int       half;
+    int       next;
+    int       k;
+    int       i;
+
+    next = 1 - atomic_load_explicit(&sector->current, memory_order_relaxed);
+    if (next > 1) next = 0;
+    buf = &sector->buf[next];
+
+    atomic_fetch_add_explicit(&buf->seq, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    buf->host_time = scan->host_time;
+    buf->first = scan->first;
+    buf->cluster = scan->cluster;
+    buf->count = scan->count;
+
+    row = buf->table[0];
+    for (i = 0; i < scan->count; i++)
+    {
+        range = scan->range[i];
+        if (range < sector->dist_min) range = SECTOR_NONE;
+        row[i] = (uint32_t)range << 16 | i;
+    }
+
+    for (k = 1; k < SECTOR_LEVELS && (1 << k) <= scan->count; k++)
+    {
+        prev = buf->table[k - 1];
+        row = buf->table[k];
+        half = 1 << (k - 1);
+
+        for (i = 0; i + (1 << k) <= scan->count; i++)
+        {
+            a = prev[i];
+            b = prev[i + half];
+            row[i] = (a < b) ? a : b;
+        }
+    }
+
+    atomic_fetch_add_explicit(&buf->seq, 1, memory_order_release);
+    atomic_store_explicit(&sector->current, next, memory_order_release);
+}
+
+//  ===========================================================================
+//  Returns nearest obstacle between two steps (inclusive).
+//  ===========================================================================
+int sector_query(sector_t *sector, int step_from, int step_to,
+                 sector_min_t *min)
+{
+    sector_buf_t *buf;
+    unsigned int seq;
+    uint32_t a, b;
+    int      current;
+    int      from, to;
+    int      k;
+
+    if (step_from > step_to) return -1;
+
+    for (;;)
+    {
+        current = atomic_load_explicit(&sector->current, memory_order_acquire);
+        if (current < 0) return -1;
+
+        buf = &sector->buf[current];
+        seq = atomic_load_explicit(&buf->seq, memory_order_acquire);
+        if (seq & 1) continue;
+
+        // Convert steps to beams, clipped to the scan. Division truncates
+        // towards zero, so ranges outside the scan are rejected first.
+        if (step_to < buf->first ||
+            step_from > buf->first + (buf->count - 1) * buf->cluster)
+        {
+            from = 1;
+            to = 0;
+        }
+        else
+        {
+            from = (step_from - buf->first) / buf->cluster;
+            to = (step_to - buf->first) / buf->cluster;
+            if (from < 0) from = 0;
+            if (to >= buf->count) to = buf->count - 1;
+        }
+
+        if (from <= to)
+        {
+            k = 31 - __builtin_clz(to - from + 1);
+            a = buf->table[k][from];
+            b = buf->table[k][to - (1 << k) + 1];
+            if (b < a) a = b;
+
+            min->host_time = buf->host_time;
+            min->range = a >> 16;
+            min->step = buf->first + (a & 0xffff) * buf->cluster;
+        }
+
+        // Retry if the table was rewritten while reading it.
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&buf->seq, memory_order_relaxed) == seq)
+            break;
+    }
+
+    if (from > to) return -1;
+
+    min->angle = (min->step - sector->step_front) * sector->step_angle;
+
+    return (min->range == SECTOR_NONE) ? 0 : 1;
+}
+
+//  ===========================================================================
+//  Returns nearest obstacle between two angles (radians, 0 is forwards).
+//  ===========================================================================
+int sector_query_angle(sector_t *sector, float from, float to,
+                       sector_min_t *min)
+{
+    int step_from;
+    int step_to;
+
+    step_from = sector->step_front + (int)ceilf(from / sector->step_angle);
+    step_to = sector->step_front + (int)floorf(to / sector->step_angle);
+
+    return sector_query(sector, step_from, step_to, min);
+}
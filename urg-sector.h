@@ -0,0 +1,90 @@
+//  ===========================================================================
+//  Sector nearest obstacle index for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+/*
+    Answers "closest obstacle between these angles" in constant time.
+
+    Index:
+
+    A sparse table holds the minimum over every run of 2^k beams starting
+    at each beam, so any interval is covered by two overlapping runs. Each
+    entry packs range << 16 | beam so the minimum also gives the argmin,
+    with ties going to the lower beam. Error codes are stored as 0xffff so
+    they are never the nearest obstacle.
+
+    Publication:
+
+    There are two tables. The writer builds the one not published and then
+    publishes it. Each table has a sequence count that is odd while it is
+    being written, and a reader retries if the count changed under it, so
+    readers never block the writer and the writer never waits for readers.
+*/
+
+//  ===========================================================================
+
+#ifndef URG_SECTOR_H
+#define URG_SECTOR_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include "urg-multi.h"
+
+//  Defines. ------------------------------------------------------------------
+
+#define SECTOR_LEVELS 11    // 2^11 > SCAN_STEPS_MAX.
+#define SECTOR_NONE   0xffff
+
+//  Types. --------------------------------------------------------------------
+
+typedef struct
+{
+    atomic_uint seq;                // Odd while being written.
+    uint64_t host_time;             // Host time of scan.
+    uint16_t first;                 // First step.
+    uint16_t cluster;               // Steps per beam.
+    uint16_t count;                 // Number of beams.
+    uint32_t table[SECTOR_LEVELS][SCAN_STEPS_MAX];
+} sector_buf_t;
+
+typedef struct
+{
+    sector_buf_t buf[2];
+    atomic_int current;             // Published buffer, -1 before first.
+    int   dist_min;                 // DMIN (mm).
+    int   step_front;               // AFRT.
+    float step_angle;               // Radians per step.
+} sector_t;
+
+typedef struct
+{
+    uint16_t range;                 // Nearest range (mm).
+    uint16_t step;                  // Step of nearest range.
+    float    angle;                 // Angle of nearest range (radians).
+    uint64_t host_time;             // Host time of scan.
+} sector_min_t;
+
+//  Functions. ----------------------------------------------------------------
+
+void sector_init(sector_t *sector, const spec_t *spec);
+void sector_update(sector_t *sector, const scan_t *scan);
+int sector_query(sector_t *sector, int step_from, int step_to,
+                 sector_min_t *min);
+int sector_query_angle(sector_t *sector, float from, float to,
+                       sector_min_t *min);
+
+#endif
@@ -0,0 +1,643 @@
+//  ===========================================================================
+//  Unix socket scan server for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+#include "urg-server.h"
+#include <unistd.h>	    // UNIX standard function definitions.
+#include <stdio.h>	    // Standard Input/Output definitions.
+#include <stdlib.h>
+#include <string.h>	    // String function definitions.
+#include <stdint.h>	    // Standard type definitions.
+#include <errno.h>      // Error numbers.
+#include <fcntl.h>	    // File control definitions.
+#include <sys/socket.h> // Sockets.
+#include <sys/un.h>     // Unix domain sockets.
+#include <sys/uio.h>    // Scatter/gather I/O.
+#include <sys/epoll.h>  // Event polling.
+#include <sys/eventfd.h>// Event notification.
+
+#define SERVER_IOV 16   // Messages per writev.
+
+/* Epoll tags for the non-client descriptors. */
+#define TAG_LISTEN (SERVER_CLIENTS)
+#define TAG_EVENT  (SERVER_CLIENTS + 1)
+
+//  ===========================================================================
+//  Drops a reference to a message, returning it to the pool (lock held).
+//  ===========================================================================
+static void msg_unref(server_t *server, msg_t *msg)
+{
+    if (atomic_fetch_sub(&msg->refs, 1) == 1)
+        server->free[server->free_count++] = msg;
+}
+
+//  ===========================================================================
+//  Closes client and releases its queue (lock held).
+//  ===========================================================================
+static void client_close(server_t *server, client_t *client)
+{
+    while (client->count > 0)
+    {
+        msg_unref(server, client->queue[client->head]);
+        client->head = (client->head + 1) % SERVER_QUEUE_MAX;
+        client->count--;
+    }
+
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, client->fd, NULL);
+    close(client->fd);
+
+    client->fd = -1;
+    client->sensors = 0;
+}
+
+//  ===========================================================================
+//  Watches client for writability only while it has a backlog (lock held).
+//  ===========================================================================
+static void client_want_out(server_t *server, client_t *client, bool want)
+{
+    struct epoll_event ev;
+
+    if (client->want_out == want) return;
+
+    ev.events = EPOLLIN | (want ? EPOLLOUT : 0);
+    ev.data.u32 = client - server->client;
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, client->fd, &ev);
+
+    client->want_out = want;
+}
+
+//  ===========================================================================
+//  Sends as much of the client's queue as the socket takes.
+//  ===========================================================================
+/*
+    Only the server thread removes messages from a queue, so the lock is
+    dropped around sendmsg() and publishers keep queueing meanwhile. The
+    messages being sent are marked so that their drop policy leaves them
+    alone.
+*/
+static void client_flush(server_t *server, client_t *client)
+{
+    struct iovec  iov[SERVER_IOV];
+    struct msghdr msg;
+    msg_t  *m;
+    size_t  sent;
+    size_t  left;
+    ssize_t ret;
+    int     n;
+    int     i;
+
+    pthread_mutex_lock(&server->lock);
+
+    while (client->count > 0)
+    {
+        n = (client->count < SERVER_IOV) ? client->count : SERVER_IOV;
+
+        for (i = 0; i < n; i++)
+        {
+            m = client->queue[(client->head + i) % SERVER_QUEUE_MAX];
+            iov[i].iov_base = &m->header;
+            iov[i].iov_len = m->size;
+        }
+        iov[0].iov_base = (uint8_t *)iov[0].iov_base + client->offset;
+        iov[0].iov_len -= client->offset;
+        client->sending = n;
+
+        pthread_mutex_unlock(&server->lock);
+
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = n;
+
+        ret = sendmsg(client->fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+
+        pthread_mutex_lock(&server->lock);
+
+        client->sending = 0;
+        if (ret < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                client_want_out(server, client, true);
+            else
+                client_close(server, client);
+            pthread_mutex_unlock(&server->lock);
+            return;
+        }
+
+        // Release whole messages sent, keep offset into a partial one.
+        sent = ret;
+        while (sent > 0)
+        {
+            m = client->queue[client->head];
+            left = m->size - client->offset;
+            if (sent < left)
+            {
+                client->offset += sent;
+                break;
+            }
+            sent -= left;
+            client->offset = 0;
+            msg_unref(server, m);
+            client->head = (client->head + 1) % SERVER_QUEUE_MAX;
+            client->count--;
+        }
+    }
+
+    client_want_out(server, client, false);
+
+    pthread_mutex_unlock(&server->lock);
+}
+
+//  ===========================================================================
+//  Queues a message to a client, applying its drop policy (lock held).
+//  ===========================================================================
+static void client_enqueue(server_t *server, client_t *client, msg_t *msg)
+{
+    int victim;
+
+    if (client->count >= client->depth)
+    {
+        // Messages being sent, or partly sent, must go out whole to keep
+        // framing.
+        victim = client->sending;
+        if (victim == 0 && client->offset > 0) victim = 1;
+
+        // Delta clients need a key frame to recover.
+        if (msg->header.repr == REPR_DELTA)
+            server->resync[msg->header.sensor] = true;
+
+        if (client->policy == DROP_NEWEST || victim >= client->count)
+        {
+            client->dropped++;
+            msg_unref(server, msg);
+            return;
+        }
+
+        victim = (client->head + victim) % SERVER_QUEUE_MAX;
+        msg_unref(server, client->queue[victim]);
+
+        // Close the gap left by the dropped message.
+        while (victim != (client->head + client->count - 1)
+                         % SERVER_QUEUE_MAX)
+        {
+            client->queue[victim] = client->queue[(victim + 1)
+                                                  % SERVER_QUEUE_MAX];
+            victim = (victim + 1) % SERVER_QUEUE_MAX;
+        }
+        client->count--;
+        client->dropped++;
+    }
+
+    client->queue[(client->head + client->count) % SERVER_QUEUE_MAX] = msg;
+    client->count++;
+}
+
+//  ===========================================================================
+//  Reads subscription requests from a client.
+//  ===========================================================================
+static void client_read(server_t *server, client_t *client)
+{
+    sub_msg_t sub;
+    ssize_t   ret;
+    int       i;
+
+    for (;;)
+    {
+        ret = recv(client->fd, client->request + client->request_len,
+                   sizeof(sub_msg_t) - client->request_len, MSG_DONTWAIT);
+
+        if (ret == 0 || (ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+        {
+            pthread_mutex_lock(&server->lock);
+            client_close(server, client);
+            pthread_mutex_unlock(&server->lock);
+            return;
+        }
+        if (ret < 0) return;
+
+        client->request_len += ret;
+        if (client->request_len < sizeof(sub_msg_t)) continue;
+        client->request_len = 0;
+
+        memcpy(&sub, client->request, sizeof(sub_msg_t));
+        if (sub.magic != SERVER_MAGIC || sub.repr >= REPR_COUNT)
+        {
+            printf("Bad subscription from client %d.\n",
+                   (int)(client - server->client));
+            pthread_mutex_lock(&server->lock);
+            client_close(server, client);
+            pthread_mutex_unlock(&server->lock);
+            return;
+        }
+
+        pthread_mutex_lock(&server->lock);
+
+        // New delta subscribers start from a key frame.
+        if (sub.repr == REPR_DELTA)
+            for (i = 0; i < SENSORS_MAX; i++)
+                if (sub.sensors & (1u << i)) server->resync[i] = true;
+
+        client->sensors = sub.sensors;
+        client->repr = sub.repr;
+        client->policy = sub.policy;
+        client->depth = sub.depth;
+        if (client->depth < 1) client->depth = 1;
+        if (client->depth > SERVER_QUEUE_MAX) client->depth = SERVER_QUEUE_MAX;
+
+        pthread_mutex_unlock(&server->lock);
+    }
+}
+
+//  ===========================================================================
+//  Accepts new clients.
+//  ===========================================================================
+static void server_accept(server_t *server)
+{
+    struct epoll_event ev;
+    client_t *client;
+    int fd;
+    int i;
+
+    while ((fd = accept4(server->listen_fd, NULL, NULL,
+                         SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+    {
+        for (i = 0; i < SERVER_CLIENTS && server->client[i].fd >= 0; i++);
+        if (i == SERVER_CLIENTS)
+        {
+            printf("Too many clients.\n");
+            close(fd);
+            continue;
+        }
+
+        // Slots are only taken and freed here, publishers just read them.
+        client = &server->client[i];
+        pthread_mutex_lock(&server->lock);
+        memset(client, 0, sizeof(client_t));
+        client->fd = fd;
+        pthread_mutex_unlock(&server->lock);
+
+        ev.events = EPOLLIN;
+        ev.data.u32 = i;
+        epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+    }
+}
+
+//  ===========================================================================
+//  Server thread.
+//  ===========================================================================
+/*
+    Only this thread opens and closes clients and sends to them, so it
+    reads client descriptors without the lock and takes it only to change
+    a client or its queue, never across a system call that may copy data.
+*/
+static void *server_thread(void *arg)
+{
+    server_t *server = arg;
+    struct epoll_event ev[SERVER_CLIENTS + 2];
+    client_t *client;
+    uint64_t  count;
+    int n;
+    int i;
+
+    while (!atomic_load(&server->stop))
+    {
+        n = epoll_wait(server->epoll_fd, ev, SERVER_CLIENTS + 2, 100);
+
+        for (i = 0; i < n; i++)
+        {
+            if (ev[i].data.u32 == TAG_LISTEN)
+            {
+                server_accept(server);
+            }
+            else if (ev[i].data.u32 == TAG_EVENT)
+            {
+                if (read(server->event_fd, &count, sizeof(count)) < 0)
+                    continue;
+
+                for (client = server->client;
+                     client < server->client + SERVER_CLIENTS; client++)
+                    if (client->fd >= 0 && !client->want_out)
+                        client_flush(server, client);
+            }
+            else
+            {
+                client = &server->client[ev[i].data.u32];
+                if (client->fd < 0) continue;
+
+                if (ev[i].events & (EPOLLHUP | EPOLLERR))
+                {
+                    pthread_mutex_lock(&server->lock);
+                    client_close(server, client);
+                    pthread_mutex_unlock(&server->lock);
+                }
+                else if (ev[i].events & EPOLLIN)
+                    client_read(server, client);
+
+                if (client->fd >= 0 && (ev[i].events & EPOLLOUT))
+                    client_flush(server, client);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+//  ===========================================================================
+//  Creates listening socket and starts server thread.
+//  ===========================================================================
+int server_init(server_t *server, const char *path)
+{
+    struct sockaddr_un addr;
+    struct epoll_event ev;
+    pthread_mutexattr_t attr;
+    int i;
+
+    memset(server, 0, sizeof(server_t));
+    strncpy(server->path, path, sizeof(server->path) - 1);
+    server->listen_fd = server->epoll_fd = server->event_fd = -1;
+    for (i = 0; i < SERVER_CLIENTS; i++) server->client[i].fd = -1;
+    for (i = 0; i < SENSORS_MAX; i++)
+        delta_init(&server->delta[i], DELTA_THRESHOLD, DELTA_INTERVAL);
+    atomic_init(&server->stop, false);
+
+    // Publishers may run SCHED_FIFO, so a lower priority holder is boosted.
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT);
+    pthread_mutex_init(&server->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    server->msgs = malloc(SERVER_MSGS * sizeof(msg_t));
+    if (server->msgs == NULL)
+    {
+        printf("Error allocating server buffers.\n");
+        return -1;
+    }
+    for (i = 0; i < SERVER_MSGS; i++) server->free[i] = &server->msgs[i];
+    server->free_count = SERVER_MSGS;
+
+    server->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK
+                                      | SOCK_CLOEXEC, 0);
+    if (server->listen_fd < 0)
+    {
+        perror("Server socket");
+        server_free(server);
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    unlink(path);
+
+    if (bind(server->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(server->listen_fd, SERVER_CLIENTS) < 0)
+    {
+        perror("Server bind");
+        server_free(server);
+        return -1;
+    }
+
+    server->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    server->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (server->epoll_fd < 0 || server->event_fd < 0)
+    {
+        perror("Server events");
+        server_free(server);
+        return -1;
+    }
+
+    ev.events = EPOLLIN;
+    ev.data.u32 = TAG_LISTEN;
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, server->listen_fd, &ev);
+    ev.data.u32 = TAG_EVENT;
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, server->event_fd, &ev);
+
+    if (pthread_create(&server->thread, NULL, server_thread, server) != 0)
+    {
+        printf("Error starting server thread.\n");
+        server_free(server);
+        return -1;
+    }
+
+    return 0;
+}
+
+//  ===========================================================================
+//  Encodes scan in a representation.
+//  ===========================================================================
+/*
+    raw, if not NULL, is the same scan as sent by the sensor. scan may
+    then have only its header filled in if repr is REPR_RAW and raw is
+    3 character encoded.
+*/
+static void msg_fill(server_t *server, msg_t *msg, uint8_t id, uint8_t repr,
+                     uint32_t seq, const spec_t *spec, const scan_t *scan,
+                     const raw_t *raw)
+{
+    static __thread points_t points;
+    size_t size;
+    int    i;
+
+    switch (repr)
+    {
+    case REPR_RAW:
+        size = scan->count * SCAN_ENC_LEN;
+        if (raw && raw->enc == SCAN_ENC_LEN)
+        {
+            memcpy(msg->payload, raw->payload, size);
+            break;
+        }
+        for (i = 0; i < scan->count; i++)
+            encode(scan->range[i], (char *)&msg->payload[i * SCAN_ENC_LEN],
+                   SCAN_ENC_LEN);
+        break;
+    case REPR_DECODED:
+        size = scan->count * sizeof(uint16_t);
+        memcpy(msg->payload, scan->range, size);
+        break;
+    case REPR_DELTA:
+        size = delta_encode(&server->delta[id], scan, msg->payload);
+        break;
+    default:
+        scan_to_points(spec, scan, &points);
+        size = scan->count * sizeof(float);
+        memcpy(msg->payload, points.x, size);
+        memcpy(msg->payload + size, points.y, size);
+        size *= 2;
+        break;
+    }
+
+    msg->header.magic = SERVER_MAGIC;
+    msg->header.size = size;
+    msg->header.host_time = scan->host_time;
+    msg->header.time = scan->time;
+    msg->header.first = scan->first;
+    msg->header.cluster = scan->cluster;
+    msg->header.count = scan->count;
+    msg->header.sensor = id;
+    msg->header.repr = repr;
+    msg->header.seq = seq;
+    msg->size = sizeof(frame_msg_t) + size;
+}
+
+//  ===========================================================================
+//  Queues scan to every client subscribed to the sensor.
+//  ===========================================================================
+/*
+    Either scan or raw is given. raw is decoded here if needed.
+*/
+static void publish(server_t *server, uint8_t id, const spec_t *spec,
+                    const scan_t *scan, raw_t *raw)
+{
+    static __thread scan_t decoded;
+    msg_t    *msg[REPR_COUNT] = {NULL};
+    client_t *client;
+    uint64_t  one = 1;
+    uint32_t  seq;
+    int       refs[REPR_COUNT] = {0};
+    int       repr;
+
+    if (id >= SENSORS_MAX) return;
+
+    // Work out which representations are wanted and take buffers.
+    pthread_mutex_lock(&server->lock);
+
+    seq = server->seq[id]++;
+
+    for (client = server->client;
+         client < server->client + SERVER_CLIENTS; client++)
+        if (client->fd >= 0 && (client->sensors & (1u << id)))
+            refs[client->repr]++;
+
+    for (repr = 0; repr < REPR_COUNT; repr++)
+        if (refs[repr] > 0 && server->free_count > 0)
+            msg[repr] = server->free[--server->free_count];
+
+    // Frames nobody took break the delta chain, so restart it.
+    if (msg[REPR_DELTA] == NULL || server->resync[id])
+    {
+        delta_reset(&server->delta[id]);
+        server->resync[id] = false;
+    }
+
+    pthread_mutex_unlock(&server->lock);
+
+    // Decode only for representations that cannot use the raw payload.
+    if (raw)
+    {
+        for (repr = 0; repr < REPR_COUNT; repr++)
+            if (msg[repr] && (repr != REPR_RAW || raw->enc != SCAN_ENC_LEN))
+                break;
+
+        if (repr < REPR_COUNT)
+        {
+            raw_to_scan(raw, &decoded);
+        }
+        else
+        {
+            decoded.host_time = raw->host_time;
+            decoded.time = raw->time;
+            decoded.first = raw->first;
+            decoded.cluster = raw->cluster;
+            decoded.count = raw->count;
+        }
+        scan = &decoded;
+    }
+
+    // Encode outside the lock.
+    for (repr = 0; repr < REPR_COUNT; repr++)
+    {
+        if (msg[repr] == NULL) continue;
+        msg_fill(server, msg[repr], id, repr, seq, spec, scan, raw);
+        atomic_store(&msg[repr]->refs, 1);  // Held by publisher.
+    }
+
+    pthread_mutex_lock(&server->lock);
+
+    for (client = server->client;
+         client < server->client + SERVER_CLIENTS; client++)
+    {
+        if (client->fd < 0 || !(client->sensors & (1u << id))) continue;
+
+        if (msg[client->repr] == NULL)
+        {
+            if (client->repr == REPR_DELTA) server->resync[id] = true;
+            client->dropped++;
+            continue;
+        }
+
+        atomic_fetch_add(&msg[client->repr]->refs, 1);
+        client_enqueue(server, client, msg[client->repr]);
+    }
+
+    for (repr = 0; repr < REPR_COUNT; repr++)
+        if (msg[repr] != NULL) msg_unref(server, msg[repr]);
+
+    pthread_mutex_unlock(&server->lock);
+
+    if (write(server->event_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+        perror("Server wake");
+}
+
+//  ===========================================================================
+//  Queues decoded scan to every client subscribed to the sensor.
+//  ===========================================================================
+void server_publish(server_t *server, uint8_t id, const spec_t *spec,
+                    const scan_t *scan)
+{
+    publish(server, id, spec, scan, NULL);
+}
+
+//  ===========================================================================
+//  Queues scan as sent by the sensor to every subscribed client.
+//  ===========================================================================
+void server_publish_raw(server_t *server, uint8_t id, const spec_t *spec,
+                        raw_t *raw)
+{
+    publish(server, id, spec, NULL, raw);
+}
+
+//  ===========================================================================
+//  Stops server thread and closes all clients.
+//  ===========================================================================
+void server_free(server_t *server)
+{
+    int i;
+
+    if (server->thread)
+    {
+        atomic_store(&server->stop, true);
+        pthread_join(server->thread, NULL);
+        server->thread = 0;
+    }
+
+    for (i = 0; i < SERVER_CLIENTS; i++)
+        if (server->client[i].fd >= 0)
+            client_close(server, &server->client[i]);
+
+    if (server->listen_fd >= 0)
+    {
+        close(server->listen_fd);
+        unlink(server->path);
+    }
+    if (server->epoll_fd >= 0) close(server->epoll_fd);
+    if (server->event_fd >= 0) close(server->event_fd);
+
+    free(server->msgs);
+    server->msgs = NULL;
+
+    pthread_mutex_destroy(&server->lock);
+}
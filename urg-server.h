@@ -0,0 +1,178 @@
+//  ===========================================================================
+//  Unix socket scan server for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+/*
+    Serves scans to local clients over a Unix stream socket.
+
+    Protocol:
+
+    A client connects and sends a sub_msg_t naming the sensors it wants,
+    the representation, its drop policy and queue depth. It may send
+    another at any time to change its subscription. The server then sends
+    a frame_msg_t header followed by size bytes of payload per frame.
+
+    REPR_RAW        SCIP encoded ranges, 3 characters each.
+    REPR_DECODED    Ranges as uint16_t (mm).
+    REPR_CARTESIAN  count x values then count y values as float (m).
+    REPR_DELTA      Changed beams only, see urg-delta.h.
+
+    Delta frames are encoded against the last frame sent for the sensor,
+    which is shared by all delta clients. A key frame is forced whenever a
+    client subscribes to deltas or loses one, so after a gap in seq a
+    client waits for the next DELTA_KEY frame and carries on from there.
+
+    Fan-out:
+
+    Each frame is encoded once per representation that somebody wants,
+    into a reference counted buffer from a preallocated set, and queued
+    to every subscribed client. The server thread sends queued buffers
+    with writev(). MSG_ZEROCOPY is not available on Unix sockets, so the
+    kernel copy into the socket is the only copy per client.
+
+    server_publish_raw() takes a scan as the sensor sent it (urg-raw.h).
+    REPR_RAW frames of 3 character scans are then copied as they are, and
+    the scan is only decoded if another representation is wanted.
+
+    Backpressure:
+
+    Each client has its own bounded queue. When it is full the client's
+    policy either drops its oldest queued frame or the new one. A slow
+    client only ever loses its own frames and sees them as gaps in seq.
+    Publishing never blocks on client I/O, it only queues and wakes the
+    server thread. The lock shared with the server thread is held only to
+    take buffers and to queue them, never across a send, and inherits the
+    priority of a real time publisher waiting on it.
+*/
+
+//  ===========================================================================
+
+#ifndef URG_SERVER_H
+#define URG_SERVER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "urg-multi.h"
+#include "urg-delta.h"
+#include "urg-raw.h"
+
+//  Defines. ------------------------------------------------------------------
+
+#define SERVER_PATH      "/tmp/urg-scans.sock"
+#define SERVER_MAGIC     0x53475255     // "URGS".
+#define SERVER_CLIENTS   32             // Max clients.
+#define SERVER_QUEUE_MAX 64             // Max queue depth per client.
+#define SERVER_MSGS      256            // Preallocated frame buffers.
+
+/* Representations. */
+#define REPR_RAW         0
+#define REPR_DECODED     1
+#define REPR_CARTESIAN   2
+#define REPR_DELTA       3
+#define REPR_COUNT       4
+
+/* Drop policies when a client queue is full. */
+#define DROP_OLDEST      0
+#define DROP_NEWEST      1
+
+/* Largest payload (Cartesian). */
+#define SERVER_PAYLOAD_MAX (2 * SCAN_STEPS_MAX * sizeof(float))
+
+//  Types. --------------------------------------------------------------------
+
+/* Client to server. */
+typedef struct
+{
+    uint32_t magic;
+    uint32_t sensors;       // Bit mask of sensors.
+    uint8_t  repr;          // Representation.
+    uint8_t  policy;        // Drop policy.
+    uint16_t depth;         // Queue depth.
+} sub_msg_t;
+
+/* Server to client, followed by size bytes of payload. */
+typedef struct
+{
+    uint32_t magic;
+    uint32_t size;          // Payload bytes.
+    uint64_t host_time;     // Host time at arrival (us, monotonic).
+    uint32_t time;          // Sensor timestamp (ms).
+    uint16_t first;         // First step.
+    uint16_t cluster;       // Steps per range.
+    uint16_t count;         // Number of ranges.
+    uint8_t  sensor;
+    uint8_t  repr;
+    uint32_t seq;           // Per sensor frame number, gaps are drops.
+} frame_msg_t;
+
+typedef struct
+{
+    atomic_int  refs;
+    size_t      size;       // Header plus payload.
+    frame_msg_t header;
+    uint8_t     payload[SERVER_PAYLOAD_MAX];
+} msg_t;
+
+typedef struct
+{
+    int       fd;           // -1 if slot unused.
+    uint32_t  sensors;      // Subscribed sensors, 0 until subscribed.
+    uint8_t   repr;
+    uint8_t   policy;
+    uint16_t  depth;
+    msg_t    *queue[SERVER_QUEUE_MAX];
+    uint16_t  head;         // Oldest queued message.
+    uint16_t  count;        // Queued messages.
+    uint16_t  sending;      // Oldest messages being sent without the lock.
+    size_t    offset;       // Bytes of oldest message already sent.
+    uint32_t  dropped;      // Frames dropped for this client.
+    bool      want_out;     // Waiting for socket to become writable.
+    uint8_t   request[sizeof(sub_msg_t)];
+    size_t    request_len;
+} client_t;
+
+typedef struct
+{
+    char            path[108];
+    int             listen_fd;
+    int             epoll_fd;
+    int             event_fd;   // Wakes server thread after publishing.
+    pthread_t       thread;
+    pthread_mutex_t lock;       // Protects clients and message pool.
+    atomic_bool     stop;
+    client_t        client[SERVER_CLIENTS];
+    uint32_t        seq[SENSORS_MAX];   // Next frame number per sensor.
+    delta_t         delta[SENSORS_MAX]; // Delta encoder per sensor.
+    bool            resync[SENSORS_MAX];// Next delta must be a key frame.
+    msg_t          *msgs;
+    msg_t          *free[SERVER_MSGS];
+    int             free_count;
+} server_t;
+
+//  Functions. ----------------------------------------------------------------
+
+int server_init(server_t *server, const char *path);
+void server_publish(server_t *server, uint8_t id, const spec_t *spec,
+                    const scan_t *scan);
+void server_publish_raw(server_t *server, uint8_t id, const spec_t *spec,
+                        raw_t *raw);
+void server_free(server_t *server);
+
+#endif
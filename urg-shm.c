@@ -0,0 +1,317 @@
+//  ===========================================================================
+//  Shared memory scan publication for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+#include "urg-shm.h"
+#include <unistd.h>	    // UNIX standard function definitions.
+#include <stdio.h>	    // Standard Input/Output definitions.
+#include <stdlib.h>
+#include <string.h>	    // String function definitions.
+#include <stdint.h>	    // Standard type definitions.
+#include <stddef.h>     // Offset definitions.
+#include <errno.h>      // Error number definitions.
+#include <fcntl.h>	    // File control definitions.
+#include <sys/mman.h>   // Memory mapping.
+#include <sys/stat.h>   // File modes.
+
+//  ===========================================================================
+//  Rounds size up to a cache line.
+//  ===========================================================================
+static size_t shm_align(size_t size)
+{
+    return (size + SHM_ALIGN - 1) & ~(size_t)(SHM_ALIGN - 1);
+}
+
+//  ===========================================================================
+//  Returns slot holding frame.
+//  ===========================================================================
+static shm_slot_t *shm_slot(shm_t *shm, uint64_t frame)
+{
+    return (shm_slot_t *)(shm->slots
+                          + (frame % shm->header->slots)
+                          * shm->header->slot_size);
+}
+
+//  ===========================================================================
+//  Creates shared memory ring for publishing scans.
+//  ===========================================================================
+int shm_publisher_open(shm_t *shm, const char *name, uint32_t slots,
+                       const spec_t *spec, uint32_t sensors)
+{
+    shm_header_t *header;
+    size_t header_size;
+    size_t slot_size;
+    void  *map;
+
+    if (slots == 0 || sensors > SENSORS_MAX) return -1;
+
+    header_size = shm_align(sizeof(shm_header_t));
+    slot_size = shm_align(sizeof(shm_slot_t));
+
+    memset(shm, 0, sizeof(shm_t));
+    strncpy(shm->name, name, sizeof(shm->name) - 1);
+    shm->writer = true;
+    shm->size = header_size + slots * slot_size;
+
+    /*
+        A segment left by a previous publisher may still be mapped by
+        readers, and shrinking it would fault them. Unlinking leaves their
+        mapping intact, and a fresh segment is created under the name.
+    */
+    if (shm_unlink(name) < 0 && errno != ENOENT)
+        perror("Shared memory unlink");
+
+    shm->fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (shm->fd < 0)
+    {
+        perror("Shared memory open");
+        return -1;
+    }
+
+    if (ftruncate(shm->fd, shm->size) < 0)
+    {
+        perror("Shared memory size");
+        shm_close(shm);
+        return -1;
+    }
+
+    map = mmap(NULL, shm->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+               shm->fd, 0);
+    if (map == MAP_FAILED)
+    {
+        perror("Shared memory map");
+        shm_close(shm);
+        return -1;
+    }
+
+    header = map;
+    shm->header = header;
+    shm->slots = (uint8_t *)map + header_size;
+
+    // Segment is zero filled, so every slot starts empty and even.
+    header->version = SHM_VERSION;
+    header->header_size = header_size;
+    header->slot_size = slot_size;
+    header->slots = slots;
+    header->sensors = sensors;
+    memcpy(header->spec, spec, sensors * sizeof(spec_t));
+    atomic_store(&header->head, 0);
+
+    // Readers check the magic last.
+    atomic_thread_fence(memory_order_release);
+    header->magic = SHM_MAGIC;
+
+    return 0;
+}
+
+//  ===========================================================================
+//  Enables delta mode on a publisher.
+//  ===========================================================================
+int shm_publish_delta(shm_t *shm, uint16_t threshold, uint16_t interval)
+{
+    uint32_t i;
+
+    if (!shm->writer) return -1;
+
+    if (shm->delta == NULL &&
+        posix_memalign((void **)&shm->delta, SHM_ALIGN,
+                       SENSORS_MAX * sizeof(delta_t)) != 0)
+    {
+        shm->delta = NULL;
+        printf("Error allocating delta encoders.\n");
+        return -1;
+    }
+
+    for (i = 0; i < SENSORS_MAX; i++)
+        delta_init(&shm->delta[i], threshold, interval);
+
+    return 0;
+}
+
+//  ===========================================================================
+//  Publishes a scan from a sensor.
+//  ===========================================================================
+void shm_publish(shm_t *shm, uint8_t sensor, const scan_t *scan)
+{
+    shm_slot_t *slot;
+    uint64_t    frame;
+
+    frame = atomic_load_explicit(&shm->header->head,
+                                 memory_order_relaxed) + 1;
+    slot = shm_slot(shm, frame);
+
+    atomic_fetch_add_explicit(&slot->seq, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    slot->sensor = sensor;
+    slot->frame = frame;
+
+    if (shm->delta != NULL && sensor < SENSORS_MAX)
+    {
+        delta_compare(&shm->delta[sensor], scan, &slot->delta,
+                      slot->changed);
+    }
+    else
+    {
+        slot->delta.flags = DELTA_KEY;
+        slot->delta.changed = scan->count;
+    }
+
+    // Only the used part of the range array is copied.
+    memcpy(&slot->scan, scan, offsetof(scan_t, range)
+                            + scan->count * sizeof(scan->range[0]));
+
+    atomic_fetch_add_explicit(&slot->seq, 1, memory_order_release);
+    atomic_store_explicit(&shm->header->head, frame, memory_order_release);
+}
+
+//  ===========================================================================
+//  Maps an existing ring read-only.
+//  ===========================================================================
+int shm_reader_open(shm_t *shm, const char *name)
+{
+    shm_header_t *header;
+    struct stat st;
+    void *map;
+
+    memset(shm, 0, sizeof(shm_t));
+    strncpy(shm->name, name, sizeof(shm->name) - 1);
+
+    shm->fd = shm_open(name, O_RDONLY, 0);
+    if (shm->fd < 0)
+    {
+        perror("Shared memory open");
+        return -1;
+    }
+
+    if (fstat(shm->fd, &st) < 0 || st.st_size < (off_t)sizeof(shm_header_t))
+    {
+        printf("Shared memory %s not ready.\n", name);
+        shm_close(shm);
+        return -1;
+    }
+    shm->size = st.st_size;
+
+    map = mmap(NULL, shm->size, PROT_READ, MAP_SHARED, shm->fd, 0);
+    if (map == MAP_FAILED)
+    {
+        perror("Shared memory map");
+        shm_close(shm);
+        return -1;
+    }
+
+    header = map;
+    shm->header = header;
+
+    if (header->magic != SHM_MAGIC || header->version != SHM_VERSION ||
+        header->slot_size < (uint32_t)sizeof(shm_slot_t) ||
+        header->header_size + (size_t)header->slots * header->slot_size
+            > shm->size)
+    {
+        printf("Shared memory %s has unknown layout.\n", name);
+        shm_close(shm);
+        return -1;
+    }
+    atomic_thread_fence(memory_order_acquire);
+
+    shm->slots = (uint8_t *)map + header->header_size;
+    shm->next = atomic_load(&header->head) + 1;
+
+    return 0;
+}
+
+//  ===========================================================================
+//  Returns slot of reader's next frame in place, NULL if none yet.
+//  ===========================================================================
+const shm_slot_t *shm_begin(shm_t *shm, unsigned int *seq)
+{
+    const shm_slot_t *slot;
+    uint64_t head;
+
+    head = atomic_load_explicit(&shm->header->head, memory_order_acquire);
+    if (shm->next > head) return NULL;
+
+    // Skip frames already overwritten.
+    if (head - shm->next >= shm->header->slots)
+    {
+        shm->lost += head - shm->header->slots + 1 - shm->next;
+        shm->next = head - shm->header->slots + 1;
+    }
+
+    slot = shm_slot(shm, shm->next);
+    *seq = atomic_load_explicit(&((shm_slot_t *)slot)->seq,
+                                memory_order_acquire);
+
+    return (slot);
+}
+
+//  ===========================================================================
+//  Returns true if slot was not rewritten while being read, and moves on.
+//  ===========================================================================
+bool shm_end(shm_t *shm, const shm_slot_t *slot, unsigned int seq)
+{
+    bool valid;
+
+    atomic_thread_fence(memory_order_acquire);
+    valid = !(seq & 1) && slot->frame == shm->next &&
+            atomic_load_explicit(&((shm_slot_t *)slot)->seq,
+                                 memory_order_relaxed) == seq;
+
+    if (!valid) shm->lost++;
+    shm->next++;
+
+    return (valid);
+}
+
+//  ===========================================================================
+//  Copies reader's next frame, returns 1 if read, 0 if none, -1 if lost.
+//  ===========================================================================
+int shm_read(shm_t *shm, uint8_t *sensor, scan_t *scan)
+{
+    const shm_slot_t *slot;
+    unsigned int seq;
+    uint16_t count;
+
+    slot = shm_begin(shm, &seq);
+    if (slot == NULL) return 0;
+
+    *sensor = slot->sensor;
+    count = slot->scan.count;
+    if (count > SCAN_STEPS_MAX) count = SCAN_STEPS_MAX;
+    memcpy(scan, &slot->scan, offsetof(scan_t, range)
+                            + count * sizeof(scan->range[0]));
+    scan->count = count;
+
+    return shm_end(shm, slot, seq) ? 1 : -1;
+}
+
+//  ===========================================================================
+//  Unmaps ring. The publisher also removes it.
+//  ===========================================================================
+void shm_close(shm_t *shm)
+{
+    if (shm->header != NULL) munmap(shm->header, shm->size);
+    if (shm->fd >= 0) close(shm->fd);
+    if (shm->writer) shm_unlink(shm->name);
+
+    free(shm->delta);
+    shm->delta = NULL;
+
+    shm->header = NULL;
+    shm->slots = NULL;
+    shm->fd = -1;
+}
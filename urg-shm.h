@@ -0,0 +1,127 @@
+//  ===========================================================================
+//  Shared memory scan publication for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+/*
+    Publishes decoded scans to other processes through a POSIX shared
+    memory ring, so a single process owns the sensors and any number of
+    local readers see every frame without copies or system calls.
+
+    Layout:
+
+    ,-------------------------------------------------,
+    | Header | Slot 0 | Slot 1 | ... | Slot (slots-1) |
+    '-------------------------------------------------'
+
+    The header describes the layout (magic, version, slot size and count)
+    and the spec of each sensor, followed by the number of the last frame
+    published. Frame n is written to slot n % slots. Both header and slots
+    start on a cache line.
+
+    Seqlock:
+
+    Each slot has a sequence count that the writer makes odd before it
+    starts writing and even again when it has finished. A reader notes the
+    count, reads the slot in place, then checks the count is unchanged and
+    the slot still holds the frame it wanted. If not, the writer lapped it
+    and the frame is lost. The writer never waits for readers.
+
+    Readers map the segment read-only and poll the head frame number.
+
+    A publisher replaces any segment of the same name rather than resizing
+    it, so readers of the old one keep a valid mapping, see no further
+    frames and have to reopen by name.
+
+    Delta mode:
+
+    If the publisher enables delta mode each slot also carries the header
+    and changed beam bitmap from urg-delta.h, compared against the last
+    frame from the same sensor. The full scan is still in the slot, so a
+    reader that forwards or logs changes can take just the flagged beams
+    from it. After a lost frame a reader waits for the next DELTA_KEY
+    frame. Without delta mode every frame is flagged DELTA_KEY.
+*/
+
+//  ===========================================================================
+
+#ifndef URG_SHM_H
+#define URG_SHM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "urg-multi.h"
+#include "urg-delta.h"
+
+//  Defines. ------------------------------------------------------------------
+
+#define SHM_MAGIC   0x314d48534752550aULL   // "\nURGSHM1".
+#define SHM_VERSION 3       // Slot layout, 3 from SCAN_STEPS_MAX 1081.
+#define SHM_ALIGN   64      // Cache line.
+#define SHM_NAME    "/urg-scans"
+
+//  Types. --------------------------------------------------------------------
+
+typedef struct
+{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t header_size;   // Offset of first slot.
+    uint32_t slot_size;     // Distance between slots.
+    uint32_t slots;         // Number of slots.
+    uint32_t sensors;       // Number of sensors.
+    spec_t   spec[SENSORS_MAX];
+    _Alignas(SHM_ALIGN) atomic_uint_fast64_t head; // Last frame, 0 if none.
+} shm_header_t;
+
+typedef struct
+{
+    atomic_uint seq;        // Odd while being written.
+    uint8_t  sensor;        // Source sensor.
+    uint64_t frame;         // Frame number held.
+    delta_hdr_t delta;      // Delta flags and changed beam count.
+    uint8_t  changed[DELTA_BYTES];  // Changed beam bitmap in delta mode.
+    scan_t   scan;
+} shm_slot_t;
+
+typedef struct
+{
+    char          name[64];
+    int           fd;
+    size_t        size;
+    bool          writer;
+    shm_header_t *header;
+    uint8_t      *slots;
+    uint64_t      next;     // Reader's next frame.
+    uint64_t      lost;     // Reader's frames overwritten before read.
+    delta_t      *delta;    // Publisher's encoders per sensor, NULL if off.
+} shm_t;
+
+//  Functions. ----------------------------------------------------------------
+
+int shm_publisher_open(shm_t *shm, const char *name, uint32_t slots,
+                       const spec_t *spec, uint32_t sensors);
+int shm_publish_delta(shm_t *shm, uint16_t threshold, uint16_t interval);
+void shm_publish(shm_t *shm, uint8_t sensor, const scan_t *scan);
+int shm_reader_open(shm_t *shm, const char *name);
+const shm_slot_t *shm_begin(shm_t *shm, unsigned int *seq);
+bool shm_end(shm_t *shm, const shm_slot_t *slot, unsigned int seq);
+int shm_read(shm_t *shm, uint8_t *sensor, scan_t *scan);
+void shm_close(shm_t *shm);
+
+#endif
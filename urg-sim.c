@@ -0,0 +1,523 @@
+//  ===========================================================================
+//  Sensor simulator for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+#include "urg-sim.h"
+#include <unistd.h>	    // UNIX standard function definitions.
+#include <stdio.h>	    // Standard Input/Output definitions.
+#include <stdlib.h>
+#include <string.h>	    // String function definitions.
+#include <stdint.h>	    // Standard type definitions.
+#include <errno.h>      // Error numbers.
+#include <fcntl.h>	    // File control definitions.
+#include <poll.h>       // Polling.
+#include <math.h>       // Maths definitions.
+#include <time.h>       // Clock definitions.
+#include <termios.h>    // Terminal control definitions.
+
+//  Defines. ------------------------------------------------------------------
+
+/* URG-04LX-UG01 specification, as given by PP. */
+#define SIM_DMIN        20
+#define SIM_DMAX        5600
+#define SIM_ARES        1024
+#define SIM_AMIN        44
+#define SIM_AMAX        725
+#define SIM_AFRT        384
+
+//  ===========================================================================
+//  Returns SCIP sum of data.
+//  ===========================================================================
+static char sim_sum(const char *data, int len)
+{
+    unsigned int val = 0;
+    int i;
+
+    for (i = 0; i < len; i++) val += (uint8_t)data[i];
+
+    return (char)((val & 0x3f) + 0x30);
+}
+
+//  ===========================================================================
+//  Returns value of len decimal digits, -1 if any are not digits.
+//  ===========================================================================
+static int sim_dec(const char *data, int len)
+{
+    int val = 0;
+    int i;
+
+    for (i = 0; i < len; i++)
+    {
+        if (data[i] < '0' || data[i] > '9') return -1;
+        val = val * 10 + (data[i] - '0');
+    }
+
+    return (val);
+}
+
+//  ===========================================================================
+//  Appends to output, false if it does not fit.
+//  ===========================================================================
+static bool sim_put(sim_t *sim, const char *data, int len)
+{
+    // Move any unwritten output to the front first.
+    if (sim->out_pos > 0)
+    {
+        memmove(sim->out, &sim->out[sim->out_pos],
+                sim->out_len - sim->out_pos);
+        sim->out_len -= sim->out_pos;
+        sim->out_pos = 0;
+    }
+
+    if (sim->out_len + len > SIM_OUT_MAX) return false;
+
+    memcpy(&sim->out[sim->out_len], data, len);
+    sim->out_len += len;
+
+    return true;
+}
+
+//  ===========================================================================
+//  Appends data, its sum and LF.
+//  ===========================================================================
+static void sim_line(sim_t *sim, const char *data, int len)
+{
+    char end[2];
+
+    end[0] = sim_sum(data, len);
+    end[1] = STRING_LF;
+
+    sim_put(sim, data, len);
+    sim_put(sim, end, 2);
+}
+
+//  ===========================================================================
+//  Appends an information line, KEY:value;sum.
+//  ===========================================================================
+static void sim_info(sim_t *sim, const char *data)
+{
+    int  len = strlen(data);
+    char end[3];
+
+    end[0] = ';';
+    end[1] = sim_sum(data, len);
+    end[2] = STRING_LF;
+
+    sim_put(sim, data, len);
+    sim_put(sim, end, 3);
+}
+
+//  ===========================================================================
+//  Writes as much output as the terminal (or the pace) allows.
+//  ===========================================================================
+static void sim_flush(sim_t *sim, uint64_t now)
+{
+    int size;
+    int len;
+
+    while (sim->out_pos < sim->out_len)
+    {
+        size = sim->out_len - sim->out_pos;
+
+        if (sim->pace)
+        {
+            if (now < sim->next_chunk) return;
+            if (size > sim->chunk) size = sim->chunk;
+        }
+
+        // Stamped first, the reader may finish before write() returns.
+        if (size == sim->out_len - sim->out_pos)
+            atomic_store(&sim->sent, host_time());
+
+        len = write(sim->master, &sim->out[sim->out_pos], size);
+        if (len <= 0) break;
+        sim->out_pos += len;
+
+        if (sim->pace)
+        {
+            sim->next_chunk = now + (uint64_t)len * 1000000 / sim->pace;
+            break;
+        }
+    }
+
+    if (sim->out_pos == sim->out_len) sim->out_pos = sim->out_len = 0;
+}
+
+//  ===========================================================================
+//  Appends a scan reply with the given echo (NULL if sent) and status.
+//  ===========================================================================
+static void sim_scan(sim_t *sim, const char *echo, const char *status)
+{
+    char   data[SCAN_STEPS_MAX * SCAN_ENC_LEN];
+    char   line[SCAN_TIME_LEN];
+    uint32_t r;
+    int    size;
+    int    len;
+    int    i;
+
+    sim->time = host_time() / 1000;
+
+    if (echo)
+    {
+        sim_put(sim, echo, strlen(echo));
+        sim_put(sim, LF, 1);
+    }
+    sim_line(sim, status, 2);
+    encode(sim->time & 0xffffff, line, SCAN_TIME_LEN);
+    sim_line(sim, line, SCAN_TIME_LEN);
+
+    for (i = 0; i < sim->count; i++)
+    {
+        // Up to +/- 8 mm of noise.
+        sim->noise ^= sim->noise << 13;
+        sim->noise ^= sim->noise >> 17;
+        sim->noise ^= sim->noise << 5;
+        r = sim->room[sim->first + i * sim->cluster] + (sim->noise & 15) - 8;
+
+        encode(r, &data[i * sim->enc], sim->enc);
+    }
+
+    size = sim->count * sim->enc;
+
+    for (i = 0; i < size; i += SCAN_LINE_LEN)
+    {
+        len = size - i;
+        if (len > SCAN_LINE_LEN) len = SCAN_LINE_LEN;
+        sim_line(sim, &data[i], len);
+    }
+
+    sim_put(sim, LF, 1);
+}
+
+//  ===========================================================================
+//  Handles one command line.
+//  ===========================================================================
+static void sim_command(sim_t *sim, const char *cmd, int len)
+{
+    char info[80];
+    char time[SCAN_TIME_LEN + 1];
+    int  first, last, cluster;
+
+    if (len < 2) return;
+
+    // Every reply starts with the echo.
+    sim_put(sim, cmd, len);
+    sim_put(sim, LF, 1);
+
+    if ((cmd[0] == 'M' || cmd[0] == 'G') && (cmd[1] == 'D' || cmd[1] == 'S'))
+    {
+        first = (len >= 12) ? sim_dec(&cmd[2], 4) : -1;
+        last = (len >= 12) ? sim_dec(&cmd[6], 4) : -1;
+        cluster = (len >= 12) ? sim_dec(&cmd[10], 2) : -1;
+        if (cluster == 0) cluster = 1;
+
+        if (first < SIM_AMIN || last > SIM_AMAX || first > last ||
+            cluster < 0 || (cmd[0] == 'M' && len < 15))
+        {
+            sim_line(sim, "0E", 2);
+            sim_put(sim, LF, 1);
+            return;
+        }
+
+        sim->first = first;
+        sim->cluster = cluster;
+        sim->count = (last - first + cluster) / cluster;
+        sim->enc = (cmd[1] == 'S') ? 2 : SCAN_ENC_LEN;
+        sim->laser = true;
+
+        if (cmd[0] == 'G')
+        {
+            sim_scan(sim, NULL, "00");
+            atomic_fetch_add(&sim->scans, 1);
+            return;
+        }
+
+        memcpy(sim->echo, cmd, len);
+        sim->echo[len] = STRING_NULL;
+        sim->scanning = true;
+        sim_line(sim, "00", 2);
+        sim_put(sim, LF, 1);
+        return;
+    }
+
+    if (strncmp(cmd, CMD_SET_LASER_ON, 2) == 0)
+    {
+        sim->laser = true;
+        sim_line(sim, "00", 2);
+    }
+    else if (strncmp(cmd, CMD_SET_LASER_OFF, 2) == 0)
+    {
+        sim->laser = false;
+        sim->scanning = false;
+        sim_line(sim, "00", 2);
+    }
+    else if (strncmp(cmd, CMD_SET_MOTOR_SPEED, 2) == 0)
+    {
+        sim_line(sim, "00", 2);
+    }
+    else if (strncmp(cmd, CMD_GET_VERSION, 2) == 0)
+    {
+        sim_line(sim, "00", 2);
+        sim_info(sim, "VEND:Hokuyo Automatic Co.,Ltd.");
+        sim_info(sim, "PROD:SOKUIKI Sensor URG-04LX-UG01");
+        sim_info(sim, "FIRM:3.4.03(17/Dec./2012)");
+        sim_info(sim, "PROT:SCIP 2.0");
+        sim_info(sim, "SERI:H0000000");
+    }
+    else if (strncmp(cmd, CMD_GET_SPEC, 2) == 0)
+    {
+        sim_line(sim, "00", 2);
+        sim_info(sim, "MODL:URG-04LX-UG01(Simple-URG)");
+        sprintf(info, "DMIN:%d", SIM_DMIN);
+        sim_info(sim, info);
+        sprintf(info, "DMAX:%d", SIM_DMAX);
+        sim_info(sim, info);
+        sprintf(info, "ARES:%d", SIM_ARES);
+        sim_info(sim, info);
+        sprintf(info, "AMIN:%d", SIM_AMIN);
+        sim_info(sim, info);
+        sprintf(info, "AMAX:%d", SIM_AMAX);
+        sim_info(sim, info);
+        sprintf(info, "AFRT:%d", SIM_AFRT);
+        sim_info(sim, info);
+        sim_info(sim, "SCAN:600");
+    }
+    else if (strncmp(cmd, CMD_GET_RUN_STATE, 2) == 0)
+    {
+        encode((host_time() / 1000) & 0xffffff, time, SCAN_TIME_LEN);
+        time[SCAN_TIME_LEN] = STRING_NULL;
+
+        sim_line(sim, "00", 2);
+        sim_info(sim, "MODL:URG-04LX-UG01(Simple-URG)");
+        sim_info(sim, sim->laser ? "LASR:ON" : "LASR:OFF");
+        sprintf(info, "SCSP:%s(%d[rpm])",
+                atomic_load(&sim->rpm) == 600 ? "Initial" : "Changed",
+                atomic_load(&sim->rpm));
+        sim_info(sim, info);
+        sim_info(sim, "MESM:Measuring by Normal Mode");
+        sim_info(sim, "SBPS:USB only");
+        sprintf(info, "TIME:%s", time);
+        sim_info(sim, info);
+        sim_info(sim, atomic_load(&sim->fault) ? "STAT:Motor error."
+                                               : "STAT:Sensor works well.");
+    }
+    else
+    {
+        sim_line(sim, "0E", 2);
+    }
+
+    sim_put(sim, LF, 1);
+}
+
+//  ===========================================================================
+//  Gathers command lines from the host.
+//  ===========================================================================
+static void sim_input(sim_t *sim)
+{
+    char buffer[256];
+    int  len;
+    int  i;
+
+    len = read(sim->master, buffer, sizeof(buffer));
+
+    for (i = 0; i < len; i++)
+    {
+        if (buffer[i] == STRING_LF || buffer[i] == STRING_CR)
+        {
+            sim_command(sim, sim->cmd, sim->cmd_len);
+            sim->cmd_len = 0;
+        }
+        else if (sim->cmd_len < SIM_CMD_MAX - 1)
+        {
+            sim->cmd[sim->cmd_len++] = buffer[i];
+        }
+    }
+}
+
+//  ===========================================================================
+//  Simulator thread.
+//  ===========================================================================
+static void *sim_thread(void *arg)
+{
+    sim_t *sim = arg;
+    struct pollfd pfd;
+    struct timespec ts;
+    uint64_t period;
+    uint64_t next;
+    uint64_t now;
+    uint64_t wait;
+    bool     pending;
+
+    period = 1000000 / sim->rate_hz;
+    next = host_time();
+
+    while (!atomic_load(&sim->stop))
+    {
+        now = host_time();
+
+        if (sim->scanning && now >= next)
+        {
+            if (sim->out_pos < sim->out_len)
+            {
+                atomic_fetch_add(&sim->missed, 1);
+            }
+            else
+            {
+                sim_scan(sim, sim->echo, "99");
+                atomic_fetch_add(&sim->scans, 1);
+            }
+
+            next += period;
+            if (next < now) next = now + period;
+        }
+
+        sim_flush(sim, now);
+
+        // Wake for the next scan, or now and then to check for stop.
+        wait = sim->scanning ? (next > now ? next - now : 0) : 100000;
+        if (wait > 100000) wait = 100000;
+
+        // Paced output waits for its next chunk rather than POLLOUT.
+        pending = sim->out_pos < sim->out_len;
+        if (pending && sim->pace)
+        {
+            if (sim->next_chunk <= now) wait = 0;
+            else if (sim->next_chunk - now < wait)
+                wait = sim->next_chunk - now;
+            pending = false;
+        }
+
+        ts.tv_sec = 0;
+        ts.tv_nsec = wait * 1000;
+
+        pfd.fd = sim->master;
+        pfd.events = POLLIN | (pending ? POLLOUT : 0);
+        pfd.revents = 0;
+
+        if (ppoll(&pfd, 1, &ts, NULL) > 0 && (pfd.revents & POLLIN))
+            sim_input(sim);
+    }
+
+    return NULL;
+}
+
+//  ===========================================================================
+//  Works out noise free ranges for a 4 m x 3 m room.
+//  ===========================================================================
+static void sim_room(sim_t *sim)
+{
+    float angle;
+    float c, s;
+    float t, t_min;
+    int   i;
+
+    for (i = 0; i < SCAN_STEPS_MAX; i++)
+    {
+        angle = (i - SIM_AFRT) * 2.0f * M_PI / SIM_ARES;
+        c = cosf(angle);
+        s = sinf(angle);
+
+        // Walls at x = -1, 3 and y = -1, 2.
+        t_min = INFINITY;
+        if (c > 0 && (t = 3.0f / c) < t_min) t_min = t;
+        if (c < 0 && (t = -1.0f / c) < t_min) t_min = t;
+        if (s > 0 && (t = 2.0f / s) < t_min) t_min = t;
+        if (s < 0 && (t = -1.0f / s) < t_min) t_min = t;
+
+        sim->room[i] = t_min * 1000.0f;
+    }
+}
+
+//  ===========================================================================
+//  Creates pseudo terminal and starts simulator.
+//  ===========================================================================
+int sim_open(sim_t *sim, int rate_hz)
+{
+    struct termios settings;
+    int err;
+
+    memset(sim, 0, sizeof(sim_t));
+    sim->slave = -1;
+    sim->rate_hz = (rate_hz > 0) ? rate_hz : SIM_RATE;
+    sim->noise = 0x2545f491;
+    atomic_store(&sim->rpm, 600);
+    sim_room(sim);
+
+    sim->master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (sim->master < 0)
+    {
+        perror("posix_openpt");
+        return -1;
+    }
+
+    if (grantpt(sim->master) < 0 || unlockpt(sim->master) < 0 ||
+        ptsname_r(sim->master, sim->path, sizeof(sim->path)) != 0)
+    {
+        perror("Pseudo terminal");
+        close(sim->master);
+        return -1;
+    }
+
+    // Raw, so nothing is echoed or translated on the way through.
+    sim->slave = open(sim->path, O_RDWR | O_NOCTTY);
+    if (sim->slave < 0 || tcgetattr(sim->slave, &settings) < 0)
+    {
+        perror("Open pseudo terminal");
+        if (sim->slave >= 0) close(sim->slave);
+        close(sim->master);
+        return -1;
+    }
+
+    cfmakeraw(&settings);
+    tcsetattr(sim->slave, TCSANOW, &settings);
+    fcntl(sim->master, F_SETFL, fcntl(sim->master, F_GETFL) | O_NONBLOCK);
+
+    err = pthread_create(&sim->thread, NULL, sim_thread, sim);
+    if (err != 0)
+    {
+        printf("Error creating simulator thread.\n");
+        close(sim->slave);
+        close(sim->master);
+        return -1;
+    }
+
+    return 0;
+}
+
+//  ===========================================================================
+//  Limits output to rate bytes/s in chunks, like a USB or serial link.
+//  ===========================================================================
+/*
+    Call before sending commands. Rate 0 writes every reply at once.
+*/
+void sim_pace(sim_t *sim, uint32_t rate, int chunk)
+{
+    sim->chunk = (chunk > 0) ? chunk : SIM_CHUNK;
+    sim->pace = rate;
+}
+
+//  ===========================================================================
+//  Stops simulator and closes pseudo terminal.
+//  ===========================================================================
+void sim_close(sim_t *sim)
+{
+    atomic_store(&sim->stop, true);
+    pthread_join(sim->thread, NULL);
+
+    close(sim->slave);
+    close(sim->master);
+}
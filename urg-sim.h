@@ -0,0 +1,114 @@
+//  ===========================================================================
+//  Sensor simulator for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+/*
+    Pretends to be a sensor on a pseudo terminal so the drivers can be run
+    and benchmarked without hardware. Open sim->path as the serial port.
+
+    Commands:
+
+    MD, MS      Continuous scans at rate_hz until QT. Only the "00" (for
+                ever) scan count is supported.
+    GD, GS      One scan.
+    BM, QT      Laser on and off.
+    CR          Motor speed, accepted and ignored.
+    VV, PP, II  Canned replies for an URG-04LX-UG01. II reports rpm and,
+                while fault is set, a fault in STAT, so monitors can be
+                tested by changing them while the simulator runs.
+
+    Anything else is answered with status "0E". Ranges describe a fixed
+    room with a little noise, and scans are written with one write() each
+    to keep the simulator's own cost low. Like the real sensor it does not
+    wait for a slow host: a scan due while the last is still being written
+    is skipped and counted in missed.
+
+    Pacing:
+
+    By default a reply is written at once. sim_pace() instead writes it in
+    chunks at a given byte rate, e.g. 64 byte USB packets, so readers see
+    data arrive the way it does from a real link. sent holds the host time
+    the last write of a reply started, so a reader can work out its own
+    latency.
+*/
+
+//  ===========================================================================
+
+#ifndef URG_SIM_H
+#define URG_SIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "urg-multi.h"
+
+//  Defines. ------------------------------------------------------------------
+
+#define SIM_RATE        10      // Scans per second (URG-04LX).
+#define SIM_CMD_MAX     64      // Longest command line.
+#define SIM_OUT_MAX     4096    // Largest reply.
+#define SIM_CHUNK       64      // Paced write size (USB packet).
+
+//  Types. --------------------------------------------------------------------
+
+typedef struct
+{
+    int      master;            // Sensor side of the pseudo terminal.
+    int      slave;             // Held open so the port never hangs up.
+    char     path[64];          // Device for the driver to open.
+    int      rate_hz;
+    pthread_t thread;
+    atomic_bool stop;
+
+    // Simulator thread.
+    bool     laser;
+    bool     scanning;          // MD/MS running.
+    char     echo[SIM_CMD_MAX]; // Echo of running MD/MS.
+    int      first;             // Scan requested.
+    int      count;
+    int      cluster;
+    int      enc;
+    char     cmd[SIM_CMD_MAX];  // Command being received.
+    int      cmd_len;
+    uint32_t time;              // Sensor time (ms).
+    uint32_t noise;             // Random state.
+    uint16_t room[SCAN_STEPS_MAX];  // Noise free ranges.
+    char     out[SIM_OUT_MAX];  // Reply being written.
+    int      out_len;
+    int      out_pos;
+    uint32_t pace;              // Output bytes/s, 0 for unpaced.
+    int      chunk;             // Paced write size.
+    uint64_t next_chunk;        // Host time of next paced write.
+
+    // Statistics.
+    atomic_uint_fast64_t scans; // Scans written.
+    atomic_uint_fast64_t missed;// Scans skipped, host not reading.
+    atomic_uint_fast64_t sent;  // Host time last reply was written.
+
+    // Reported by II.
+    atomic_int  rpm;            // Motor speed.
+    atomic_bool fault;          // Diagnostic reports a fault.
+} sim_t;
+
+//  Functions. ----------------------------------------------------------------
+
+int sim_open(sim_t *sim, int rate_hz);
+void sim_pace(sim_t *sim, uint32_t rate, int chunk);
+void sim_close(sim_t *sim);
+
+#endif
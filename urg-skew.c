@@ -0,0 +1,114 @@
+//  ===========================================================================
+//  Motion de-skew for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+#include "urg-skew.h"
+#include <stdio.h>	    // Standard Input/Output definitions.
+#include <stdint.h>	    // Standard type definitions.
+#include <math.h>       // Maths definitions.
+
+//  ===========================================================================
+//  Initialises de-skew stage.
+//  ===========================================================================
+void skew_init(skew_t *skew, pose_source_t source, void *arg,
+               uint32_t latency)
+{
+    skew->source = source;
+    skew->arg = arg;
+    skew->latency = latency;
+}
+
+//  ===========================================================================
+//  Assigns a timestamp and sweep weight to each beam.
+//  ===========================================================================
+void skew_stamp(skew_t *skew, const timing_t *timing, const scan_t *scan)
+{
+    uint64_t last;
+    float    beam_time;
+    float    sweep;
+    int      n;
+    int      i;
+
+    if (scan->count == 0) return;
+
+    n = scan->count - 1;
+    last = scan->host_time - skew->latency;
+    beam_time = scan->cluster * timing->step_time;
+    sweep = (n > 0) ? n * beam_time : 1.0f;
+
+    for (i = 0; i <= n; i++)
+    {
+        skew->stamp[i] = last - (uint64_t)((n - i) * beam_time);
+        skew->weight[i] = (n - i) * beam_time / sweep;
+    }
+}
+
+//  ===========================================================================
+//  Transforms points into the sensor frame at the time of the last beam.
+//  ===========================================================================
+int skew_correct(skew_t *skew, const timing_t *timing, const scan_t *scan,
+                 points_t *points)
+{
+    pose_t start;
+    pose_t end;
+    float  dx, dy, dtheta;
+    float  c, s;
+    int    err;
+    int    i;
+
+    float * restrict x = points->x;
+    float * restrict y = points->y;
+    const float * restrict w = skew->weight;
+
+    if (scan->count == 0) return 0;
+
+    skew_stamp(skew, timing, scan);
+
+    if (skew->source == NULL) return 0;
+
+    err = skew->source(skew->stamp[0], &start, skew->arg);
+    if (err < 0) return (err);
+    err = skew->source(skew->stamp[scan->count - 1], &end, skew->arg);
+    if (err < 0) return (err);
+
+    // Start pose relative to end pose.
+    c = cosf(end.theta);
+    s = sinf(end.theta);
+    dx =  c * (start.x - end.x) + s * (start.y - end.y);
+    dy = -s * (start.x - end.x) + c * (start.y - end.y);
+    dtheta = remainderf(start.theta - end.theta, 2.0f * M_PI);
+
+    /*
+        Rotation within a sweep is small so sin and cos are expanded as
+        polynomials, which keeps the loop free of library calls and lets it
+        vectorise. NAN points stay NAN.
+    */
+    for (i = 0; i < scan->count; i++)
+    {
+        float a  = w[i] * dtheta;
+        float a2 = a * a;
+        float ca = 1.0f - a2 * (0.5f - a2 * (1.0f / 24.0f));
+        float sa = a * (1.0f - a2 * (1.0f / 6.0f));
+        float px = x[i];
+        float py = y[i];
+
+        x[i] = ca * px - sa * py + w[i] * dx;
+        y[i] = sa * px + ca * py + w[i] * dy;
+    }
+
+    return 0;
+}
@@ -0,0 +1,69 @@
+//  ===========================================================================
+//  Motion de-skew for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+/*
+    A scan takes around 100 ms so on a moving platform each beam is observed
+    from a different pose.
+
+    Timestamps:
+
+    The host time of a scan is taken when the last line arrives. The last
+    beam is assumed to be observed a fixed latency before that and each
+    earlier beam one step time (from the timing model) per step before that.
+
+    t(i) = host_time - latency - (count - 1 - i) * cluster * step_time
+
+    De-skew:
+
+    The pose source is queried at the first and last beam times and the
+    motion between them is interpolated linearly across the sweep. Each
+    point is transformed into the sensor frame at the time of the last beam
+    so the result looks like an instantaneous scan taken at that time.
+*/
+
+//  ===========================================================================
+
+#ifndef URG_SKEW_H
+#define URG_SKEW_H
+
+#include <stdint.h>
+#include "urg-multi.h"
+
+//  Types. --------------------------------------------------------------------
+
+/* Returns pose at a given host time (us, monotonic), 0 on success. */
+typedef int (*pose_source_t)(uint64_t time, pose_t *pose, void *arg);
+
+typedef struct
+{
+    pose_source_t source;           // Odometry or pose callback.
+    void    *arg;                   // Callback argument.
+    uint32_t latency;               // Last beam to arrival (us).
+    uint64_t stamp[SCAN_STEPS_MAX]; // Per-beam timestamps (us, monotonic).
+    float    weight[SCAN_STEPS_MAX];// Fraction of sweep left after beam.
+} skew_t;
+
+//  Functions. ----------------------------------------------------------------
+
+void skew_init(skew_t *skew, pose_source_t source, void *arg,
+               uint32_t latency);
+void skew_stamp(skew_t *skew, const timing_t *timing, const scan_t *scan);
+int skew_correct(skew_t *skew, const timing_t *timing, const scan_t *scan,
+                 points_t *points);
+
+#endif
@@ -0,0 +1,410 @@
+//  ===========================================================================
+//  Multi-sensor frame synchronisation for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+#include "urg-sync.h"
+#include <stdio.h>	    // Standard Input/Output definitions.
+#include <stdlib.h>
+#include <string.h>	    // String function definitions.
+#include <stdint.h>	    // Standard type definitions.
+#include <errno.h>      // Error number definitions.
+#include <time.h>
+
+#define SYNC_MASK (SYNC_QUEUE - 1)
+
+//  ===========================================================================
+//  Initialises a synchroniser.
+//  ===========================================================================
+/*
+    wait_time is only used by SYNC_WAIT, 0 for SYNC_WAIT_TIME.
+*/
+int sync_init(sync_t *sync, int policy, uint32_t wait_time)
+{
+    if (policy < SYNC_NEAREST || policy > SYNC_WAIT)
+    {
+        printf("Unknown sync policy %d.\n", policy);
+        return -1;
+    }
+
+    memset(sync, 0, sizeof(sync_t));
+
+    sync->policy = policy;
+    sync->wait_time = wait_time ? wait_time : SYNC_WAIT_TIME;
+
+    if (sem_init(&sync->ready, 0, 0) < 0)
+    {
+        perror("sem_init");
+        return -1;
+    }
+
+    return 0;
+}
+
+//  ===========================================================================
+//  Adds a sensor whose frames come from pool (or NULL), returns its id.
+//  ===========================================================================
+/*
+    Add every sensor before pushing frames.
+*/
+int sync_add_sensor(sync_t *sync, pool_t *pool)
+{
+    int id = atomic_load(&sync->sensors);
+
+    if (id >= SENSORS_MAX) return -1;
+
+    sync->queue[id].pool = pool;
+    atomic_store(&sync->sensors, id + 1);
+
+    return (id);
+}
+
+//  ===========================================================================
+//  Returns a frame to its pool.
+//  ===========================================================================
+static void sync_put(sync_queue_t *queue, scan_t *scan)
+{
+    if (scan != NULL && queue->pool != NULL) pool_put(queue->pool, scan);
+}
+
+//  ===========================================================================
+//  Hands a frame to the consumer. Sensor's thread only.
+//  ===========================================================================
+/*
+    Takes ownership of the frame. Returns -1 if the ring was full and the
+    frame was returned to its pool.
+*/
+int sync_push(sync_t *sync, int id, scan_t *scan)
+{
+    sync_queue_t *queue;
+    unsigned int  head;
+
+    if (id < 0 || id >= atomic_load(&sync->sensors)) return -1;
+
+    queue = &sync->queue[id];
+    head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+
+    if (head - atomic_load_explicit(&queue->tail, memory_order_acquire) >=
+        SYNC_QUEUE)
+    {
+        atomic_fetch_add_explicit(&queue->overflow, 1, memory_order_relaxed);
+        sync_put(queue, scan);
+        return -1;
+    }
+
+    queue->slot[head & SYNC_MASK] = scan;
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+    sem_post(&sync->ready);
+
+    return 0;
+}
+
+//  ===========================================================================
+//  Returns host time of the n'th queued frame.
+//  ===========================================================================
+#define SYNC_TIME(queue, tail, n) \
+    ((queue)->slot[((tail) + (n)) & SYNC_MASK]->host_time)
+
+//  ===========================================================================
+//  Returns index of the queued frame nearest a time.
+//  ===========================================================================
+static int sync_nearest(sync_queue_t *queue, unsigned int tail, int queued,
+                        uint64_t time)
+{
+    uint64_t t;
+    uint64_t diff;
+    uint64_t best = UINT64_MAX;
+    int      nearest = 0;
+    int      i;
+
+    for (i = 0; i < queued; i++)
+    {
+        t = SYNC_TIME(queue, tail, i);
+        diff = (t > time) ? t - time : time - t;
+        if (diff >= best) break;        // Frames are in time order.
+        best = diff;
+        nearest = i;
+    }
+
+    return (nearest);
+}
+
+//  ===========================================================================
+//  Takes the n'th queued frame, dropping those before it.
+//  ===========================================================================
+static scan_t *sync_take(sync_queue_t *queue, unsigned int tail, int n)
+{
+    scan_t *scan = queue->slot[(tail + n) & SYNC_MASK];
+    int     i;
+
+    for (i = 0; i < n; i++)
+    {
+        sync_put(queue, queue->slot[(tail + i) & SYNC_MASK]);
+        queue->dropped++;
+    }
+
+    atomic_store_explicit(&queue->tail, tail + n + 1, memory_order_release);
+
+    return (scan);
+}
+
+//  ===========================================================================
+//  Drops all but the newest keep queued frames.
+//  ===========================================================================
+static void sync_trim(sync_queue_t *queue, unsigned int *tail, int *queued,
+                      int keep)
+{
+    while (*queued > keep)
+    {
+        sync_put(queue, queue->slot[(*tail)++ & SYNC_MASK]);
+        queue->dropped++;
+        (*queued)--;
+    }
+
+    atomic_store_explicit(&queue->tail, *tail, memory_order_release);
+}
+
+//  ===========================================================================
+//  Forms a group if the policy allows one now, returns true if it did.
+//  ===========================================================================
+/*
+    Sets *deadline to when a partial group will be due, or 0.
+*/
+static bool sync_group(sync_t *sync, sync_group_t *group, uint64_t now,
+                       uint64_t *deadline)
+{
+    sync_queue_t *queue;
+    unsigned int  tail[SENSORS_MAX];
+    int      queued[SENSORS_MAX];
+    int      sensors = atomic_load(&sync->sensors);
+    int      present = 0;
+    uint64_t oldest = UINT64_MAX;       // Oldest queued frame.
+    uint64_t reached = UINT64_MAX;      // Newest frame of slowest sensor.
+    uint64_t ref;
+    uint64_t t;
+    uint64_t first;
+    uint64_t last;
+    int      n;
+    int      i;
+
+    *deadline = 0;
+
+    for (i = 0; i < sensors; i++)
+    {
+        queue = &sync->queue[i];
+        tail[i] = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+        queued[i] = atomic_load_explicit(&queue->head, memory_order_acquire)
+                  - tail[i];
+        if (queued[i] == 0) continue;
+
+        sync_trim(queue, &tail[i], &queued[i],
+                  sync->policy == SYNC_LATEST ? 1 : SYNC_KEEP);
+
+        present++;
+        t = SYNC_TIME(queue, tail[i], 0);
+        if (t < oldest) oldest = t;
+        t = SYNC_TIME(queue, tail[i], queued[i] - 1);
+        if (t < reached) reached = t;
+    }
+
+    if (present == 0) return false;
+
+    if (present < sensors)
+    {
+        if (sync->policy != SYNC_WAIT) return false;
+        if (now < oldest + sync->wait_time)
+        {
+            *deadline = oldest + sync->wait_time;
+            return false;
+        }
+        ref = oldest;
+    }
+    else
+        ref = reached;
+
+    memset(group, 0, sizeof(sync_group_t));
+    first = UINT64_MAX;
+    last = 0;
+
+    for (i = 0; i < sensors; i++)
+    {
+        if (queued[i] == 0) continue;
+        queue = &sync->queue[i];
+
+        if (sync->policy == SYNC_LATEST)
+            n = queued[i] - 1;
+        else
+            n = sync_nearest(queue, tail[i], queued[i], ref);
+
+        // A partial group only takes frames within the wait of its oldest.
+        t = SYNC_TIME(queue, tail[i], n);
+        if (present < sensors && t > ref + sync->wait_time) continue;
+
+        group->scan[i] = sync_take(queue, tail[i], n);
+        group->mask |= 1 << i;
+        if (t < first) first = t;
+        if (t > last) last = t;
+    }
+
+    group->host_time = last;
+    group->skew = last - first;
+    group->wait = now - first;
+
+    sync->groups++;
+    if (present < sensors) sync->partial++;
+    rt_hist_add(&sync->skew, group->skew / SYNC_HIST_UNIT);
+    rt_hist_add(&sync->wait, group->wait / SYNC_HIST_UNIT);
+
+    return true;
+}
+
+//  ===========================================================================
+//  Waits up to timeout (us) for the next group. Consumer thread only.
+//  ===========================================================================
+/*
+    Returns 0 with a group, -1 on timeout or after sync_stop(). A partial
+    group is returned when due even if the timeout is later.
+*/
+int sync_next(sync_t *sync, sync_group_t *group, uint32_t timeout)
+{
+    struct timespec ts;
+    uint64_t now = host_time();
+    uint64_t end = now + timeout;
+    uint64_t deadline;
+    uint64_t until;
+
+    for (;;)
+    {
+        if (atomic_load(&sync->stop)) return -1;
+        if (sync_group(sync, group, now, &deadline)) return 0;
+        if (now >= end) return -1;
+
+        // Semaphore waits are on the realtime clock.
+        until = (deadline && deadline < end) ? deadline : end;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec += (until - now) / 1000000;
+        ts.tv_nsec += ((until - now) % 1000000) * 1000;
+        if (ts.tv_nsec >= 1000000000)
+        {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000;
+        }
+
+        while (sem_timedwait(&sync->ready, &ts) < 0 && errno == EINTR);
+        now = host_time();
+    }
+}
+
+//  ===========================================================================
+//  Returns a group's frames to their pools.
+//  ===========================================================================
+void sync_release(sync_t *sync, sync_group_t *group)
+{
+    int i;
+
+    for (i = 0; i < SENSORS_MAX; i++)
+    {
+        if (group->scan[i] == NULL) continue;
+        sync_put(&sync->queue[i], group->scan[i]);
+        group->scan[i] = NULL;
+    }
+
+    group->mask = 0;
+}
+
+//  ===========================================================================
+//  Wakes the consumer and makes sync_next() return -1.
+//  ===========================================================================
+void sync_stop(sync_t *sync)
+{
+    atomic_store(&sync->stop, true);
+    sem_post(&sync->ready);
+}
+
+//  ===========================================================================
+//  Prints one histogram.
+//  ===========================================================================
+/*
+    A percentile in the overflow bucket is only known to be beyond the
+    range, so it is printed as ">range".
+*/
+static void sync_hist_print(const char *name, const rt_hist_t *hist)
+{
+    static const double p[] = {0.5, 0.99};
+    static const char  *label[] = {"p50", "p99"};
+    uint64_t value;
+    int      i;
+
+    if (hist->count == 0) return;
+
+    printf("%-8s mean %llu us", name,
+           (unsigned long long)(hist->sum * SYNC_HIST_UNIT / hist->count));
+
+    for (i = 0; i < 2; i++)
+    {
+        value = rt_hist_percentile(hist, p[i]);
+        printf(", %s %s%llu", label[i], (value >= RT_HIST_MAX) ? ">" : "",
+               (unsigned long long)(value * SYNC_HIST_UNIT));
+    }
+
+    printf(", max %llu us.\n",
+           (unsigned long long)(hist->max * SYNC_HIST_UNIT));
+}
+
+//  ===========================================================================
+//  Prints group statistics.
+//  ===========================================================================
+void sync_report(sync_t *sync)
+{
+    static const char *policy[] = {"nearest", "latest", "wait"};
+    sync_queue_t *queue;
+    int i;
+
+    printf("Sync     %s, %u groups, %u partial.\n", policy[sync->policy],
+           sync->groups, sync->partial);
+    sync_hist_print("Skew", &sync->skew);
+    sync_hist_print("Wait", &sync->wait);
+
+    for (i = 0; i < atomic_load(&sync->sensors); i++)
+    {
+        queue = &sync->queue[i];
+        printf("Sensor %d %u frames, %u dropped, %u overflowed.\n", i,
+               atomic_load(&queue->head), queue->dropped,
+               atomic_load(&queue->overflow));
+    }
+}
+
+//  ===========================================================================
+//  Returns queued frames to their pools. Producers must have stopped.
+//  ===========================================================================
+void sync_free(sync_t *sync)
+{
+    sync_queue_t *queue;
+    unsigned int  tail;
+    int i;
+
+    for (i = 0; i < atomic_load(&sync->sensors); i++)
+    {
+        queue = &sync->queue[i];
+        tail = atomic_load(&queue->tail);
+        while (tail != atomic_load(&queue->head))
+            sync_put(queue, queue->slot[tail++ & SYNC_MASK]);
+        atomic_store(&queue->tail, tail);
+    }
+
+    atomic_store(&sync->sensors, 0);
+    sem_destroy(&sync->ready);
+}
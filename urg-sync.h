@@ -0,0 +1,141 @@
+//  ===========================================================================
+//  Multi-sensor frame synchronisation for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+/*
+    Groups frames from free running sensors into matched sets by host time,
+    so a consumer sees one frame per sensor per group.
+
+    Queues:
+
+    Each sensor has a preallocated ring of SYNC_QUEUE frame pointers with a
+    single producer, the sensor's thread, and a single consumer, the thread
+    calling sync_next(). Handing over a frame is a store and a semaphore
+    post, with no lock shared between sensors. While a group waits for a
+    sensor the consumer keeps only the newest SYNC_KEEP frames of the
+    others (one for SYNC_LATEST), so the ring only fills if the consumer
+    itself stops. A frame pushed to a full ring is returned to its pool
+    and counted as an overflow.
+
+    Policies:
+
+    SYNC_NEAREST    Waits until every sensor has a frame, then takes the
+                    time the slowest sensor has reached and picks each
+                    sensor's frame nearest to it. Least skew. Newer frames
+                    are kept for the next group.
+    SYNC_LATEST     Waits until every sensor has a frame, then takes each
+                    sensor's newest. Least age, but skew can reach a scan
+                    period.
+    SYNC_WAIT       As SYNC_NEAREST, but a group is emitted anyway once its
+                    oldest frame has waited for the wait time. Sensors with
+                    no frame within the wait time of it are left out of the
+                    group, so a slow or lost sensor delays the group by at
+                    most that long. Free running sensors can be up to a scan
+                    period apart, so a wait shorter than that splits
+                    groups that would have completed.
+
+    Frames passed over by a group are returned to their pool and counted as
+    dropped. Frames in a group belong to the caller until sync_release().
+
+    Statistics:
+
+    Each group records its skew, the spread of its frames' host times, and
+    its wait, how long its oldest frame was queued. Both are kept in
+    urg-rt.h histograms in SYNC_HIST_UNIT steps, which covers ten scan
+    periods at 10 Hz, and sync_report() prints their percentiles. A
+    percentile beyond the range is printed as ">1000000".
+*/
+
+//  ===========================================================================
+
+#ifndef URG_SYNC_H
+#define URG_SYNC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <semaphore.h>
+#include "urg-multi.h"
+#include "urg-pool.h"
+#include "urg-rt.h"
+
+//  Defines. ------------------------------------------------------------------
+
+#define SYNC_QUEUE      8       // Frames queued per sensor, a power of 2.
+#define SYNC_KEEP       4       // Frames kept while waiting for a group.
+#define SYNC_ALIGN      64      // Cache line.
+#define SYNC_WAIT_TIME  100000  // Default wait for SYNC_WAIT (us).
+#define SYNC_HIST_UNIT  100     // Histogram step (us), 1 s range.
+
+/* Policies. */
+#define SYNC_NEAREST    0
+#define SYNC_LATEST     1
+#define SYNC_WAIT       2
+
+//  Types. --------------------------------------------------------------------
+
+typedef struct
+{
+    uint64_t host_time;             // Newest frame time in the group (us).
+    uint32_t skew;                  // Spread of frame times (us).
+    uint32_t wait;                  // Time oldest frame was queued (us).
+    uint32_t mask;                  // Sensors in the group, bit per id.
+    scan_t  *scan[SENSORS_MAX];     // NULL if not in the group.
+} sync_group_t;
+
+typedef struct
+{
+    // Producer.
+    _Alignas(SYNC_ALIGN) atomic_uint head;  // Frames pushed.
+    atomic_uint overflow;                   // Frames pushed to a full ring.
+
+    // Consumer.
+    _Alignas(SYNC_ALIGN) atomic_uint tail;  // Frames taken or dropped.
+    uint32_t dropped;                       // Frames passed over.
+
+    scan_t  *slot[SYNC_QUEUE];
+    pool_t  *pool;                          // Pool to return frames to.
+} sync_queue_t;
+
+typedef struct
+{
+    sync_queue_t queue[SENSORS_MAX];
+    atomic_int sensors;             // Number of sensors added.
+    int        policy;
+    uint32_t   wait_time;           // SYNC_WAIT wait (us).
+    sem_t      ready;               // Posted with each frame.
+    atomic_bool stop;
+
+    // Statistics.
+    uint32_t   groups;
+    uint32_t   partial;             // Groups missing a sensor.
+    rt_hist_t  skew;                // SYNC_HIST_UNIT steps.
+    rt_hist_t  wait;
+} sync_t;
+
+//  Functions. ----------------------------------------------------------------
+
+int sync_init(sync_t *sync, int policy, uint32_t wait_time);
+int sync_add_sensor(sync_t *sync, pool_t *pool);
+int sync_push(sync_t *sync, int id, scan_t *scan);
+int sync_next(sync_t *sync, sync_group_t *group, uint32_t timeout);
+void sync_release(sync_t *sync, sync_group_t *group);
+void sync_stop(sync_t *sync);
+void sync_report(sync_t *sync);
+void sync_free(sync_t *sync);
+
+#endif
@@ -0,0 +1,275 @@
+//  ===========================================================================
+//  Clustering and object tracking for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+#include "urg-track.h"
+#include <string.h>	    // String function definitions.
+#include <stdint.h>	    // Standard type definitions.
+#include <stdbool.h>	// Boolean definitions.
+#include <math.h>       // Maths definitions.
+
+//  ===========================================================================
+//  Initialises clustering and tracking for one sensor.
+//  ===========================================================================
+void track_init(track_t *track, float gap, float gap_ratio,
+                uint16_t min_points, float max_width, float gate)
+{
+    memset(track, 0, sizeof(track_t));
+
+    track->gap = gap;
+    track->gap_ratio = gap_ratio;
+    track->min_points = min_points;
+    track->max_width = max_width;
+    track->gate = gate;
+    track->accel = 2.0f;
+    track->noise = 0.05f;
+    track->min_hits = 3;
+    track->max_misses = 5;
+    track->next_id = 1;
+}
+
+//  ===========================================================================
+//  Closes cluster of points first..last if it passes the size checks.
+//  ===========================================================================
+static void track_close(track_t *track, const points_t *points,
+                        int first, int last)
+{
+    cluster_t *cluster;
+    float dx, dy;
+    float sx, sy;
+    int   n;
+    int   i;
+
+    n = last - first + 1;
+    if (n < track->min_points || track->clusters >= CLUSTERS_MAX) return;
+
+    dx = points->x[last] - points->x[first];
+    dy = points->y[last] - points->y[first];
+    if (dx * dx + dy * dy > track->max_width * track->max_width) return;
+
+    sx = sy = 0;
+    for (i = first; i <= last; i++)
+    {
+        sx += points->x[i];
+        sy += points->y[i];
+    }
+
+    cluster = &track->cluster[track->clusters++];
+    cluster->x = sx / n;
+    cluster->y = sy / n;
+    cluster->width = sqrtf(dx * dx + dy * dy);
+    cluster->first = first;
+    cluster->count = n;
+    cluster->track = -1;
+}
+
+//  ===========================================================================
+//  Splits ordered points into clusters, returns number found.
+//  ===========================================================================
+int track_cluster(track_t *track, const points_t *points)
+{
+    float dx, dy;
+    float range;
+    float limit;
+    int   first;
+    int   i;
+
+    track->clusters = 0;
+    first = -1;
+
+    for (i = 0; i < points->count; i++)
+    {
+        if (isnan(points->x[i]))
+        {
+            if (first >= 0) track_close(track, points, first, i - 1);
+            first = -1;
+            continue;
+        }
+
+        if (first >= 0)
+        {
+            dx = points->x[i] - points->x[i - 1];
+            dy = points->y[i] - points->y[i - 1];
+            range = sqrtf(points->x[i] * points->x[i]
+                        + points->y[i] * points->y[i]);
+            limit = track->gap + track->gap_ratio * range;
+
+            if (dx * dx + dy * dy > limit * limit)
+            {
+                track_close(track, points, first, i - 1);
+                first = i;
+            }
+        }
+        else
+        {
+            first = i;
+        }
+    }
+
+    if (first >= 0) track_close(track, points, first, points->count - 1);
+
+    return (track->clusters);
+}
+
+//  ===========================================================================
+//  Predicts one axis forward by dt.
+//  ===========================================================================
+static void track_predict(float *pos, float vel, float p[3], float dt, float q)
+{
+    float dt2 = dt * dt;
+
+    *pos += vel * dt;
+
+    // P = F P F' + Q for F = [1 dt; 0 1], white acceleration noise q.
+    p[0] += 2.0f * dt * p[1] + dt2 * p[2] + 0.25f * dt2 * dt2 * q;
+    p[1] += dt * p[2] + 0.5f * dt2 * dt * q;
+    p[2] += dt2 * q;
+}
+
+//  ===========================================================================
+//  Corrects one axis with a position measurement.
+//  ===========================================================================
+static void track_correct(float *pos, float *vel, float p[3], float z, float r)
+{
+    float s  = p[0] + r;
+    float k0 = p[0] / s;
+    float k1 = p[1] / s;
+    float e  = z - *pos;
+
+    *pos += k0 * e;
+    *vel += k1 * e;
+
+    p[2] -= k1 * p[1];
+    p[1] -= k0 * p[1];
+    p[0] -= k0 * p[0];
+}
+
+//  ===========================================================================
+//  Clusters points and updates tracks, returns number of confirmed tracks.
+//  ===========================================================================
+int track_update(track_t *track, const points_t *points, uint64_t time)
+{
+    object_t  *obj;
+    cluster_t *cluster;
+    bool  taken[TRACKS_MAX];
+    float q, r;
+    float dt;
+    float dx, dy;
+    float d2, best;
+    int   best_c, best_t;
+    int   confirmed;
+    int   c, t;
+
+    track_cluster(track, points);
+
+    dt = (track->time > 0 && time > track->time)
+       ? (time - track->time) * 1e-6f : 0;
+    track->time = time;
+    q = track->accel * track->accel;
+    r = track->noise * track->noise;
+
+    for (t = 0; t < TRACKS_MAX; t++)
+    {
+        obj = &track->track[t];
+        taken[t] = false;
+        if (obj->id == 0) continue;
+        track_predict(&obj->x, obj->vx, obj->p[0], dt, q);
+        track_predict(&obj->y, obj->vy, obj->p[1], dt, q);
+    }
+
+    /*
+        Greedy assignment, closest pair first. Cluster and track counts
+        are small so the repeated search is cheaper than sorting pairs.
+    */
+    for (;;)
+    {
+        best = track->gate * track->gate;
+        best_c = best_t = -1;
+
+        for (c = 0; c < track->clusters; c++)
+        {
+            cluster = &track->cluster[c];
+            if (cluster->track >= 0) continue;
+
+            for (t = 0; t < TRACKS_MAX; t++)
+            {
+                obj = &track->track[t];
+                if (obj->id == 0 || taken[t]) continue;
+
+                dx = cluster->x - obj->x;
+                dy = cluster->y - obj->y;
+                d2 = dx * dx + dy * dy;
+                if (d2 < best)
+                {
+                    best = d2;
+                    best_c = c;
+                    best_t = t;
+                }
+            }
+        }
+
+        if (best_c < 0) break;
+
+        cluster = &track->cluster[best_c];
+        obj = &track->track[best_t];
+        cluster->track = best_t;
+        taken[best_t] = true;
+
+        track_correct(&obj->x, &obj->vx, obj->p[0], cluster->x, r);
+        track_correct(&obj->y, &obj->vy, obj->p[1], cluster->y, r);
+        obj->hits++;
+        obj->misses = 0;
+        if (obj->hits >= track->min_hits) obj->confirmed = true;
+    }
+
+    // Remove tracks unseen for too long.
+    for (t = 0; t < TRACKS_MAX; t++)
+    {
+        obj = &track->track[t];
+        if (obj->id == 0 || taken[t]) continue;
+
+        if (++obj->misses > track->max_misses) obj->id = 0;
+    }
+
+    // Start tracks for unassigned clusters.
+    for (c = 0; c < track->clusters; c++)
+    {
+        cluster = &track->cluster[c];
+        if (cluster->track >= 0) continue;
+
+        for (t = 0; t < TRACKS_MAX && track->track[t].id != 0; t++);
+        if (t == TRACKS_MAX) break;
+
+        obj = &track->track[t];
+        memset(obj, 0, sizeof(object_t));
+        obj->id = track->next_id++;
+        if (track->next_id == 0) track->next_id = 1;
+        obj->x = cluster->x;
+        obj->y = cluster->y;
+        obj->p[0][0] = obj->p[1][0] = r;
+        obj->p[0][2] = obj->p[1][2] = 1.0f;   // Walking pace, 1 m/s.
+        obj->hits = 1;
+        obj->confirmed = (track->min_hits <= 1);
+        cluster->track = t;
+    }
+
+    confirmed = 0;
+    for (t = 0; t < TRACKS_MAX; t++)
+        if (track->track[t].id != 0) confirmed += track->track[t].confirmed;
+
+    return (confirmed);
+}
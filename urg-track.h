@@ -0,0 +1,105 @@
+//  ===========================================================================
+//  Clustering and object tracking for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+/*
+    Clusters a scan into objects and tracks them from frame to frame.
+
+    Clustering:
+
+    Neighbouring points belong to the same cluster unless they are further
+    apart than gap + gap_ratio * range, which allows for beams spreading
+    with distance. Invalid points also end a cluster. This is a single pass
+    over the ordered points. Clusters with too few points or too wide to be
+    a person or cart are discarded.
+
+    Tracking:
+
+    Each track is a constant velocity Kalman filter, with x and y filtered
+    independently. Tracks are predicted to the frame time, then clusters
+    are assigned to the nearest predicted track within the gate, closest
+    pairs first. Unassigned clusters start new tracks. A track is confirmed
+    after min_hits updates and removed after max_misses frames unseen.
+
+    All clusters and tracks are held in the track_t for one sensor.
+*/
+
+//  ===========================================================================
+
+#ifndef URG_TRACK_H
+#define URG_TRACK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "urg-multi.h"
+
+//  Defines. ------------------------------------------------------------------
+
+#define CLUSTERS_MAX 128    // Max clusters per frame.
+#define TRACKS_MAX    64    // Max tracks per sensor.
+
+//  Types. --------------------------------------------------------------------
+
+typedef struct
+{
+    float    x, y;          // Centroid (m).
+    float    width;         // Distance between end points (m).
+    uint16_t first;         // First point index.
+    uint16_t count;         // Number of points.
+    int16_t  track;         // Assigned track slot, -1 if none.
+} cluster_t;
+
+typedef struct
+{
+    uint32_t id;            // Unique track id, 0 if slot unused.
+    bool     confirmed;
+    uint16_t hits;          // Updates received.
+    uint16_t misses;        // Consecutive frames unseen.
+    float    x, y;          // Position (m).
+    float    vx, vy;        // Velocity (m/s).
+    float    p[2][3];       // Per axis covariance: pos, pos-vel, vel.
+} object_t;
+
+typedef struct
+{
+    // Clustering.
+    float     gap;          // Fixed part of break distance (m).
+    float     gap_ratio;    // Range dependent part of break distance.
+    uint16_t  min_points;   // Min points in a cluster.
+    float     max_width;    // Max cluster width (m).
+    int       clusters;
+    cluster_t cluster[CLUSTERS_MAX];
+
+    // Tracking.
+    float     gate;         // Max association distance (m).
+    float     accel;        // Process noise, acceleration (m/s^2).
+    float     noise;        // Measurement noise (m).
+    uint16_t  min_hits;     // Updates before confirming.
+    uint16_t  max_misses;   // Frames unseen before removing.
+    uint64_t  time;         // Host time of last frame (us).
+    uint32_t  next_id;
+    object_t  track[TRACKS_MAX];
+} track_t;
+
+//  Functions. ----------------------------------------------------------------
+
+void track_init(track_t *track, float gap, float gap_ratio,
+                uint16_t min_points, float max_width, float gate);
+int track_cluster(track_t *track, const points_t *points);
+int track_update(track_t *track, const points_t *points, uint64_t time);
+
+#endif
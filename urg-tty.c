@@ -0,0 +1,198 @@
+//  ===========================================================================
+//  Serial port tuning for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+#include "urg-tty.h"
+#include <unistd.h>	    // UNIX standard function definitions.
+#include <stdio.h>	    // Standard Input/Output definitions.
+#include <string.h>	    // String function definitions.
+#include <stdint.h>	    // Standard type definitions.
+#include <errno.h>      // Error numbers.
+#include <fcntl.h>	    // File control definitions.
+#include <time.h>       // Clock definitions.
+#include <sys/ioctl.h>  // Device control.
+#include <linux/serial.h>   // Serial driver flags.
+
+/* VMIN and VTIME per mode. */
+static const struct
+{
+    const char *name;
+    cc_t vmin;
+    cc_t vtime;
+} tty_modes[TTY_MODES] =
+{
+    { "byte",     1,                     0 },
+    { "line",     SCAN_LINE_LEN + 2,     1 },
+    { "block",    255,                   1 },
+    { "adaptive", 1,                     0 },
+};
+
+//  ===========================================================================
+//  Sets or clears the driver's low latency flag. -1 if not supported.
+//  ===========================================================================
+int tty_low_latency(int fd, bool on)
+{
+    struct serial_struct serial;
+
+    if (ioctl(fd, TIOCGSERIAL, &serial) < 0) return -1;
+
+    if (on) serial.flags |= ASYNC_LOW_LATENCY;
+    else    serial.flags &= ~ASYNC_LOW_LATENCY;
+
+    if (ioctl(fd, TIOCSSERIAL, &serial) < 0) return -1;
+
+    return 0;
+}
+
+//  ===========================================================================
+//  Returns name of mode.
+//  ===========================================================================
+const char *tty_mode_name(int mode)
+{
+    if (mode < 0 || mode >= TTY_MODES) return "unknown";
+
+    return tty_modes[mode].name;
+}
+
+//  ===========================================================================
+//  Configures an open port for blocking reads in the given mode.
+//  ===========================================================================
+int tty_open(tty_t *tty, int fd, int mode)
+{
+    struct serial_struct serial;
+    struct termios settings;
+    int flags;
+
+    if (mode < 0 || mode >= TTY_MODES)
+    {
+        printf("Unknown tty mode %d.\n", mode);
+        return -1;
+    }
+
+    memset(tty, 0, sizeof(tty_t));
+    tty->fd = fd;
+    tty->mode = mode;
+
+    if (tcgetattr(fd, &tty->saved) < 0)
+    {
+        perror("tcgetattr");
+        return -1;
+    }
+
+    settings = tty->saved;
+    settings.c_cc[VMIN] = tty_modes[mode].vmin;
+    settings.c_cc[VTIME] = tty_modes[mode].vtime;
+
+    if (tcsetattr(fd, TCSANOW, &settings) < 0)
+    {
+        perror("tcsetattr");
+        return -1;
+    }
+
+    flags = fcntl(fd, F_GETFL);
+    if (flags >= 0) fcntl(fd, F_SETFL, flags & ~O_NONBLOCK);
+
+    // Remember whether the flag was already set, to leave it that way.
+    if (ioctl(fd, TIOCGSERIAL, &serial) == 0)
+        tty->was_low_latency = (serial.flags & ASYNC_LOW_LATENCY) != 0;
+    tty->low_latency = (tty_low_latency(fd, true) == 0);
+
+    return 0;
+}
+
+//  ===========================================================================
+//  Sleeps for us microseconds.
+//  ===========================================================================
+static void tty_sleep(uint64_t us)
+{
+    struct timespec ts;
+
+    ts.tv_sec = us / 1000000;
+    ts.tv_nsec = (us % 1000000) * 1000;
+
+    nanosleep(&ts, NULL);
+}
+
+//  ===========================================================================
+//  Reads once, waiting first in adaptive mode, and feeds the parser.
+//  ===========================================================================
+/*
+    Returns bytes read, 0 if interrupted or -1 on error or end of file.
+*/
+int tty_read(tty_t *tty, parser_t *parser)
+{
+    float    left;
+    uint64_t wait;
+    uint64_t now;
+    int      len;
+
+    // Let all but the tail of a reply pile up, then take it in one read.
+    if (tty->mode == TTY_ADAPTIVE && tty->seen > 0 && tty->rate > 0)
+    {
+        left = tty->reply_size - tty->seen;
+
+        if (left > TTY_ADAPT_TAIL)
+        {
+            wait = (left - TTY_ADAPT_TAIL) / tty->rate;
+            if (wait > TTY_ADAPT_WAIT) wait = TTY_ADAPT_WAIT;
+            tty_sleep(wait);
+            tty->waits++;
+        }
+    }
+
+    len = read(tty->fd, tty->buffer, TTY_BUFFER_SIZE);
+    if (len < 0 && errno == EINTR) return 0;
+    if (len <= 0) return -1;
+
+    now = host_time();
+    tty->reads++;
+    tty->bytes += len;
+
+    // Only time spent inside a reply says how fast it arrives.
+    if (tty->seen > 0 && now > tty->last)
+    {
+        if (tty->rate == 0) tty->rate = (float)len / (now - tty->last);
+        tty->rate += TTY_ADAPT_WEIGHT
+                   * ((float)len / (now - tty->last) - tty->rate);
+    }
+
+    tty->seen += len;
+    tty->last = now;
+
+    parser_feed(parser, tty->buffer, len);
+
+    if (parser->scans != tty->scans)
+    {
+        if (tty->reply_size == 0) tty->reply_size = tty->seen;
+        tty->reply_size += TTY_ADAPT_WEIGHT
+                         * ((float)tty->seen - tty->reply_size);
+        tty->scans = parser->scans;
+        tty->seen = 0;
+    }
+
+    return (len);
+}
+
+//  ===========================================================================
+//  Restores the port's settings.
+//  ===========================================================================
+void tty_close(tty_t *tty)
+{
+    if (tty->low_latency && !tty->was_low_latency)
+        tty_low_latency(tty->fd, false);
+    tcsetattr(tty->fd, TCSANOW, &tty->saved);
+}
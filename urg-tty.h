@@ -0,0 +1,116 @@
+//  ===========================================================================
+//  Serial port tuning for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+/*
+    Controls how a blocking read() on the sensor port returns, trading the
+    delay before a scan is seen against the number of reads (and CPU) it
+    takes, for a reader that owns one port. serial_open() leaves VMIN and
+    VTIME at 0, which suits get_data() polling but not streaming.
+
+    Low latency flag:
+
+    tty_open() sets ASYNC_LOW_LATENCY with TIOCSSERIAL where the driver
+    supports it, so received data is pushed to the reader at once instead
+    of on the next tick. USB ACM and pseudo terminals do not implement it,
+    which is reported in low_latency and otherwise harmless.
+
+    Modes:
+
+    TTY_BYTE        VMIN 1, VTIME 0. A read returns as soon as anything has
+                    arrived, i.e. every USB packet. Lowest latency, most
+                    reads.
+    TTY_LINE        VMIN 66 (one data line with sum and LF), VTIME 1.
+    TTY_BLOCK       VMIN 255 (the largest allowed), VTIME 1.
+
+                    Both are meant to save reads by waiting for more data,
+                    but the end of a reply then waits for the 0.1 s
+                    inter-byte timer unless it happens to fill VMIN. Recent
+                    kernels also copy tty reads in 64 byte pieces and only
+                    apply VMIN to each piece, so neither actually makes
+                    reads larger than TTY_BYTE does.
+    TTY_ADAPTIVE    VMIN 1, VTIME 0, but tty_read() learns the size of a
+                    reply and the rate it arrives at. While more than
+                    TTY_ADAPT_TAIL bytes of a reply are still to come it
+                    sleeps for the time they should take before reading, so
+                    each read collects what has piled up. The tail is read
+                    as it arrives, so latency stays close to TTY_BYTE with
+                    far fewer reads. Read sizes follow the data instead of
+                    the USB packet size.
+
+    test_tty runs each mode against the simulator (urg-sim.h) paced like a
+    USB link and prints reads, CPU and latency per scan.
+*/
+
+//  ===========================================================================
+
+#ifndef URG_TTY_H
+#define URG_TTY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <termios.h>
+#include "urg-parser.h"
+
+//  Defines. ------------------------------------------------------------------
+
+/* Modes. */
+#define TTY_BYTE            0
+#define TTY_LINE            1
+#define TTY_BLOCK           2
+#define TTY_ADAPTIVE        3
+#define TTY_MODES           4
+
+#define TTY_BUFFER_SIZE     4096    // Largest read.
+#define TTY_ADAPT_TAIL      256     // Bytes left to arrive after a wait.
+#define TTY_ADAPT_WAIT      20000   // Longest wait (us).
+#define TTY_ADAPT_WEIGHT    0.125f  // Weight of a new rate or size sample.
+
+//  Types. --------------------------------------------------------------------
+
+typedef struct
+{
+    int      fd;
+    int      mode;
+    bool     low_latency;       // ASYNC_LOW_LATENCY is set.
+    bool     was_low_latency;   // And was before tty_open().
+    struct termios saved;       // Settings to restore.
+
+    // Adaptive reads.
+    float    rate;              // Bytes per us while a reply arrives.
+    float    reply_size;        // Bytes per scan reply.
+    uint32_t seen;              // Bytes of current reply so far.
+    uint32_t scans;             // Parser scans at last read.
+    uint64_t last;              // Host time of last read (us).
+
+    // Statistics.
+    uint64_t reads;
+    uint64_t bytes;
+    uint64_t waits;             // Sleeps before reads.
+
+    char     buffer[TTY_BUFFER_SIZE];
+} tty_t;
+
+//  Functions. ----------------------------------------------------------------
+
+int tty_low_latency(int fd, bool on);
+int tty_open(tty_t *tty, int fd, int mode);
+int tty_read(tty_t *tty, parser_t *parser);
+void tty_close(tty_t *tty);
+const char *tty_mode_name(int mode);
+
+#endif
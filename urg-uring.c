@@ -0,0 +1,389 @@
+//  ===========================================================================
+//  io_uring reader backend for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+/*
+    Uses the raw system calls rather than liburing so there is nothing
+    extra to install.
+
+    Every port has a fixed slice of one registered buffer and a registered
+    file slot, and a READ_FIXED is kept outstanding on it. A completion is
+    fed to the port's parser and the read is queued again at once, but only
+    submitted by the next io_uring_enter(), which also waits for the next
+    completions. Ports are switched to blocking mode because io_uring
+    completes a non-blocking read that finds nothing with -EAGAIN instead
+    of waiting for data, and terminals get VMIN 1 so a blocking read waits
+    for at least one byte rather than returning 0, which reads as end of
+    file.
+
+    Multishot reads (IORING_OP_READ_MULTISHOT, Linux 6.7) would save the
+    re-arming but need provided buffer rings; re-armed fixed reads cost the
+    same one system call per batch.
+*/
+
+//  ===========================================================================
+
+#include "urg-io.h"
+#include <unistd.h>	    // UNIX standard function definitions.
+#include <stdio.h>	    // Standard Input/Output definitions.
+#include <stdlib.h>
+#include <string.h>	    // String function definitions.
+#include <stdint.h>	    // Standard type definitions.
+#include <errno.h>      // Error numbers.
+#include <fcntl.h>	    // File control definitions.
+#include <sys/mman.h>   // Memory mapping.
+#include <sys/uio.h>    // I/O vectors.
+#include <sys/syscall.h>// System call numbers.
+#include <termios.h>    // Terminal control definitions.
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+
+//  Defines. ------------------------------------------------------------------
+
+#define URING_ENTRIES   IO_SOURCES_MAX  // One read per port at most.
+
+//  Types. --------------------------------------------------------------------
+
+typedef struct
+{
+    int       fd;
+    uint32_t  sq_mask;
+    uint32_t  cq_mask;
+    uint32_t *sq_head;
+    uint32_t *sq_tail;
+    uint32_t *sq_array;
+    uint32_t *cq_head;
+    uint32_t *cq_tail;
+    struct io_uring_sqe *sqe;
+    struct io_uring_cqe *cqe;
+    void     *sq_ring;
+    void     *cq_ring;
+    size_t    sq_ring_size;
+    size_t    cq_ring_size;
+    size_t    sqe_size;
+    uint32_t  pending;                  // Queued, not yet submitted.
+    char     *buffer;                   // IO_BUFFER_SIZE per port.
+} uring_priv_t;
+
+//  ===========================================================================
+//  System call wrappers.
+//  ===========================================================================
+static int uring_setup(unsigned entries, struct io_uring_params *params)
+{
+    return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uring_enter(int fd, unsigned submit, unsigned wait,
+                       unsigned flags, void *arg, size_t size)
+{
+    return syscall(__NR_io_uring_enter, fd, submit, wait, flags, arg, size);
+}
+
+static int uring_register(int fd, unsigned op, void *arg, unsigned count)
+{
+    return syscall(__NR_io_uring_register, fd, op, arg, count);
+}
+
+//  ===========================================================================
+//  Frees rings and buffer.
+//  ===========================================================================
+static void uring_free(io_t *io)
+{
+    uring_priv_t *priv = io->priv;
+
+    if (priv->sqe) munmap(priv->sqe, priv->sqe_size);
+    if (priv->cq_ring && priv->cq_ring != priv->sq_ring)
+        munmap(priv->cq_ring, priv->cq_ring_size);
+    if (priv->sq_ring) munmap(priv->sq_ring, priv->sq_ring_size);
+    if (priv->fd >= 0) close(priv->fd);
+
+    free(priv->buffer);
+    free(priv);
+}
+
+//  ===========================================================================
+//  Sets up ring, registered buffer and file table.
+//  ===========================================================================
+static int uring_init(io_t *io)
+{
+    struct io_uring_params params;
+    uring_priv_t *priv;
+    struct iovec iov;
+    int fds[IO_SOURCES_MAX];
+    int i;
+
+    priv = calloc(1, sizeof(uring_priv_t));
+    if (priv == NULL) return -1;
+    io->priv = priv;
+
+    memset(&params, 0, sizeof(params));
+    priv->fd = uring_setup(URING_ENTRIES, &params);
+    if (priv->fd < 0)
+    {
+        perror("io_uring_setup");
+        uring_free(io);
+        return -1;
+    }
+
+    if (!(params.features & IORING_FEAT_EXT_ARG) ||
+        !(params.features & IORING_FEAT_NODROP))
+    {
+        printf("io_uring too old for reader.\n");
+        uring_free(io);
+        return -1;
+    }
+
+    // Map rings.
+    priv->sq_ring_size = params.sq_off.array
+                       + params.sq_entries * sizeof(uint32_t);
+    priv->cq_ring_size = params.cq_off.cqes
+                       + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (priv->cq_ring_size > priv->sq_ring_size)
+            priv->sq_ring_size = priv->cq_ring_size;
+        priv->cq_ring_size = priv->sq_ring_size;
+    }
+
+    priv->sq_ring = mmap(NULL, priv->sq_ring_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, priv->fd,
+                         IORING_OFF_SQ_RING);
+    if (priv->sq_ring == MAP_FAILED) priv->sq_ring = NULL;
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+        priv->cq_ring = priv->sq_ring;
+    else
+    {
+        priv->cq_ring = mmap(NULL, priv->cq_ring_size,
+                             PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE, priv->fd,
+                             IORING_OFF_CQ_RING);
+        if (priv->cq_ring == MAP_FAILED) priv->cq_ring = NULL;
+    }
+
+    priv->sqe_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    priv->sqe = mmap(NULL, priv->sqe_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, priv->fd, IORING_OFF_SQES);
+    if (priv->sqe == MAP_FAILED) priv->sqe = NULL;
+
+    if (!priv->sq_ring || !priv->cq_ring || !priv->sqe)
+    {
+        perror("Map io_uring");
+        uring_free(io);
+        return -1;
+    }
+
+    priv->sq_head  = (uint32_t *)((char *)priv->sq_ring + params.sq_off.head);
+    priv->sq_tail  = (uint32_t *)((char *)priv->sq_ring + params.sq_off.tail);
+    priv->sq_array = (uint32_t *)((char *)priv->sq_ring + params.sq_off.array);
+    priv->sq_mask  = *(uint32_t *)((char *)priv->sq_ring
+                                   + params.sq_off.ring_mask);
+    priv->cq_head  = (uint32_t *)((char *)priv->cq_ring + params.cq_off.head);
+    priv->cq_tail  = (uint32_t *)((char *)priv->cq_ring + params.cq_off.tail);
+    priv->cq_mask  = *(uint32_t *)((char *)priv->cq_ring
+                                   + params.cq_off.ring_mask);
+    priv->cqe = (struct io_uring_cqe *)((char *)priv->cq_ring
+                                        + params.cq_off.cqes);
+
+    // One registered buffer sliced per port, so the kernel pins it once.
+    priv->buffer = aligned_alloc(4096, IO_SOURCES_MAX * IO_BUFFER_SIZE);
+    if (priv->buffer == NULL)
+    {
+        uring_free(io);
+        return -1;
+    }
+
+    iov.iov_base = priv->buffer;
+    iov.iov_len = IO_SOURCES_MAX * IO_BUFFER_SIZE;
+
+    if (uring_register(priv->fd, IORING_REGISTER_BUFFERS, &iov, 1) < 0)
+    {
+        perror("Register io_uring buffer");
+        uring_free(io);
+        return -1;
+    }
+
+    // Empty file table, filled in as ports are added.
+    for (i = 0; i < IO_SOURCES_MAX; i++) fds[i] = -1;
+
+    if (uring_register(priv->fd, IORING_REGISTER_FILES, fds,
+                       IO_SOURCES_MAX) < 0)
+    {
+        perror("Register io_uring files");
+        uring_free(io);
+        return -1;
+    }
+
+    return 0;
+}
+
+//  ===========================================================================
+//  Queues a read on a port for the next io_uring_enter().
+//  ===========================================================================
+static void uring_queue(io_t *io, int index)
+{
+    uring_priv_t *priv = io->priv;
+    struct io_uring_sqe *sqe;
+    uint32_t tail;
+
+    tail = *priv->sq_tail;
+    sqe = &priv->sqe[tail & priv->sq_mask];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ_FIXED;
+    sqe->flags = IOSQE_FIXED_FILE;
+    sqe->fd = index;
+    sqe->off = (uint64_t)-1;           // Current position, ports stream.
+    sqe->addr = (uint64_t)(uintptr_t)&priv->buffer[index * IO_BUFFER_SIZE];
+    sqe->len = IO_BUFFER_SIZE;
+    sqe->buf_index = 0;
+    sqe->user_data = index;
+
+    priv->sq_array[tail & priv->sq_mask] = tail & priv->sq_mask;
+    __atomic_store_n(priv->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    priv->pending++;
+}
+
+//  ===========================================================================
+//  Registers port and queues its first read.
+//  ===========================================================================
+static int uring_add(io_t *io, int index)
+{
+    uring_priv_t *priv = io->priv;
+    struct io_uring_files_update update;
+    struct termios settings;
+    int fd = io->fd[index];
+    int flags;
+
+    flags = fcntl(fd, F_GETFL);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags & ~O_NONBLOCK) < 0)
+    {
+        perror("Set port blocking");
+        return -1;
+    }
+
+    if (tcgetattr(fd, &settings) == 0)
+    {
+        settings.c_cc[VMIN] = 1;
+        settings.c_cc[VTIME] = 0;
+        tcsetattr(fd, TCSANOW, &settings);
+    }
+
+    memset(&update, 0, sizeof(update));
+    update.offset = index;
+    update.fds = (uint64_t)(uintptr_t)&fd;
+
+    if (uring_register(priv->fd, IORING_REGISTER_FILES_UPDATE,
+                       &update, 1) < 0)
+    {
+        perror("Register port");
+        return -1;
+    }
+
+    uring_queue(io, index);
+
+    return 0;
+}
+
+//  ===========================================================================
+//  Submits queued reads and handles completions in one system call.
+//  ===========================================================================
+static int uring_poll(io_t *io, int timeout_ms)
+{
+    uring_priv_t *priv = io->priv;
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    struct io_uring_cqe *cqe;
+    uint32_t head, tail;
+    unsigned flags;
+    int index;
+    int count;
+    int ret;
+
+    // Only wait if nothing has completed already.
+    head = *priv->cq_head;
+    tail = __atomic_load_n(priv->cq_tail, __ATOMIC_ACQUIRE);
+
+    if (head == tail || priv->pending)
+    {
+        memset(&arg, 0, sizeof(arg));
+        flags = IORING_ENTER_EXT_ARG;
+
+        if (head == tail && timeout_ms != 0)
+        {
+            flags |= IORING_ENTER_GETEVENTS;
+            if (timeout_ms > 0)
+            {
+                ts.tv_sec = timeout_ms / 1000;
+                ts.tv_nsec = (timeout_ms % 1000) * 1000000LL;
+                arg.ts = (uint64_t)(uintptr_t)&ts;
+            }
+        }
+
+        ret = uring_enter(priv->fd, priv->pending,
+                          (flags & IORING_ENTER_GETEVENTS) ? 1 : 0,
+                          flags, &arg, sizeof(arg));
+        io->syscalls++;
+
+        if (ret < 0 && errno != ETIME && errno != EINTR)
+        {
+            perror("io_uring_enter");
+            return -1;
+        }
+        if (ret > 0) priv->pending -= ret;
+        tail = __atomic_load_n(priv->cq_tail, __ATOMIC_ACQUIRE);
+    }
+
+    count = 0;
+
+    while (head != tail)
+    {
+        cqe = &priv->cqe[head & priv->cq_mask];
+        index = cqe->user_data;
+        ret = cqe->res;
+
+        if (ret > 0)
+        {
+            io_data(io, index, &priv->buffer[index * IO_BUFFER_SIZE], ret);
+            uring_queue(io, index);
+        }
+        else if (ret == -EINTR || ret == -EAGAIN)
+        {
+            uring_queue(io, index);
+        }
+        else
+        {
+            io_drop(io, index);
+        }
+
+        count++;
+        head++;
+    }
+
+    __atomic_store_n(priv->cq_head, head, __ATOMIC_RELEASE);
+
+    return (count);
+}
+
+const io_ops_t io_uring_ops =
+{
+    .name = "io_uring",
+    .init = uring_init,
+    .add  = uring_add,
+    .poll = uring_poll,
+    .free = uring_free,
+};
@@ -0,0 +1,153 @@
+//  ===========================================================================
+//  Worker threads for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+#include "urg-workers.h"
+#include <stdio.h>	    // Standard Input/Output definitions.
+#include <stdbool.h>	// Boolean definitions.
+#include <pthread.h>    // POSIX threads.
+
+//  ===========================================================================
+//  Runs tasks from current batch until none are left.
+//  ===========================================================================
+static void workers_drain(workers_t *workers)
+{
+    int task;
+
+    while ((task = atomic_fetch_add(&workers->next, 1)) < workers->tasks)
+        workers->fn(workers->arg, task);
+}
+
+//  ===========================================================================
+//  Worker thread.
+//  ===========================================================================
+static void *workers_thread(void *arg)
+{
+    workers_t   *workers = arg;
+    unsigned int batch = 0;
+
+    pthread_mutex_lock(&workers->lock);
+
+    for (;;)
+    {
+        while (!workers->stop && workers->batch == batch)
+            pthread_cond_wait(&workers->start, &workers->lock);
+
+        if (workers->stop) break;
+        batch = workers->batch;
+
+        pthread_mutex_unlock(&workers->lock);
+        workers_drain(workers);
+        pthread_mutex_lock(&workers->lock);
+
+        if (--workers->busy == 0) pthread_cond_signal(&workers->done);
+    }
+
+    pthread_mutex_unlock(&workers->lock);
+
+    return NULL;
+}
+
+//  ===========================================================================
+//  Starts worker threads. With 0 threads tasks run on the caller.
+//  ===========================================================================
+int workers_init(workers_t *workers, int threads)
+{
+    int err;
+    int i;
+
+    if (threads > WORKERS_MAX) threads = WORKERS_MAX;
+    if (threads < 0) threads = 0;
+
+    workers->threads = 0;
+    workers->batch = 0;
+    workers->busy = 0;
+    workers->stop = false;
+    workers->tasks = 0;
+    atomic_init(&workers->next, 0);
+
+    pthread_mutex_init(&workers->lock, NULL);
+    pthread_mutex_init(&workers->run, NULL);
+    pthread_cond_init(&workers->start, NULL);
+    pthread_cond_init(&workers->done, NULL);
+
+    for (i = 0; i < threads; i++)
+    {
+        err = pthread_create(&workers->thread[i], NULL, workers_thread,
+                             workers);
+        if (err != 0)
+        {
+            printf("Error starting worker thread.\n");
+            workers_free(workers);
+            return -1;
+        }
+        workers->threads++;
+    }
+
+    return 0;
+}
+
+//  ===========================================================================
+//  Runs tasks in parallel and waits for them all to finish.
+//  ===========================================================================
+void workers_run(workers_t *workers, task_t fn, void *arg, int tasks)
+{
+    // One batch at a time, so callers on other threads wait their turn.
+    pthread_mutex_lock(&workers->run);
+
+    pthread_mutex_lock(&workers->lock);
+    workers->fn = fn;
+    workers->arg = arg;
+    workers->tasks = tasks;
+    atomic_store(&workers->next, 0);
+    workers->busy = workers->threads;
+    workers->batch++;
+    pthread_cond_broadcast(&workers->start);
+    pthread_mutex_unlock(&workers->lock);
+
+    workers_drain(workers);
+
+    pthread_mutex_lock(&workers->lock);
+    while (workers->busy > 0)
+        pthread_cond_wait(&workers->done, &workers->lock);
+    pthread_mutex_unlock(&workers->lock);
+
+    pthread_mutex_unlock(&workers->run);
+}
+
+//  ===========================================================================
+//  Stops worker threads.
+//  ===========================================================================
+void workers_free(workers_t *workers)
+{
+    int i;
+
+    pthread_mutex_lock(&workers->lock);
+    workers->stop = true;
+    pthread_cond_broadcast(&workers->start);
+    pthread_mutex_unlock(&workers->lock);
+
+    for (i = 0; i < workers->threads; i++)
+        pthread_join(workers->thread[i], NULL);
+
+    workers->threads = 0;
+
+    pthread_cond_destroy(&workers->start);
+    pthread_cond_destroy(&workers->done);
+    pthread_mutex_destroy(&workers->run);
+    pthread_mutex_destroy(&workers->lock);
+}
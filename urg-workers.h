@@ -0,0 +1,73 @@
+//  ===========================================================================
+//  Worker threads for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+/*
+    A fixed set of threads for splitting a stage into parallel tasks.
+
+    workers_run() hands out tasks 0 to tasks - 1 to the threads and the
+    caller, and returns when every task has finished. Threads are created
+    once so running a batch costs a wake-up rather than a thread start.
+
+    Stages on different threads may share one pool, e.g. fusion on its
+    own thread and the grid on the acquisition thread. Their batches run
+    one after another, so one stage can wait for another's batch. A task
+    must not call workers_run() on its own pool.
+*/
+
+//  ===========================================================================
+
+#ifndef URG_WORKERS_H
+#define URG_WORKERS_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+//  Defines. ------------------------------------------------------------------
+
+#define WORKERS_MAX 16      // Max number of threads.
+
+//  Types. --------------------------------------------------------------------
+
+/* Runs a single task. */
+typedef void (*task_t)(void *arg, int task);
+
+typedef struct
+{
+    pthread_t       thread[WORKERS_MAX];
+    int             threads;    // Number of threads (excluding caller).
+    pthread_mutex_t lock;
+    pthread_mutex_t run;        // Held by workers_run() for a batch.
+    pthread_cond_t  start;      // Signalled when a batch is posted.
+    pthread_cond_t  done;       // Signalled when a batch completes.
+    unsigned int    batch;      // Batch number.
+    int             busy;       // Threads still working on batch.
+    bool            stop;
+    task_t          fn;
+    void           *arg;
+    int             tasks;
+    atomic_int      next;       // Next task to hand out.
+} workers_t;
+
+//  Functions. ----------------------------------------------------------------
+
+int workers_init(workers_t *workers, int threads);
+void workers_run(workers_t *workers, task_t fn, void *arg, int tasks);
+void workers_free(workers_t *workers);
+
+#endif
@@ -0,0 +1,283 @@
+//  ===========================================================================
+//  Zone intrusion detection for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+#include "urg-zone.h"
+#include <stdio.h>	    // Standard Input/Output definitions.
+#include <stdlib.h>
+#include <string.h>	    // String function definitions.
+#include <stdint.h>	    // Standard type definitions.
+#include <stdbool.h>	// Boolean definitions.
+#include <math.h>       // Maths definitions.
+
+//  Vector types. -------------------------------------------------------------
+
+#define ZONE_LANES 8
+
+typedef uint16_t v8u16 __attribute__((vector_size(16)));
+typedef int16_t  v8s16 __attribute__((vector_size(16)));
+
+/* Unaligned load type for the scan range array. */
+typedef uint16_t v8u16u __attribute__((vector_size(16), aligned(2)));
+
+//  ===========================================================================
+//  Initialises zone engine for a sensor spec and acquisition settings.
+//  ===========================================================================
+int zones_init(zones_t *zones, const spec_t *spec, const acq_t *acq,
+               zone_event_t event, void *arg)
+{
+    size_t size;
+    int    steps;
+    int    i;
+
+    memset(zones, 0, sizeof(zones_t));
+
+    steps = spec->step_max - spec->step_min + 1;
+
+    zones->first = spec->step_min;
+    zones->cluster = acq->cluster;
+    zones->count = (steps + acq->cluster - 1) / acq->cluster;
+    zones->stride = (zones->count + ZONE_LANES - 1) & ~(ZONE_LANES - 1);
+    zones->dist_min = spec->dist_min;
+    zones->event = event;
+    zones->arg = arg;
+
+    size = (size_t)ZONES_MAX * zones->stride * sizeof(uint16_t);
+    if (posix_memalign((void **)&zones->lo, ZONE_ALIGN, size) != 0)
+        zones->lo = NULL;
+    if (posix_memalign((void **)&zones->hi, ZONE_ALIGN, size) != 0)
+        zones->hi = NULL;
+    zones->angle = malloc(zones->count * sizeof(float));
+
+    if (zones->lo == NULL || zones->hi == NULL || zones->angle == NULL)
+    {
+        printf("Error allocating zone thresholds.\n");
+        zones_free(zones);
+        return -1;
+    }
+
+    // Angle of the centre of each (possibly clustered) beam.
+    for (i = 0; i < zones->count; i++)
+        zones->angle[i] = (zones->first + (i + 0.5f) * zones->cluster - 0.5f
+                        - spec->step_front) * 2.0f * M_PI / spec->ang_res;
+
+    return 0;
+}
+
+//  ===========================================================================
+//  Returns true if the sensor origin lies inside polygon.
+//  ===========================================================================
+static bool zone_contains_origin(const vertex_t *poly, int vertices)
+{
+    bool inside = false;
+    int  i, j;
+
+    for (i = 0, j = vertices - 1; i < vertices; j = i++)
+    {
+        if ((poly[i].y > 0) != (poly[j].y > 0) &&
+            0 < (poly[j].x - poly[i].x) * (0 - poly[i].y)
+              / (poly[j].y - poly[i].y) + poly[i].x)
+            inside = !inside;
+    }
+
+    return (inside);
+}
+
+//  ===========================================================================
+//  Compiles polygon into per-beam limits, returns zone id.
+//  ===========================================================================
+int zone_add(zones_t *zones, const vertex_t *poly, int vertices,
+             uint16_t min_beams, uint16_t on_frames, uint16_t off_frames)
+{
+    uint16_t *lo;
+    uint16_t *hi;
+    zone_t   *zone;
+    bool      inside;
+    float     dx, dy;
+    float     ex, ey;
+    float     denom, t, u;
+    float     t_min, t_max;
+    int       id;
+    int       i, j, k;
+
+    if (zones->zones >= ZONES_MAX || vertices < 3) return -1;
+
+    id = zones->zones;
+    lo = &zones->lo[id * zones->stride];
+    hi = &zones->hi[id * zones->stride];
+    inside = zone_contains_origin(poly, vertices);
+
+    for (i = 0; i < zones->stride; i++)
+    {
+        lo[i] = UINT16_MAX;
+        hi[i] = 0;
+    }
+
+    for (i = 0; i < zones->count; i++)
+    {
+        dx = cosf(zones->angle[i]);
+        dy = sinf(zones->angle[i]);
+        t_min = INFINITY;
+        t_max = -INFINITY;
+
+        // Intersect beam with each edge.
+        for (j = 0, k = vertices - 1; j < vertices; k = j++)
+        {
+            ex = poly[j].x - poly[k].x;
+            ey = poly[j].y - poly[k].y;
+            denom = dx * ey - dy * ex;
+            if (fabsf(denom) < 1e-9f) continue;
+
+            t = (poly[k].x * ey - poly[k].y * ex) / denom;
+            u = (poly[k].x * dy - poly[k].y * dx) / denom;
+            if (t < 0 || u < 0 || u > 1) continue;
+
+            if (t < t_min) t_min = t;
+            if (t > t_max) t_max = t;
+        }
+
+        if (t_max < 0) continue;
+        if (inside) t_min = 0;
+
+        t_min = floorf(t_min * 1000.0f);
+        t_max = ceilf(t_max * 1000.0f);
+
+        // Clamped both ways, as out of range conversion to uint16_t is
+        // undefined.
+        if (t_min > UINT16_MAX - 1) t_min = UINT16_MAX - 1;
+        lo[i] = (t_min < zones->dist_min) ? zones->dist_min : t_min;
+        hi[i] = (t_max > UINT16_MAX - 1) ? UINT16_MAX - 1 : t_max;
+    }
+
+    zone = &zones->zone[id];
+    zone->min_beams = (min_beams > 0) ? min_beams : 1;
+    zone->on_frames = (on_frames > 0) ? on_frames : 1;
+    zone->off_frames = (off_frames > 0) ? off_frames : 1;
+    zone->run = 0;
+    zone->beams = 0;
+    zone->active = false;
+
+    zones->zones++;
+
+    return (id);
+}
+
+//  ===========================================================================
+//  Returns number of beams within a zone's limits.
+//  ===========================================================================
+static int zone_beams(const uint16_t *range, const uint16_t *lo,
+                      const uint16_t *hi, int count)
+{
+    v8s16 acc = {0};
+    int   beams;
+    int   i;
+
+    /*
+        Vector compares give -1 in each matching lane, so subtracting the
+        mask counts matches per lane. A lane sees at most stride / 8 beams
+        so it cannot overflow.
+    */
+    for (i = 0; i + ZONE_LANES <= count; i += ZONE_LANES)
+    {
+        v8u16 r = *(const v8u16u *)&range[i];
+        v8u16 l = *(const v8u16 *)&lo[i];
+        v8u16 h = *(const v8u16 *)&hi[i];
+
+        acc -= (v8s16)((r >= l) & (r <= h));
+    }
+
+    beams = 0;
+    for (int lane = 0; lane < ZONE_LANES; lane++) beams += acc[lane];
+
+    for (; i < count; i++)
+        beams += (range[i] >= lo[i] && range[i] <= hi[i]);
+
+    return (beams);
+}
+
+//  ===========================================================================
+//  Checks frame against all zones, returns number of active zones.
+//  ===========================================================================
+int zones_check(zones_t *zones, const scan_t *scan)
+{
+    zone_t  *zone;
+    uint64_t bit;
+    bool     hit;
+    int      active;
+    int      word;
+    int      id;
+
+    if (scan->count != zones->count || scan->first != zones->first ||
+        scan->cluster != zones->cluster)
+    {
+        printf("Scan does not match zone layout.\n");
+        return -1;
+    }
+
+    memset(zones->hit, 0, sizeof(zones->hit));
+    active = 0;
+
+    for (id = 0; id < zones->zones; id++)
+    {
+        zone = &zones->zone[id];
+        word = id / 64;
+        bit = 1ULL << (id % 64);
+
+        zone->beams = zone_beams(scan->range,
+                                 &zones->lo[id * zones->stride],
+                                 &zones->hi[id * zones->stride],
+                                 scan->count);
+        hit = (zone->beams >= zone->min_beams);
+        if (hit) zones->hit[word] |= bit;
+
+        // Count the run of frames that disagree with the current state.
+        if (hit != zone->active)
+        {
+            zone->run++;
+            if (zone->run >= (hit ? zone->on_frames : zone->off_frames))
+            {
+                zone->active = hit;
+                zone->run = 0;
+                zones->active[word] ^= bit;
+                if (zones->event != NULL) zones->event(id, hit, zones->arg);
+            }
+        }
+        else
+        {
+            zone->run = 0;
+        }
+
+        active += zone->active;
+    }
+
+    return (active);
+}
+
+//  ===========================================================================
+//  Releases zone engine.
+//  ===========================================================================
+void zones_free(zones_t *zones)
+{
+    free(zones->lo);
+    free(zones->hi);
+    free(zones->angle);
+
+    zones->lo = NULL;
+    zones->hi = NULL;
+    zones->angle = NULL;
+    zones->zones = 0;
+}
@@ -0,0 +1,104 @@
+//  ===========================================================================
+//  Zone intrusion detection for Hokuyo URG-04LX-UG01 laser scanner.
+//  ===========================================================================
+/*
+    Copyright 2017 Darren Faulke <darren@alidaf.co.uk>
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+
+/*
+    Zones are polygons in the sensor frame (metres). Each one is compiled
+    once into a minimum and maximum range for every beam, so checking a
+    frame is a vector compare of the range array against the two limits.
+
+    Compiling:
+
+    Each beam is intersected with every polygon edge. The limits are the
+    nearest and furthest crossings, or zero to the furthest crossing if the
+    sensor is inside the polygon. For a non-convex polygon a beam can leave
+    and re-enter, and the gap in between is treated as inside, so the zone
+    errs on the side of triggering. Beams that miss the polygon never match.
+    The lower limit is clamped to DMIN so error codes never match either.
+
+    Checking:
+
+    A zone is hit when at least min_beams beams fall within their limits.
+    It becomes active after on_frames consecutive hits and inactive after
+    off_frames consecutive misses, and the event callback is called on each
+    change. The raw hits and debounced states are also kept as bitmasks.
+*/
+
+//  ===========================================================================
+
+#ifndef URG_ZONE_H
+#define URG_ZONE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "urg-multi.h"
+
+//  Defines. ------------------------------------------------------------------
+
+#define ZONES_MAX   512     // Max number of zones per sensor.
+#define ZONE_WORDS  (ZONES_MAX / 64)
+#define ZONE_ALIGN  16      // Alignment of threshold rows (bytes).
+
+//  Types. --------------------------------------------------------------------
+
+typedef struct
+{
+    float x;                // Metres.
+    float y;
+} vertex_t;
+
+/* Called when a zone changes state. */
+typedef void (*zone_event_t)(int zone, bool active, void *arg);
+
+typedef struct
+{
+    uint16_t min_beams;     // Beams needed for a hit.
+    uint16_t on_frames;     // Consecutive hits to activate.
+    uint16_t off_frames;    // Consecutive misses to deactivate.
+    uint16_t run;           // Current run of hits or misses.
+    uint16_t beams;         // Beams within limits in last frame.
+    bool     active;        // Debounced state.
+} zone_t;
+
+typedef struct
+{
+    uint16_t first;         // First step.
+    uint16_t cluster;       // Steps per beam.
+    uint16_t count;         // Beams per frame.
+    uint16_t stride;        // Threshold row length (padded).
+    uint16_t dist_min;      // DMIN (mm).
+    int      zones;         // Number of zones added.
+    uint16_t *lo;           // Per-zone, per-beam minimum range (mm).
+    uint16_t *hi;           // Per-zone, per-beam maximum range (mm).
+    float    *angle;        // Per-beam angle (radians).
+    zone_t   zone[ZONES_MAX];
+    uint64_t hit[ZONE_WORDS];       // Zones hit in last frame.
+    uint64_t active[ZONE_WORDS];    // Debounced zone states.
+    zone_event_t event;
+    void    *arg;
+} zones_t;
+
+//  Functions. ----------------------------------------------------------------
+
+int zones_init(zones_t *zones, const spec_t *spec, const acq_t *acq,
+               zone_event_t event, void *arg);
+int zone_add(zones_t *zones, const vertex_t *poly, int vertices,
+             uint16_t min_beams, uint16_t on_frames, uint16_t off_frames);
+int zones_check(zones_t *zones, const scan_t *scan);
+void zones_free(zones_t *zones);
+
+#endif